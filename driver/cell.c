@@ -13,10 +13,14 @@
 /* For compatibility with older kernel versions */
 #include <linux/version.h>
 
+#include <linux/anon_inodes.h>
 #include <linux/cpu.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <asm/cacheflush.h>
 
 #include "cell.h"
@@ -31,6 +35,14 @@
 #define remove_cpu(cpu)		cpu_down(cpu)
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+#include <linux/mmu_context.h>
+#define kthread_use_mm(mm)	use_mm(mm)
+#define kthread_unuse_mm(mm)	unuse_mm(mm)
+#else
+#include <linux/kthread.h>
+#endif
+
 struct cell *root_cell;
 
 static LIST_HEAD(cells);
@@ -69,6 +81,7 @@ retry:
 		return ERR_PTR(-ENOMEM);
 
 	INIT_LIST_HEAD(&cell->entry);
+	mutex_init(&cell->load_lock);
 
 	cell->id = id;
 
@@ -306,77 +319,236 @@ static int cell_management_prologue(struct jailhouse_cell_id *cell_id,
 
 #define MEM_REQ_FLAGS	(JAILHOUSE_MEM_WRITE | JAILHOUSE_MEM_LOADABLE)
 
-static int load_image(struct cell *cell,
-		      struct jailhouse_preload_image __user *uimage)
+static const struct jailhouse_memory *
+find_loadable_region(struct cell *cell, u64 target_address, u64 size,
+		     u64 *region_offset)
 {
-	struct jailhouse_preload_image image;
-	const struct jailhouse_memory *mem;
-	unsigned int regions, page_offs;
-	u64 image_offset, phys_start;
-	void *image_mem;
-	int err = 0;
-
-	if (copy_from_user(&image, uimage, sizeof(image)))
-		return -EFAULT;
+	const struct jailhouse_memory *mem = cell->memory_regions;
+	unsigned int regions;
 
-	if (image.size == 0)
-		return 0;
-
-	mem = cell->memory_regions;
 	for (regions = cell->num_memory_regions; regions > 0; regions--) {
-		image_offset = image.target_address - mem->virt_start;
-		if (image.target_address >= mem->virt_start &&
-		    image_offset < mem->size) {
-			if (image.size > mem->size - image_offset ||
+		*region_offset = target_address - mem->virt_start;
+		if (target_address >= mem->virt_start &&
+		    *region_offset < mem->size) {
+			if (size > mem->size - *region_offset ||
 			    (mem->flags & MEM_REQ_FLAGS) != MEM_REQ_FLAGS)
-				return -EINVAL;
-			break;
+				return NULL;
+			return mem;
 		}
 		mem++;
 	}
-	if (regions == 0)
-		return -EINVAL;
-
-	phys_start = (mem->phys_start + image_offset) & PAGE_MASK;
-	page_offs = offset_in_page(image_offset);
-	image_mem = jailhouse_ioremap(phys_start, 0,
-				      PAGE_ALIGN(image.size + page_offs));
-	if (!image_mem) {
-		pr_err("jailhouse: Unable to map cell RAM at %08llx "
-		       "for image loading\n",
-		       (unsigned long long)(mem->phys_start + image_offset));
-		return -EBUSY;
-	}
+	return NULL;
+}
 
-	if (copy_from_user(image_mem + page_offs,
-			   (void __user *)(unsigned long)image.source_address,
-			   image.size))
-		err = -EFAULT;
+static void flush_image(void *image_mem, unsigned long size)
+{
 	/*
 	 * ARMv7 and ARMv8 require to clean D-cache and invalidate I-cache for
 	 * memory containing new instructions. On x86 this is a NOP.
 	 */
-	flush_icache_range((unsigned long)(image_mem + page_offs),
-			   (unsigned long)(image_mem + page_offs) + image.size);
+	flush_icache_range((unsigned long)image_mem,
+			   (unsigned long)image_mem + size);
 #ifdef CONFIG_ARM
 	/*
 	 * ARMv7 requires to flush the written code and data out of D-cache to
 	 * allow the guest starting off with caches disabled.
 	 */
-	__cpuc_flush_dcache_area(image_mem + page_offs, image.size);
+	__cpuc_flush_dcache_area(image_mem, size);
 #endif
+}
 
-	vunmap(image_mem);
+struct load_window {
+	const struct jailhouse_memory *mem;
+	u64 start, end;
+	u64 data_start, data_end;
+	void *image_mem;
+};
+
+struct load_work {
+	struct work_struct work;
+	struct mm_struct *mm;
+	struct jailhouse_preload_image image;
+	struct load_window *window;
+	u64 window_offs;
+	u64 duration_ns;
+	int err;
+};
+
+static void load_image_work(struct work_struct *work)
+{
+	struct load_work *load = container_of(work, struct load_work, work);
+	u64 start = ktime_get_ns();
+
+	kthread_use_mm(load->mm);
+	if (copy_from_user(load->window->image_mem + load->window_offs,
+			   (void __user *)(unsigned long)
+				load->image.source_address,
+			   load->image.size))
+		load->err = -EFAULT;
+	kthread_unuse_mm(load->mm);
+
+	load->duration_ns = ktime_get_ns() - start;
+}
+
+static bool images_overlap(const struct jailhouse_preload_image *a,
+			   const struct jailhouse_preload_image *b)
+{
+	return a->target_address < b->target_address + b->size &&
+		b->target_address < a->target_address + a->size;
+}
+
+/*
+ * Returns the mapping window of the given memory region that the image at
+ * offset, with the given size, shares pages with or directly adjoins. A new
+ * window is set up if there is none.
+ */
+static struct load_window *get_load_window(struct load_window *windows,
+					   unsigned int *num_windows,
+					   const struct jailhouse_memory *mem,
+					   u64 offset, u64 size)
+{
+	u64 start = round_down(offset, PAGE_SIZE);
+	u64 end = round_up(offset + size, PAGE_SIZE);
+	struct load_window *window;
+	unsigned int n;
+
+	for (n = 0, window = windows; n < *num_windows; n++, window++)
+		if (window->mem == mem && start <= window->end &&
+		    end >= window->start) {
+			window->start = min(window->start, start);
+			window->end = max(window->end, end);
+			window->data_start = min(window->data_start, offset);
+			window->data_end = max(window->data_end, offset + size);
+			return window;
+		}
+
+	window->mem = mem;
+	window->start = start;
+	window->end = end;
+	window->data_start = offset;
+	window->data_end = offset + size;
+	(*num_windows)++;
+
+	return window;
+}
+
+/*
+ * Copies the preload images into the cell. Images that are contiguous within
+ * a memory region share a single mapping window and a single cache
+ * maintenance pass. Images further apart get separate windows so that the
+ * unused RAM between them is not mapped, which could exhaust the vmalloc
+ * space on 32-bit hosts. The images are copied concurrently by kernel
+ * workers. As the copy order is undefined, overlapping images are rejected.
+ */
+static int load_images(struct cell *cell,
+		       struct jailhouse_preload_image __user *uimages,
+		       unsigned int num_images)
+{
+	unsigned int n, m, num_loads = 0, num_windows = 0;
+	struct load_window *windows, *window;
+	struct load_work *loads, *load;
+	const struct jailhouse_memory *mem;
+	u64 image_offset, phys_start;
+	int err = 0;
+
+	loads = kcalloc(num_images, sizeof(*loads), GFP_KERNEL);
+	windows = kcalloc(num_images, sizeof(*windows), GFP_KERNEL);
+	if (!loads || !windows) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	for (n = 0; n < num_images; n++) {
+		load = &loads[num_loads];
+		if (copy_from_user(&load->image, &uimages[n],
+				   sizeof(load->image))) {
+			err = -EFAULT;
+			goto out_free;
+		}
+		if (load->image.size == 0)
+			continue;
+
+		mem = find_loadable_region(cell, load->image.target_address,
+					   load->image.size, &image_offset);
+		if (!mem) {
+			err = -EINVAL;
+			goto out_free;
+		}
+
+		for (m = 0; m < num_loads; m++)
+			if (images_overlap(&loads[m].image, &load->image)) {
+				pr_err("jailhouse: Overlapping images at "
+				       "%08llx\n", load->image.target_address);
+				err = -EINVAL;
+				goto out_free;
+			}
+
+		load->window = get_load_window(windows, &num_windows, mem,
+					       image_offset, load->image.size);
+		num_loads++;
+	}
+
+	/* windows may have grown after an image was added to them */
+	for (n = 0, load = loads; n < num_loads; n++, load++) {
+		mem = load->window->mem;
+		load->window_offs = load->image.target_address -
+			mem->virt_start - load->window->start;
+	}
+
+	for (n = 0, window = windows; n < num_windows; n++, window++) {
+		phys_start = window->mem->phys_start + window->start;
+		window->image_mem =
+			jailhouse_ioremap(phys_start, 0,
+					  window->end - window->start);
+		if (!window->image_mem) {
+			pr_err("jailhouse: Unable to map cell RAM at %08llx "
+			       "for image loading\n",
+			       (unsigned long long)phys_start);
+			err = -EBUSY;
+			goto out_unmap;
+		}
+	}
+
+	for (n = 0, load = loads; n < num_loads; n++, load++) {
+		load->mm = current->mm;
+		INIT_WORK(&load->work, load_image_work);
+		queue_work(system_unbound_wq, &load->work);
+	}
+
+	for (n = 0, load = loads; n < num_loads; n++, load++) {
+		flush_work(&load->work);
+		if (load->err && !err)
+			err = load->err;
+
+		pr_debug("jailhouse: loaded %llu bytes to %08llx in %llu us "
+			 "(%llu KiB/s)\n",
+			 load->image.size, load->image.target_address,
+			 div_u64(load->duration_ns, NSEC_PER_USEC),
+			 div64_u64(load->image.size * (NSEC_PER_SEC / 1024),
+				   load->duration_ns ? : 1));
+	}
+
+	for (n = 0, window = windows; n < num_windows; n++, window++)
+		flush_image(window->image_mem + window->data_start -
+			    window->start,
+			    window->data_end - window->data_start);
+
+out_unmap:
+	for (n = 0, window = windows; n < num_windows; n++, window++)
+		if (window->image_mem)
+			vunmap(window->image_mem);
+
+out_free:
+	kfree(windows);
+	kfree(loads);
 
 	return err;
 }
 
 int jailhouse_cmd_cell_load(struct jailhouse_cell_load __user *arg)
 {
-	struct jailhouse_preload_image __user *image = arg->image;
 	struct jailhouse_cell_load cell_load;
 	struct cell *cell;
-	unsigned int n;
 	int err;
 
 	if (copy_from_user(&cell_load, arg, sizeof(cell_load)))
@@ -386,23 +558,153 @@ int jailhouse_cmd_cell_load(struct jailhouse_cell_load __user *arg)
 	if (err)
 		return err;
 
+	mutex_lock(&cell->load_lock);
 	err = jailhouse_call_arg1(JAILHOUSE_HC_CELL_SET_LOADABLE, cell->id);
+	if (!err)
+		cell->loadable = true;
+	mutex_unlock(&cell->load_lock);
+
+	if (!err && cell_load.num_preload_images > 0)
+		err = load_images(cell, arg->image,
+				  cell_load.num_preload_images);
+
+	mutex_unlock(&jailhouse_lock);
+
+	return err;
+}
+
+int jailhouse_cmd_cell_start(const char __user *arg)
+{
+	struct jailhouse_cell_id cell_id;
+	struct cell *cell;
+	int err;
+
+	if (copy_from_user(&cell_id, arg, sizeof(cell_id)))
+		return -EFAULT;
+
+	err = cell_management_prologue(&cell_id, &cell);
 	if (err)
-		goto unlock_out;
+		return err;
 
-	for (n = cell_load.num_preload_images; n > 0; n--, image++) {
-		err = load_image(cell, image);
-		if (err)
-			break;
+	mutex_lock(&cell->load_lock);
+	/* the cell memory must no longer be accessible via loader mappings */
+	if (cell->load_files > 0) {
+		err = -EBUSY;
+	} else {
+		err = jailhouse_call_arg1(JAILHOUSE_HC_CELL_START, cell->id);
+		if (!err)
+			cell->loadable = false;
 	}
+	mutex_unlock(&cell->load_lock);
 
-unlock_out:
 	mutex_unlock(&jailhouse_lock);
 
 	return err;
 }
 
-int jailhouse_cmd_cell_start(const char __user *arg)
+/*
+ * Cache maintenance for an image that was written via a loader mapping, see
+ * also load_images. Only needed on ARM, and only possible as long as the cell
+ * memory is still accessible, i.e. the cell was not destroyed meanwhile.
+ */
+static void cell_mmap_close(struct vm_area_struct *vma)
+{
+#if defined(CONFIG_ARM) || defined(CONFIG_ARM64)
+	struct cell *cell = vma->vm_file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	const struct jailhouse_memory *mem;
+	u64 region_offset;
+	void *image_mem;
+
+	mutex_lock(&cell->load_lock);
+	if (!cell->loadable)
+		goto out;
+
+	mem = find_loadable_region(cell, (u64)vma->vm_pgoff << PAGE_SHIFT,
+				   size, &region_offset);
+	if (!mem)
+		goto out;
+
+	image_mem = jailhouse_ioremap(mem->phys_start + region_offset, 0,
+				      size);
+	if (!image_mem) {
+		pr_err("jailhouse: Unable to map cell RAM for cache "
+		       "maintenance\n");
+		goto out;
+	}
+	flush_image(image_mem, size);
+	vunmap(image_mem);
+
+out:
+	mutex_unlock(&cell->load_lock);
+#endif
+}
+
+static const struct vm_operations_struct cell_mmap_vm_ops = {
+	.close = cell_mmap_close,
+};
+
+/*
+ * Maps the loadable memory of a cell into the caller's address space. The
+ * file offset corresponds to the cell-virtual address of the target region,
+ * so that images can be read directly into their final location.
+ */
+static int cell_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct cell *cell = file->private_data;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	const struct jailhouse_memory *mem;
+	u64 region_offset;
+	int err;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	mutex_lock(&cell->load_lock);
+
+	if (!cell->loadable) {
+		err = -EPERM;
+		goto out;
+	}
+
+	mem = find_loadable_region(cell, (u64)vma->vm_pgoff << PAGE_SHIFT,
+				   size, &region_offset);
+	if (!mem || offset_in_page(mem->phys_start + region_offset)) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	vma->vm_ops = &cell_mmap_vm_ops;
+	err = remap_pfn_range(vma, vma->vm_start,
+			      (mem->phys_start + region_offset) >> PAGE_SHIFT,
+			      size, vma->vm_page_prot);
+
+out:
+	mutex_unlock(&cell->load_lock);
+
+	return err;
+}
+
+static int cell_mmap_release(struct inode *inode, struct file *file)
+{
+	struct cell *cell = file->private_data;
+
+	mutex_lock(&cell->load_lock);
+	cell->load_files--;
+	mutex_unlock(&cell->load_lock);
+
+	kobject_put(&cell->kobj);
+
+	return 0;
+}
+
+static const struct file_operations cell_mmap_fops = {
+	.owner = THIS_MODULE,
+	.mmap = cell_mmap,
+	.release = cell_mmap_release,
+};
+
+int jailhouse_cmd_cell_mmap(const char __user *arg)
 {
 	struct jailhouse_cell_id cell_id;
 	struct cell *cell;
@@ -415,8 +717,23 @@ int jailhouse_cmd_cell_start(const char __user *arg)
 	if (err)
 		return err;
 
-	err = jailhouse_call_arg1(JAILHOUSE_HC_CELL_START, cell->id);
+	mutex_lock(&cell->load_lock);
+	if (!cell->loadable) {
+		err = -EPERM;
+		goto unlock_out;
+	}
 
+	kobject_get(&cell->kobj);
+	err = anon_inode_getfd("jailhouse-cell", &cell_mmap_fops, cell,
+			       O_RDWR | O_CLOEXEC);
+	if (err < 0) {
+		kobject_put(&cell->kobj);
+		goto unlock_out;
+	}
+	cell->load_files++;
+
+unlock_out:
+	mutex_unlock(&cell->load_lock);
 	mutex_unlock(&jailhouse_lock);
 
 	return err;
@@ -427,7 +744,15 @@ static int cell_destroy(struct cell *cell)
 	unsigned int cpu;
 	int err;
 
+	mutex_lock(&cell->load_lock);
 	err = jailhouse_call_arg1(JAILHOUSE_HC_CELL_DESTROY, cell->id);
+	/*
+	 * Existing loader mappings stay valid as the memory returns to the
+	 * root cell, but it must no longer be handled as cell memory.
+	 */
+	if (!err)
+		cell->loadable = false;
+	mutex_unlock(&cell->load_lock);
 	if (err)
 		return err;
 
@@ -16,6 +16,7 @@
 #include <linux/cpumask.h>
 #include <linux/list.h>
 #include <linux/kobject.h>
+#include <linux/mutex.h>
 #include <linux/uaccess.h>
 
 #include "jailhouse.h"
@@ -32,6 +33,10 @@ struct cell {
 	cpumask_t cpus_assigned;
 	u32 num_memory_regions;
 	struct jailhouse_memory *memory_regions;
+	/* protects loadable and load_files */
+	struct mutex load_lock;
+	bool loadable;
+	unsigned int load_files;
 #ifdef CONFIG_PCI
 	u32 num_pci_devices;
 	struct jailhouse_pci_device *pci_devices;
@@ -51,6 +56,8 @@ int jailhouse_cmd_cell_load(struct jailhouse_cell_load __user *arg);
 int jailhouse_cmd_cell_start(const char __user *arg);
 int jailhouse_cmd_cell_destroy(const char __user *arg);
 
+int jailhouse_cmd_cell_mmap(const char __user *arg);
+
 int jailhouse_cmd_cell_destroy_non_root(void);
 
 #endif /* !_JAILHOUSE_DRIVER_CELL_H */
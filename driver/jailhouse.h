@@ -72,11 +72,51 @@ struct jailhouse_cell_load {
 
 #define JAILHOUSE_CELL_ID_UNUSED	(-1)
 
+/*
+ * Query for JAILHOUSE_GET_STATS. The ioctl copies up to buffer_size bytes of
+ * a statistics snapshot, formatted as struct jailhouse_stats_page, and
+ * returns the full size of the snapshot.
+ */
+struct jailhouse_stats_query {
+	__u64 buffer_address;
+	__u32 buffer_size;
+	__u32 padding;
+};
+
+/*
+ * Query for JAILHOUSE_TRACE_READ. The ioctl copies up to buffer_size bytes of
+ * trace records of the given CPU, starting with record number position or
+ * the oldest one still available, and returns the number of records copied.
+ * On return, position holds the number of the first copied record, max_cpus
+ * the number of per-CPU trace rings and timestamp_khz the frequency of the
+ * record timestamps.
+ */
+struct jailhouse_trace_query {
+	__u64 buffer_address;
+	__u32 buffer_size;
+	__u32 cpu;
+	__u32 position;
+	__u32 max_cpus;
+	__u32 timestamp_khz;
+	__u32 padding;
+};
+
+/* Event codes are JAILHOUSE_TRACE_* from jailhouse/trace-events.h. */
+struct jailhouse_trace_record {
+	__u64 timestamp;
+	__u32 cpu;
+	__u32 event;
+	__u64 arg[2];
+};
+
 #define JAILHOUSE_ENABLE		_IOW(0, 0, void *)
 #define JAILHOUSE_DISABLE		_IO(0, 1)
 #define JAILHOUSE_CELL_CREATE		_IOW(0, 2, struct jailhouse_cell_create)
 #define JAILHOUSE_CELL_LOAD		_IOW(0, 3, struct jailhouse_cell_load)
 #define JAILHOUSE_CELL_START		_IOW(0, 4, struct jailhouse_cell_id)
 #define JAILHOUSE_CELL_DESTROY		_IOW(0, 5, struct jailhouse_cell_id)
+#define JAILHOUSE_CELL_MMAP		_IOW(0, 6, struct jailhouse_cell_id)
+#define JAILHOUSE_GET_STATS		_IOW(0, 7, struct jailhouse_stats_query)
+#define JAILHOUSE_TRACE_READ		_IOWR(0, 8, struct jailhouse_trace_query)
 
 #endif /* !_JAILHOUSE_DRIVER_H */
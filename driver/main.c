@@ -106,6 +106,8 @@ static atomic_t call_done;
 static int error_code;
 static struct jailhouse_virt_console* volatile console_page;
 static bool console_available;
+static struct jailhouse_stats_page *stats_page;
+static struct jailhouse_trace_buffer *trace_buffer;
 static struct resource *hypervisor_mem_res;
 
 static typeof(ioremap_page_range) *ioremap_page_range_sym;
@@ -172,6 +174,33 @@ static void copy_console_page(struct jailhouse_virt_console *dst)
 	} while (console_page->tail != tail || console_page->busy);
 }
 
+/*
+ * Reads the statistics slot of a CPU from the page published by the
+ * hypervisor, retrying while the CPU is updating it. Returns false if the
+ * page is not available.
+ */
+bool jailhouse_read_cpu_stats(unsigned int cpu,
+			      struct jailhouse_cpu_stats *dst)
+{
+	struct jailhouse_cpu_stats *slot;
+	u32 seq;
+
+	if (!stats_page || cpu >= stats_page->max_cpus)
+		return false;
+
+	slot = &stats_page->cpu[cpu];
+	do {
+		while ((seq = READ_ONCE(slot->seq)) & 1)
+			cpu_relax();
+		rmb();
+
+		memcpy(dst, (void *)slot, sizeof(*dst));
+		rmb();
+	} while (READ_ONCE(slot->seq) != seq);
+
+	return true;
+}
+
 static inline void update_last_console(void)
 {
 	if (!console_available)
@@ -379,6 +408,7 @@ static int jailhouse_cmd_enable(struct jailhouse_system __user *arg)
 	unsigned long config_size;
 	unsigned int clock_gates;
 	const char *fw_name;
+	int stats_offset, trace_offset;
 	long max_cpus;
 	int err;
 
@@ -615,6 +645,16 @@ static int jailhouse_cmd_enable(struct jailhouse_system __user *arg)
 
 	release_firmware(hypervisor);
 
+	stats_offset = jailhouse_call_arg1(JAILHOUSE_HC_HYPERVISOR_GET_INFO,
+					   JAILHOUSE_INFO_STATS_PAGE);
+	if (stats_offset > 0)
+		stats_page = hypervisor_mem + stats_offset;
+
+	trace_offset = jailhouse_call_arg1(JAILHOUSE_HC_HYPERVISOR_GET_INFO,
+					   JAILHOUSE_INFO_TRACE_BUFFER);
+	if (trace_offset > 0)
+		trace_buffer = hypervisor_mem + trace_offset;
+
 	jailhouse_cell_register_root();
 	jailhouse_pci_virtual_root_devices_add(&config_header);
 
@@ -742,6 +782,8 @@ static int jailhouse_cmd_disable(void)
 
 	update_last_console();
 
+	stats_page = NULL;
+	trace_buffer = NULL;
 	jailhouse_cell_delete_root();
 	jailhouse_enabled = false;
 	module_put(THIS_MODULE);
@@ -754,6 +796,140 @@ unlock_out:
 	return err;
 }
 
+static long jailhouse_cmd_get_stats(struct jailhouse_stats_query __user *arg)
+{
+	struct jailhouse_stats_query query;
+	struct jailhouse_stats_page *snapshot;
+	size_t size = 0;
+	unsigned int cpu;
+	long err;
+
+	if (copy_from_user(&query, arg, sizeof(query)))
+		return -EFAULT;
+
+	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
+		return -EINTR;
+
+	if (!jailhouse_enabled || !stats_page) {
+		err = -EINVAL;
+		goto unlock_out;
+	}
+
+	size = sizeof(*snapshot) +
+		stats_page->max_cpus * sizeof(snapshot->cpu[0]);
+	snapshot = kmalloc(size, GFP_KERNEL);
+	if (!snapshot) {
+		err = -ENOMEM;
+		goto unlock_out;
+	}
+
+	snapshot->max_cpus = stats_page->max_cpus;
+	snapshot->num_stats = stats_page->num_stats;
+	for (cpu = 0; cpu < snapshot->max_cpus; cpu++)
+		jailhouse_read_cpu_stats(cpu, &snapshot->cpu[cpu]);
+
+	err = size;
+	if (copy_to_user((void __user *)(unsigned long)query.buffer_address,
+			 snapshot, min_t(size_t, size, query.buffer_size)))
+		err = -EFAULT;
+
+	kfree(snapshot);
+
+unlock_out:
+	mutex_unlock(&jailhouse_lock);
+
+	return err;
+}
+
+static long jailhouse_cmd_trace_read(struct jailhouse_trace_query __user *arg)
+{
+	struct jailhouse_trace_record *records = NULL;
+	struct jailhouse_trace_query query;
+	struct jailhouse_trace_entry *entry;
+	struct jailhouse_trace_ring *ring;
+	unsigned int num_entries, count, skip, n;
+	u32 head, first;
+	long err;
+
+	if (copy_from_user(&query, arg, sizeof(query)))
+		return -EFAULT;
+
+	if (mutex_lock_interruptible(&jailhouse_lock) != 0)
+		return -EINTR;
+
+	if (!jailhouse_enabled) {
+		err = -EINVAL;
+		goto unlock_out;
+	}
+	if (!trace_buffer) {
+		err = -EOPNOTSUPP;
+		goto unlock_out;
+	}
+	if (query.cpu >= trace_buffer->max_cpus) {
+		err = -EINVAL;
+		goto unlock_out;
+	}
+
+	num_entries = trace_buffer->num_entries;
+	ring = (void *)trace_buffer + sizeof(*trace_buffer) +
+		query.cpu * (sizeof(*ring) + num_entries * sizeof(*entry));
+
+	/*
+	 * Only num_entries - 1 entries are stable: the hypervisor may already
+	 * write the slot of the oldest one.
+	 */
+	count = min_t(unsigned int, query.buffer_size / sizeof(*records),
+		      num_entries - 1);
+	if (count > 0) {
+		records = kmalloc_array(count, sizeof(*records), GFP_KERNEL);
+		if (!records) {
+			err = -ENOMEM;
+			goto unlock_out;
+		}
+	}
+
+	head = READ_ONCE(ring->head);
+	rmb();
+
+	first = query.position;
+	if (head - first > num_entries - 1)
+		first = head > num_entries - 1 ? head - (num_entries - 1) : 0;
+	count = min(count, head - first);
+
+	for (n = 0; n < count; n++) {
+		entry = &ring->entry[(first + n) % num_entries];
+		records[n].timestamp = entry->timestamp;
+		records[n].cpu = entry->cpu;
+		records[n].event = entry->event;
+		records[n].arg[0] = entry->arg[0];
+		records[n].arg[1] = entry->arg[1];
+	}
+
+	/* drop records that were overwritten while copying them */
+	rmb();
+	head = READ_ONCE(ring->head);
+	skip = 0;
+	if (head - first > num_entries - 1)
+		skip = min(count, head - first - (num_entries - 1));
+
+	query.position = first + skip;
+	query.max_cpus = trace_buffer->max_cpus;
+	query.timestamp_khz = trace_buffer->timestamp_khz;
+
+	err = count - skip;
+	if (copy_to_user((void __user *)(unsigned long)query.buffer_address,
+			 records + skip, (count - skip) * sizeof(*records)) ||
+	    copy_to_user(arg, &query, sizeof(query)))
+		err = -EFAULT;
+
+	kfree(records);
+
+unlock_out:
+	mutex_unlock(&jailhouse_lock);
+
+	return err;
+}
+
 static long jailhouse_ioctl(struct file *file, unsigned int ioctl,
 			    unsigned long arg)
 {
@@ -781,8 +957,19 @@ static long jailhouse_ioctl(struct file *file, unsigned int ioctl,
 	case JAILHOUSE_CELL_DESTROY:
 		err = jailhouse_cmd_cell_destroy((const char __user *)arg);
 		break;
+	case JAILHOUSE_CELL_MMAP:
+		err = jailhouse_cmd_cell_mmap((const char __user *)arg);
+		break;
+	case JAILHOUSE_GET_STATS:
+		err = jailhouse_cmd_get_stats(
+			(struct jailhouse_stats_query __user *)arg);
+		break;
+	case JAILHOUSE_TRACE_READ:
+		err = jailhouse_cmd_trace_read(
+			(struct jailhouse_trace_query __user *)arg);
+		break;
 	default:
-		err = -EINVAL;
+		err = -ENOTTY;
 		break;
 	}
 
@@ -34,4 +34,8 @@ void *jailhouse_ioremap(phys_addr_t phys, unsigned long virt,
 int jailhouse_console_dump_delta(char *dst, unsigned int head,
 				 unsigned int *miss);
 
+struct jailhouse_cpu_stats;
+bool jailhouse_read_cpu_stats(unsigned int cpu,
+			      struct jailhouse_cpu_stats *dst);
+
 #endif /* !_JAILHOUSE_DRIVER_MAIN_H */
@@ -82,24 +82,35 @@ struct jailhouse_cpu_stats_attr {
 	unsigned int code;
 };
 
+/*
+ * Statistics are read from the page published by the hypervisor. Only if that
+ * is unavailable, a hypercall is issued.
+ */
+static u32 read_cpu_stat(unsigned int cpu, unsigned int code)
+{
+	struct jailhouse_cpu_stats stats;
+	int value;
+
+	if (jailhouse_read_cpu_stats(cpu, &stats))
+		return stats.stats[code];
+
+	value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO, cpu,
+				    JAILHOUSE_CPU_INFO_STAT_BASE + code);
+	return value > 0 ? value : 0;
+}
+
 static ssize_t cell_stats_show(struct kobject *kobj,
 			       struct kobj_attribute *attr,
 			       char *buffer)
 {
 	struct jailhouse_cpu_stats_attr *stats_attr =
 		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
-	unsigned int code = JAILHOUSE_CPU_INFO_STAT_BASE + stats_attr->code;
 	struct cell *cell = container_of(kobj, struct cell, stats_kobj);
 	unsigned long sum = 0;
 	unsigned int cpu;
-	int value;
 
-	for_each_cpu(cpu, &cell->cpus_assigned) {
-		value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO, cpu,
-					    code);
-		if (value > 0)
-			sum += value;
-	}
+	for_each_cpu(cpu, &cell->cpus_assigned)
+		sum += read_cpu_stat(cpu, stats_attr->code);
 
 	return sprintf(buffer, "%lu\n", sum);
 }
@@ -110,16 +121,10 @@ static ssize_t cpu_stats_show(struct kobject *kobj,
 {
 	struct jailhouse_cpu_stats_attr *stats_attr =
 		container_of(attr, struct jailhouse_cpu_stats_attr, kattr);
-	unsigned int code = JAILHOUSE_CPU_INFO_STAT_BASE + stats_attr->code;
 	struct cell_cpu *cell_cpu = container_of(kobj, struct cell_cpu, kobj);
-	int value;
 
-	value = jailhouse_call_arg2(JAILHOUSE_HC_CPU_GET_INFO, cell_cpu->cpu,
-				    code);
-	if (value < 0)
-		value = 0;
-
-	return sprintf(buffer, "%d\n", value);
+	return sprintf(buffer, "%u\n",
+		       read_cpu_stat(cell_cpu->cpu, stats_attr->code));
 }
 
 #define JAILHOUSE_CPU_STATS_ATTR(_name, _code) \
@@ -150,6 +155,11 @@ JAILHOUSE_CPU_STATS_ATTR(vmexits_msr_other,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER);
 JAILHOUSE_CPU_STATS_ATTR(vmexits_msr_x2apic_icr,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MSR_X2APIC_ICR);
+JAILHOUSE_CPU_STATS_ATTR(vmcs_reads, JAILHOUSE_CPU_STAT_VMCS_READS);
+JAILHOUSE_CPU_STATS_ATTR(vmcs_writes, JAILHOUSE_CPU_STAT_VMCS_WRITES);
+JAILHOUSE_CPU_STATS_ATTR(vmcb_reloads, JAILHOUSE_CPU_STAT_VMCB_RELOADS);
+JAILHOUSE_CPU_STATS_ATTR(ioapic_remaps_skipped,
+			 JAILHOUSE_CPU_STAT_IOAPIC_REMAPS_SKIPPED);
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 JAILHOUSE_CPU_STATS_ATTR(vmexits_maintenance,
 			 JAILHOUSE_CPU_STAT_VMEXITS_MAINTENANCE);
@@ -176,6 +186,10 @@ static struct attribute *cell_stats_attrs[] = {
 	&vmexits_exception_cell_attr.kattr.attr,
 	&vmexits_msr_other_cell_attr.kattr.attr,
 	&vmexits_msr_x2apic_icr_cell_attr.kattr.attr,
+	&vmcs_reads_cell_attr.kattr.attr,
+	&vmcs_writes_cell_attr.kattr.attr,
+	&vmcb_reloads_cell_attr.kattr.attr,
+	&ioapic_remaps_skipped_cell_attr.kattr.attr,
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	&vmexits_maintenance_cell_attr.kattr.attr,
 	&vmexits_virt_irq_cell_attr.kattr.attr,
@@ -209,6 +223,10 @@ static struct attribute *cpu_stats_attrs[] = {
 	&vmexits_exception_cpu_attr.kattr.attr,
 	&vmexits_msr_other_cpu_attr.kattr.attr,
 	&vmexits_msr_x2apic_icr_cpu_attr.kattr.attr,
+	&vmcs_reads_cpu_attr.kattr.attr,
+	&vmcs_writes_cpu_attr.kattr.attr,
+	&vmcb_reloads_cpu_attr.kattr.attr,
+	&ioapic_remaps_skipped_cpu_attr.kattr.attr,
 #elif defined(CONFIG_ARM) || defined(CONFIG_ARM64)
 	&vmexits_maintenance_cpu_attr.kattr.attr,
 	&vmexits_virt_irq_cpu_attr.kattr.attr,
@@ -535,6 +553,20 @@ static ssize_t remap_pool_used_show(struct device *dev,
 	return info_show(dev, buffer, JAILHOUSE_INFO_REMAP_POOL_USED);
 }
 
+static ssize_t root_suspend_last_us_show(struct device *dev,
+					 struct device_attribute *attr,
+					 char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_ROOT_SUSPEND_LAST_US);
+}
+
+static ssize_t root_suspend_max_us_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buffer)
+{
+	return info_show(dev, buffer, JAILHOUSE_INFO_ROOT_SUSPEND_MAX_US);
+}
+
 static ssize_t core_show(struct file *filp, struct kobject *kobj,
 			 struct bin_attribute *attr, char *buf, loff_t off,
 			 size_t count)
@@ -549,6 +581,8 @@ static DEVICE_ATTR_RO(mem_pool_size);
 static DEVICE_ATTR_RO(mem_pool_used);
 static DEVICE_ATTR_RO(remap_pool_size);
 static DEVICE_ATTR_RO(remap_pool_used);
+static DEVICE_ATTR_RO(root_suspend_last_us);
+static DEVICE_ATTR_RO(root_suspend_max_us);
 
 static struct attribute *jailhouse_sysfs_entries[] = {
 	&dev_attr_console.attr,
@@ -557,6 +591,8 @@ static struct attribute *jailhouse_sysfs_entries[] = {
 	&dev_attr_mem_pool_used.attr,
 	&dev_attr_remap_pool_size.attr,
 	&dev_attr_remap_pool_used.attr,
+	&dev_attr_root_suspend_last_us.attr,
+	&dev_attr_root_suspend_max_us.attr,
 	NULL
 };
 
@@ -18,6 +18,7 @@
 #include <jailhouse/paging.h>
 #include <jailhouse/printk.h>
 #include <jailhouse/string.h>
+#include <jailhouse/trace.h>
 #include <jailhouse/unit.h>
 #include <asm/control.h>
 #include <asm/gic.h>
@@ -228,6 +229,8 @@ void irqchip_set_pending(struct public_per_cpu *cpu_public, u16 irq_id)
 	const u16 sender = this_cpu_id();
 	unsigned int new_tail;
 
+	trace_event(JAILHOUSE_TRACE_IRQ_INJECT, irq_id, cpu_public->cpu_id);
+
 	if (sdei_available) {
 		irqchip_send_sgi(cpu_public->cpu_id, irq_id);
 		return;
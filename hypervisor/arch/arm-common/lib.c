@@ -23,6 +23,22 @@ unsigned long phys_processor_id(void)
 	return mpidr & MPIDR_CPUID_MASK;
 }
 
+u64 arch_read_timestamp(void)
+{
+	u64 cntpct;
+
+	arm_read_sysreg(CNTPCT_EL0, cntpct);
+	return cntpct;
+}
+
+unsigned long arch_timestamp_khz(void)
+{
+	unsigned long cntfrq;
+
+	arm_read_sysreg(CNTFRQ_EL0, cntfrq);
+	return cntfrq / 1000;
+}
+
 unsigned int arm_cpu_by_mpidr(struct cell *cell, unsigned long mpidr)
 {
 	unsigned int cpu;
@@ -64,3 +64,12 @@ int arch_pci_update_msix_vector(struct pci_device *device, unsigned int index)
 		     device->msix_vectors[index].data);
 	return 0;
 }
+
+int arch_pci_update_msix(struct pci_device *device)
+{
+	unsigned int n;
+
+	for (n = 0; n < device->info->num_msix_vectors; n++)
+		arch_pci_update_msix_vector(device, n);
+	return 0;
+}
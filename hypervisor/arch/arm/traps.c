@@ -16,6 +16,7 @@
 
 #include <jailhouse/control.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/trace.h>
 #include <asm/control.h>
 #include <asm/gic.h>
 #include <asm/psci.h>
@@ -488,6 +489,7 @@ static void arch_dump_abt(bool is_data)
 union registers* arch_handle_exit(union registers *regs)
 {
 	this_cpu_public()->stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
+	trace_event(JAILHOUSE_TRACE_VMEXIT, regs->exit_reason, 0);
 
 	switch (regs->exit_reason) {
 	case EXIT_REASON_IRQ:
@@ -519,5 +521,7 @@ union registers* arch_handle_exit(union registers *regs)
 		panic_stop();
 	}
 
+	vcpu_exit_done();
+
 	return regs;
 }
@@ -400,6 +400,10 @@ static void queue_inc_prod(struct arm_smmu_queue *q)
 	u32 prod = (Q_WRP(q->prod, shift) | Q_IDX(q->prod, shift)) + 1;
 
 	q->prod = Q_OVF(q->prod) | Q_WRP(prod, shift) | Q_IDX(prod, shift);
+}
+
+static void queue_publish_prod(struct arm_smmu_queue *q)
+{
 	mmio_write32(q->prod_reg, q->prod);
 }
 
@@ -500,20 +504,33 @@ static void arm_smmu_cmdq_skip_err(struct arm_smmu_device *smmu)
 	mmio_write32(smmu->base + ARM_SMMU_GERRORN, gerrorn);
 }
 
+static void arm_smmu_cmdq_poll_cons(struct arm_smmu_device *smmu)
+{
+	struct arm_smmu_queue *q = &smmu->cmdq.q;
+
+	queue_sync_cons(q);
+	if (queue_error(smmu, q))
+		arm_smmu_cmdq_skip_err(smmu);
+}
+
+/*
+ * Append a command to the queue without waiting for its consumption. The
+ * producer index is only handed over to the hardware when the queue runs full
+ * or when the batch is closed by arm_smmu_cmdq_issue_sync().
+ */
 static void arm_smmu_cmdq_insert_cmd(struct arm_smmu_device *smmu, u64 *cmd)
 {
 	struct arm_smmu_queue *q = &smmu->cmdq.q;
 
-	while (queue_full(q))
-		queue_sync_cons(q);
+	if (queue_full(q)) {
+		queue_publish_prod(q);
+		do
+			arm_smmu_cmdq_poll_cons(smmu);
+		while (queue_full(q));
+	}
 
 	queue_write(queue_entry(q, q->prod), cmd, q->ent_dwords);
 	queue_inc_prod(q);
-	while (!queue_empty(q)) {
-		queue_sync_cons(q);
-		if (queue_error(smmu, q))
-			arm_smmu_cmdq_skip_err(smmu);
-	}
 }
 
 static void arm_smmu_cmdq_issue_cmd(struct arm_smmu_device *smmu,
@@ -530,15 +547,23 @@ static void arm_smmu_cmdq_issue_cmd(struct arm_smmu_device *smmu,
 	spin_unlock(&smmu->cmdq.lock);
 }
 
+/*
+ * Close the current batch of commands with a CMD_SYNC, submit all of them to
+ * the hardware and wait until they have been consumed.
+ */
 static void arm_smmu_cmdq_issue_sync(struct arm_smmu_device *smmu)
 {
 	struct arm_smmu_cmdq_ent ent = { .opcode = CMDQ_OP_CMD_SYNC };
+	struct arm_smmu_queue *q = &smmu->cmdq.q;
 	u64 cmd[CMDQ_ENT_DWORDS];
 
 	arm_smmu_cmdq_build_cmd(cmd, &ent);
 
 	spin_lock(&smmu->cmdq.lock);
 	arm_smmu_cmdq_insert_cmd(smmu, cmd);
+	queue_publish_prod(q);
+	while (!queue_empty(q))
+		arm_smmu_cmdq_poll_cons(smmu);
 	spin_unlock(&smmu->cmdq.lock);
 }
 
@@ -556,6 +581,10 @@ arm_smmu_write_strtab_l1_desc(u64 *dst, struct arm_smmu_strtab_l1_desc *desc)
 	dsb(ishst);
 }
 
+/*
+ * Queue the invalidation of the cached STE of a stream ID. The caller has to
+ * close the batch via arm_smmu_cmdq_issue_sync().
+ */
 static void arm_smmu_sync_ste_for_sid(struct arm_smmu_device *smmu, u32 sid)
 {
 	struct arm_smmu_cmdq_ent cmd = {
@@ -567,7 +596,6 @@ static void arm_smmu_sync_ste_for_sid(struct arm_smmu_device *smmu, u32 sid)
 	};
 
 	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
-	arm_smmu_cmdq_issue_sync(smmu);
 }
 
 static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu, u32 sid,
@@ -577,8 +605,6 @@ static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu, u32 sid,
 	struct paging_structures *pg_structs = &this_cell()->arch.mm;
 	u64 val, vttbr;
 
-	val = 0;
-
 	/* Bypass */
 	if (bypass) {
 		val = STRTAB_STE_0_V;
@@ -601,10 +627,21 @@ static void arm_smmu_write_strtab_ent(struct arm_smmu_device *smmu, u32 sid,
 	vttbr = paging_hvirt2phys(pg_structs->root_table);
 	dst[3] = vttbr & STRTAB_STE_3_S2TTB_MASK;
 
-	val |= FIELD_PREP(STRTAB_STE_0_CFG, STRTAB_STE_0_CFG_S2_TRANS);
+	/*
+	 * The translating configuration is only enabled by
+	 * arm_smmu_activate_strtab_ent() after this update has been synced.
+	 */
+	arm_smmu_sync_ste_for_sid(smmu, sid);
+}
+
+static void arm_smmu_activate_strtab_ent(struct arm_smmu_device *smmu,
+					 u32 sid, u64 *dst)
+{
+	u64 val;
+
+	val = FIELD_PREP(STRTAB_STE_0_CFG, STRTAB_STE_0_CFG_S2_TRANS);
 	val |= STRTAB_STE_0_V;
 
-	arm_smmu_sync_ste_for_sid(smmu, sid);
 	dst[0] = val;
 	dsb(ishst);
 	arm_smmu_sync_ste_for_sid(smmu, sid);
@@ -966,6 +1003,7 @@ static void arm_smmu_uninit_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
 	struct arm_smmu_strtab_l1_desc *desc;
 	struct arm_smmu_cmdq_ent cmd;
 	void *strtab;
+	u64 *l2ptr;
 	u32 size;
 
 	desc = &cfg->l1_desc[sid >> STRTAB_SPLIT];
@@ -974,6 +1012,7 @@ static void arm_smmu_uninit_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
 	if (desc->active_stes)
 		return;
 
+	l2ptr = desc->l2ptr;
 	desc->l2ptr = NULL;
 	desc->l2ptr_dma = 0;
 	desc->span = 0;
@@ -986,8 +1025,11 @@ static void arm_smmu_uninit_l2_strtab(struct arm_smmu_device *smmu, u32 sid)
 	cmd.cfgi.leaf = false;
 	arm_smmu_cmdq_issue_cmd(smmu, &cmd);
 
+	/* The table must no longer be walked when returning it to the pool. */
+	arm_smmu_cmdq_issue_sync(smmu);
+
 	size = 1 << (STRTAB_SPLIT + STRTAB_STE_DWORDS_BITS + 3);
-	page_free(&mem_pool, desc->l2ptr, PAGES(size));
+	page_free(&mem_pool, l2ptr, PAGES(size));
 }
 
 static u64 *arm_smmu_get_step_for_sid(struct arm_smmu_device *smmu, u32 sid)
@@ -1057,11 +1099,24 @@ static int arm_smmuv3_cell_init(struct cell *cell)
 		if (iommu->type != JAILHOUSE_IOMMU_SMMUV3)
 			continue;
 
+		/*
+		 * Prepare the STEs of all stream IDs in a first batch, then
+		 * switch them to stage-2 translation in a second one. This
+		 * keeps the number of CMD_SYNC round-trips independent of the
+		 * number of stream IDs.
+		 */
 		for_each_stream_id(sid, cell->config, s) {
 			ret = arm_smmu_init_ste(smmu, sid.id, cell->config->id);
-			if (ret)
+			if (ret) {
+				arm_smmu_cmdq_issue_sync(smmu);
 				return ret;
+			}
 		}
+		arm_smmu_cmdq_issue_sync(smmu);
+
+		for_each_stream_id(sid, cell->config, s)
+			arm_smmu_activate_strtab_ent(smmu, sid.id,
+				arm_smmu_get_step_for_sid(smmu, sid.id));
 
 		cmd.opcode	= CMDQ_OP_TLBI_S12_VMALL;
 		cmd.tlbi.vmid	= cell->config->id;
@@ -1088,6 +1143,7 @@ static void arm_smmuv3_cell_exit(struct cell *cell)
 		if (iommu->type != JAILHOUSE_IOMMU_SMMUV3)
 			continue;
 
+		/* STE invalidations are synced together with the TLBI. */
 		for_each_stream_id(sid, cell->config, s) {
 			arm_smmu_uninit_ste(smmu, sid.id, cell->config->id);
 		}
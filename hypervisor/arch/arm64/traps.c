@@ -13,6 +13,7 @@
 
 #include <jailhouse/control.h>
 #include <jailhouse/printk.h>
+#include <jailhouse/trace.h>
 #include <asm/control.h>
 #include <asm/entry.h>
 #include <asm/gic.h>
@@ -177,6 +178,7 @@ void arch_handle_trap(union registers *guest_regs)
 	int ret = TRAP_UNHANDLED;
 
 	fill_trap_context(&ctx, guest_regs);
+	trace_event(JAILHOUSE_TRACE_VMEXIT, ctx.esr, ctx.elr);
 
 	handler = trap_handlers[ESR_EC(ctx.esr)];
 	if (handler)
@@ -515,6 +515,14 @@ int iommu_map_interrupt(struct cell *cell, u16 device_id, unsigned int vector,
 	return -ENOSYS;
 }
 
+void iommu_begin_interrupt_batch(void)
+{
+}
+
+void iommu_end_interrupt_batch(void)
+{
+}
+
 static void amd_iommu_print_event(struct amd_iommu *iommu,
 				  union buf_entry *entry)
 {
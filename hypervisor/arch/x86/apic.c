@@ -17,6 +17,8 @@
 #include <jailhouse/printk.h>
 #include <jailhouse/control.h>
 #include <jailhouse/mmio.h>
+#include <jailhouse/string.h>
+#include <jailhouse/trace.h>
 #include <asm/apic.h>
 #include <asm/control.h>
 
@@ -269,6 +271,9 @@ void apic_send_irq(struct apic_irq_message irq_msg)
 {
 	u32 delivery_mode = irq_msg.delivery_mode << APIC_ICR_DLVR_SHIFT;
 
+	trace_event(JAILHOUSE_TRACE_IRQ_INJECT, irq_msg.vector,
+		    irq_msg.destination);
+
 	/* IA-32 SDM 10.6: "lowest priority IPI [...] should be avoided" */
 	if (delivery_mode == APIC_ICR_DLVR_LOWPRI) {
 		delivery_mode = APIC_ICR_DLVR_FIXED;
@@ -285,10 +290,57 @@ void apic_send_irq(struct apic_irq_message irq_msg)
 			  APIC_ICR_SH_NONE);
 }
 
+static inline u32 *vapic_reg(u8 *vapic, unsigned int reg)
+{
+	return (u32 *)(vapic + XAPIC_REG(reg));
+}
+
+static inline unsigned int highest_bit(u32 val)
+{
+	return 31 - __builtin_clz(val);
+}
+
+/*
+ * Post the interrupt the host just took to a virtual APIC page. The vector is
+ * the highest one in service: it was accepted above the priority of anything
+ * still in service, and that can only be level-triggered vectors whose EOI is
+ * deferred until the guest completed them (see apic_vapic_eoi).
+ */
+static void apic_forward_irq(u8 *vapic)
+{
+	unsigned int n, bit;
+	u32 isr;
+
+	for (n = APIC_NUM_INT_REGS; n > 0; n--) {
+		isr = apic_ops.read(APIC_REG_ISR0 + n - 1);
+		if (isr != 0)
+			break;
+	}
+	/* spurious interrupt, nothing to acknowledge */
+	if (n == 0)
+		return;
+
+	bit = highest_bit(isr);
+	if (apic_ops.read(APIC_REG_TMR0 + n - 1) & (1U << bit)) {
+		*vapic_reg(vapic, APIC_REG_TMR0 + n - 1) |= 1U << bit;
+	} else {
+		*vapic_reg(vapic, APIC_REG_TMR0 + n - 1) &= ~(1U << bit);
+		apic_ops.write(APIC_REG_EOI, APIC_EOI_ACK);
+	}
+	/* AVIC may set IRR bits of other vectors concurrently */
+	atomic_test_and_set_bit(bit, (unsigned long *)vapic_reg(vapic,
+					APIC_REG_IRR0 + n - 1));
+}
+
 void apic_irq_handler(void)
 {
 	struct per_cpu *cpu_data = this_cpu_data();
 
+	if (cpu_data->vapic_page) {
+		apic_forward_irq(cpu_data->vapic_page);
+		return;
+	}
+
 	cpu_data->num_clear_apic_irqs++;
 	if (cpu_data->num_clear_apic_irqs > 256)
 		/*
@@ -317,6 +369,9 @@ void apic_clear(void)
 	unsigned int xlc = (apic_ext_features() >> 16) & 0xff;
 	unsigned int n;
 
+	/* Interrupts drained below are dropped, not forwarded */
+	this_cpu_data()->vapic_page = NULL;
+
 	/* Enable the APIC - the cell may have turned it off */
 	apic_ops.write(APIC_REG_SVR, APIC_SVR_ENABLE_APIC | 0xff);
 
@@ -431,7 +486,7 @@ static void apic_send_ipi_all(u32 lo_val, int except_cpu)
  *
  * @return True if request was successfully validated and executed.
  */
-static bool apic_handle_icr_write(u32 lo_val, u32 hi_val)
+bool apic_handle_icr_write(u32 lo_val, u32 hi_val)
 {
 	u32 shorthand = lo_val & APIC_ICR_SH_MASK;
 	unsigned int target_cpu_id;
@@ -503,11 +558,44 @@ static bool apic_invalid_lvt_delivery_mode(unsigned int reg, u32 val)
 	return true;
 }
 
+/**
+ * Validate and apply a guest write to an xAPIC register.
+ * @param reg		Register index (x2APIC numbering)
+ * @param val		Value written by the guest
+ * @param icr_hi	Destination field of the ICR, only used for ICR writes
+ *
+ * @return True if the write was valid and has been applied.
+ */
+bool apic_handle_xapic_write(unsigned int reg, u32 val, u32 icr_hi)
+{
+	if (apic_accessing_reserved_bits(reg, val))
+		return false;
+
+	if (reg == APIC_REG_ICR) {
+		return apic_handle_icr_write(val, icr_hi);
+	} else if (reg == APIC_REG_LDR &&
+		   val != 1UL << (this_cpu_id() + XAPIC_DEST_SHIFT)) {
+		panic_printk("FATAL: Unsupported change to LDR: %x\n", val);
+		return false;
+	} else if (reg == APIC_REG_DFR && val != 0xffffffff) {
+		panic_printk("FATAL: Unsupported change to DFR: %x\n", val);
+		return false;
+	} else if (reg >= APIC_REG_LVTCMCI && reg <= APIC_REG_LVTERR &&
+		   apic_invalid_lvt_delivery_mode(reg, val))
+		return false;
+	else if (reg >= APIC_REG_XLVT0 && reg <= APIC_REG_XLVT3 &&
+		 apic_invalid_lvt_delivery_mode(reg, val))
+		return false;
+	else if (reg != APIC_REG_ID)
+		apic_ops.write(reg, val);
+	return true;
+}
+
 unsigned int apic_mmio_access(const struct guest_paging_structures *pg_structs,
 			      unsigned int reg, bool is_write)
 {
 	struct mmio_instruction inst;
-	u32 val, dest;
+	u32 val, dest = 0;
 
 	if (using_x2apic) {
 		panic_printk("FATAL: xAPIC access in x2APIC mode\n");
@@ -523,32 +611,10 @@ unsigned int apic_mmio_access(const struct guest_paging_structures *pg_structs,
 		return 0;
 	}
 	if (is_write) {
-		val = inst.out_val;
-
-		if (apic_accessing_reserved_bits(reg, val))
-			return 0;
-
-		if (reg == APIC_REG_ICR) {
+		if (reg == APIC_REG_ICR)
 			dest = apic_ops.read(APIC_REG_ICR_HI) >> 24;
-			if (!apic_handle_icr_write(val, dest))
-				return 0;
-		} else if (reg == APIC_REG_LDR &&
-			   val != 1UL << (this_cpu_id() + XAPIC_DEST_SHIFT)) {
-			panic_printk("FATAL: Unsupported change to LDR: %x\n",
-				     val);
-			return 0;
-		} else if (reg == APIC_REG_DFR && val != 0xffffffff) {
-			panic_printk("FATAL: Unsupported change to DFR: %x\n",
-				     val);
-			return 0;
-		} else if (reg >= APIC_REG_LVTCMCI && reg <= APIC_REG_LVTERR &&
-			   apic_invalid_lvt_delivery_mode(reg, val))
+		if (!apic_handle_xapic_write(reg, inst.out_val, dest))
 			return 0;
-		else if (reg >= APIC_REG_XLVT0 && reg <= APIC_REG_XLVT3 &&
-			 apic_invalid_lvt_delivery_mode(reg, val))
-			return 0;
-		else if (reg != APIC_REG_ID)
-			apic_ops.write(reg, val);
 	} else {
 		val = apic_ops.read(reg);
 		this_cpu_data()->guest_regs.by_index[inst.in_reg_num] = val;
@@ -556,6 +622,88 @@ unsigned int apic_mmio_access(const struct guest_paging_structures *pg_structs,
 	return inst.inst_len;
 }
 
+/**
+ * Initialize a virtual APIC page from the state of the physical APIC and start
+ * forwarding host-taken interrupts to it.
+ * @param vapic		Virtual APIC page of the calling CPU
+ */
+void apic_vapic_init(u8 *vapic)
+{
+	static const unsigned int regs[] = {
+		APIC_REG_ID, APIC_REG_LVR, APIC_REG_TPR, APIC_REG_LDR,
+		APIC_REG_DFR, APIC_REG_SVR, APIC_REG_LVTCMCI, APIC_REG_LVTT,
+		APIC_REG_LVTTHMR, APIC_REG_LVTPC, APIC_REG_LVT0, APIC_REG_LVT1,
+		APIC_REG_LVTERR, APIC_REG_TMICT, APIC_REG_TDCR,
+	};
+	unsigned int n;
+
+	memset(vapic, 0, PAGE_SIZE);
+	for (n = 0; n < ARRAY_SIZE(regs); n++)
+		*vapic_reg(vapic, regs[n]) = apic_ops.read(regs[n]);
+
+	this_cpu_data()->vapic_page = vapic;
+}
+
+/**
+ * Complete forwarded level-triggered interrupts on the physical APIC after
+ * the guest signaled an EOI for one of them.
+ * @param vapic		Virtual APIC page of the calling CPU
+ *
+ * The physical EOI always completes the highest vector in service. So walk
+ * the deferred vectors from the top and stop at the first one the guest has
+ * not completed yet.
+ */
+void apic_vapic_eoi(u8 *vapic)
+{
+	unsigned int n, bit;
+	u32 *tmr, pending;
+
+	for (n = APIC_NUM_INT_REGS; n > 0; n--) {
+		tmr = vapic_reg(vapic, APIC_REG_TMR0 + n - 1);
+		while (*tmr != 0) {
+			bit = highest_bit(*tmr);
+			pending = *vapic_reg(vapic, APIC_REG_ISR0 + n - 1) |
+				*vapic_reg(vapic, APIC_REG_IRR0 + n - 1);
+			if (pending & (1U << bit))
+				return;
+			*tmr &= ~(1U << bit);
+			apic_ops.write(APIC_REG_EOI, APIC_EOI_ACK);
+		}
+	}
+}
+
+/**
+ * Stop forwarding and hand interrupts that the guest has not yet received
+ * back to the physical APIC. Must be called with interrupts disabled.
+ * @param vapic		Virtual APIC page of the calling CPU
+ */
+void apic_vapic_release(u8 *vapic)
+{
+	unsigned int n, bit;
+	u32 irr, tmr;
+
+	this_cpu_data()->vapic_page = NULL;
+
+	for (n = APIC_NUM_INT_REGS; n > 0; n--) {
+		irr = *vapic_reg(vapic, APIC_REG_IRR0 + n - 1);
+		tmr = *vapic_reg(vapic, APIC_REG_TMR0 + n - 1);
+		/* level-triggered sources will assert again after the EOI */
+		while (tmr != 0) {
+			tmr &= ~(1U << highest_bit(tmr));
+			apic_ops.write(APIC_REG_EOI, APIC_EOI_ACK);
+		}
+		irr &= ~*vapic_reg(vapic, APIC_REG_TMR0 + n - 1);
+		while (irr != 0) {
+			bit = highest_bit(irr);
+			irr &= ~(1U << bit);
+			apic_ops.send_ipi(this_cpu_public()->apic_id,
+					  APIC_ICR_DLVR_FIXED |
+					  ((n - 1) * 32 + bit));
+		}
+	}
+	memset(vapic, 0, PAGE_SIZE);
+}
+
 bool x2apic_handle_write(void)
 {
 	union registers *guest_regs = &this_cpu_data()->guest_regs;
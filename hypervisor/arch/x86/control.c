@@ -18,6 +18,7 @@
 #include <asm/control.h>
 #include <asm/ioapic.h>
 #include <asm/iommu.h>
+#include <asm/pmu.h>
 #include <asm/vcpu.h>
 
 struct exception_frame {
@@ -68,6 +69,19 @@ int arch_unmap_memory_region(struct cell *cell,
 	return vcpu_unmap_memory_region(cell, mem);
 }
 
+u64 arch_read_timestamp(void)
+{
+	u32 lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((u64)hi << 32) | lo;
+}
+
+unsigned long arch_timestamp_khz(void)
+{
+	return system_config->platform_info.x86.tsc_khz;
+}
+
 void arch_flush_cell_vcpu_caches(struct cell *cell)
 {
 	unsigned int cpu;
@@ -104,6 +118,7 @@ void arch_cell_reset(struct cell *cell)
 
 void arch_config_commit(struct cell *cell_added_removed)
 {
+	vcpu_config_commit(cell_added_removed);
 	iommu_config_commit(cell_added_removed);
 	ioapic_config_commit(cell_added_removed);
 }
@@ -222,11 +237,13 @@ void x86_check_events(void)
 	/* wait_for_sipi is only modified on this CPU, so checking outside of
 	 * control_lock is fine */
 	if (cpu_public->wait_for_sipi) {
+		pmu_load_cell_state();
 		vcpu_park();
 	} else if (sipi_vector >= 0) {
 		printk("CPU %d received SIPI, vector %x\n", this_cpu_id(),
 		       sipi_vector);
 		apic_clear();
+		pmu_load_cell_state();
 		vcpu_reset(sipi_vector);
 	}
 
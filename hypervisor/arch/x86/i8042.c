@@ -14,32 +14,21 @@
 #include <jailhouse/utils.h>
 #include <asm/i8042.h>
 #include <asm/io.h>
-#include <jailhouse/percpu.h>
 
-#include <jailhouse/cell-config.h>
-
-int i8042_access_handler(u16 port, bool dir_in, unsigned int size)
+int i8042_access_handler(void *arg, struct pio_access *pio)
 {
-	union registers *guest_regs = &this_cpu_data()->guest_regs;
-	u8 val;
-
-	if (port == I8042_CMD_REG && this_cell()->arch.pio_i8042_allowed) {
-		if (size != 1)
+	if (pio->size != 1)
+		goto invalid_access;
+	if (pio->in) {
+		pio->value = inb(I8042_CMD_REG);
+	} else {
+		if (pio->value == I8042_CMD_WRITE_CTRL_PORT ||
+		    (pio->value & I8042_CMD_PULSE_CTRL_PORT) ==
+		    I8042_CMD_PULSE_CTRL_PORT)
 			goto invalid_access;
-		if (dir_in) {
-			guest_regs->rax &= ~BYTE_MASK(1);
-			guest_regs->rax |= inb(I8042_CMD_REG);
-		} else {
-			val = (u8)guest_regs->rax;
-			if (val == I8042_CMD_WRITE_CTRL_PORT ||
-			    (val & I8042_CMD_PULSE_CTRL_PORT) ==
-			    I8042_CMD_PULSE_CTRL_PORT)
-				goto invalid_access;
-			outb(val, I8042_CMD_REG);
-		}
-		return 1;
+		outb(pio->value, I8042_CMD_REG);
 	}
-	return 0;
+	return 1;
 
 invalid_access:
 	panic_printk("FATAL: Invalid write to i8042 controller port\n");
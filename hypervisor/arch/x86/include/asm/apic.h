@@ -36,6 +36,9 @@
 #define APIC_REG_DFR			0x0e
 #define APIC_REG_SVR			0x0f
 #define APIC_REG_ISR0			0x10
+#define APIC_REG_TMR0			0x18
+#define APIC_REG_IRR0			0x20
+#define APIC_REG_ESR			0x28
 #define APIC_REG_LVTCMCI		0x2f
 #define APIC_REG_ICR			0x30
 #define APIC_REG_ICR_HI			0x31
@@ -45,6 +48,8 @@
 #define APIC_REG_LVT0			0x35
 #define APIC_REG_LVT1			0x36
 #define APIC_REG_LVTERR			0x37
+#define APIC_REG_TMICT			0x38
+#define APIC_REG_TDCR			0x3e
 #define APIC_REG_SELF_IPI		0x3f
 #define APIC_REG_XFEAT			0x40
 #define APIC_REG_XLVT0			0x50
@@ -162,9 +167,15 @@ void apic_send_irq(struct apic_irq_message irq_msg);
 
 void apic_irq_handler(void);
 
+bool apic_handle_icr_write(u32 lo_val, u32 hi_val);
+bool apic_handle_xapic_write(unsigned int reg, u32 val, u32 icr_hi);
 unsigned int apic_mmio_access(const struct guest_paging_structures *pg_structs,
 			      unsigned int reg, bool is_write);
 
+void apic_vapic_init(u8 *vapic);
+void apic_vapic_eoi(u8 *vapic);
+void apic_vapic_release(u8 *vapic);
+
 bool x2apic_handle_write(void);
 void x2apic_handle_read(void);
 
@@ -51,9 +51,14 @@ static inline int atomic_test_and_set_bit(int nr, volatile unsigned long *addr)
 {
 	int oldbit;
 
+	/*
+	 * btsq needs a 64-bit register if nr is not a constant. Passing the
+	 * int as is would make gcc pick a 32-bit one that the assembler
+	 * rejects.
+	 */
 	asm volatile("lock btsq %2,%1\n\t"
 		     "sbb %0,%0" : "=r" (oldbit), BITOP_ADDR(addr)
-		     : "Ir" (nr) : "memory");
+		     : "Ir" ((long)nr) : "memory");
 
 	return oldbit;
 }
@@ -16,19 +16,35 @@
 #define _JAILHOUSE_ASM_CELL_H
 
 #include <jailhouse/paging.h>
+#include <asm/pio.h>
+
+#define X86_CPUID_CACHE_SIZE	16
 
 struct cell_ioapic;
 
+/** Precomputed result of a CPUID leaf. */
+struct cpuid_entry {
+	u32 function;
+	/** Subleaf, only compared if @c indexed is set. */
+	u32 index;
+	bool indexed;
+	u32 eax, ebx, ecx, edx;
+};
+
 /** x86-specific cell states. */
 struct arch_cell {
 	/** Buffer for the EPT/NPT root-level page table. */
 	u8 __attribute__((aligned(PAGE_SIZE))) root_table_page[PAGE_SIZE];
 
-	bool pio_i8042_allowed;
+	/** Handlers of intercepted I/O ports. */
+	struct pio_dispatch pio;
 
 	/* Intel: PIO access bitmap.
 	 * AMD: I/O Permissions Map. */
 	u8 *io_bitmap;
+	/* Intel: MSR bitmap.
+	 * AMD: MSR Permissions Map. */
+	u8 *msr_bitmap;
 	union {
 		struct {
 			/** Paging structures used for cell CPUs. */
@@ -37,6 +53,14 @@ struct arch_cell {
 		struct {
 			/** Paging structures used for cell CPUs and IOMMU. */
 			struct paging_structures npt_iommu_structs;
+			/** AVIC physical APIC ID table, NULL without AVIC. */
+			u64 *avic_physical_table;
+			/** AVIC logical APIC ID table, NULL without AVIC. */
+			u32 *avic_logical_table;
+			/** Address space ID tagging the cell's TLB entries. */
+			u32 asid;
+			/** ASID generation the ASID was allocated in. */
+			u32 asid_generation;
 		} svm; /**< AMD SVM-specific fields. */
 	};
 
@@ -58,6 +82,11 @@ struct arch_cell {
 	/** Number of assigned IOAPICs. */
 	unsigned int num_ioapics;
 
+	/** CPUID leaves served without executing CPUID. */
+	struct cpuid_entry cpuid[X86_CPUID_CACHE_SIZE];
+	/** Number of valid entries in @c cpuid. */
+	unsigned int num_cpuid_entries;
+
 	/** Class Of Service for cache allocation (Intel only). */
 	u32 cos;
 	/** Allocated L3 cache region (Intel only). */
@@ -14,11 +14,12 @@
 #define _JAILHOUSE_ASM_I8042_H
 
 #include <jailhouse/types.h>
+#include <asm/pio.h>
 
 #define I8042_CMD_REG			0x64
 # define I8042_CMD_WRITE_CTRL_PORT	0xd1
 # define I8042_CMD_PULSE_CTRL_PORT	0xf0
 
-int i8042_access_handler(u16 port, bool dir_in, unsigned int size);
+int i8042_access_handler(void *arg, struct pio_access *pio);
 
 #endif /* !_JAILHOUSE_ASM_I8042_H */
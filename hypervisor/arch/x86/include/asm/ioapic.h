@@ -67,6 +67,13 @@ struct phys_ioapic {
 	spinlock_t lock;
 	/** Shadow state of redirection entries as seen by the cells. */
 	union ioapic_redir_entry shadow_redir_table[IOAPIC_MAX_PINS];
+	/** Interrupt remapping index of each pin as last mapped. */
+	u16 remap_index[IOAPIC_MAX_PINS];
+	/** Set for pins whose remap_index still matches their shadow entry.
+	 * Cleared when anything but the mask or status bits change. One flag
+	 * per pin as pins of the same IOAPIC are updated concurrently by
+	 * different cells. */
+	bool remap_valid[IOAPIC_MAX_PINS];
 };
 
 /**
@@ -41,6 +41,9 @@ int iommu_map_interrupt(struct cell *cell,
 			unsigned int vector,
 			struct apic_irq_message irq_msg);
 
+void iommu_begin_interrupt_batch(void);
+void iommu_end_interrupt_batch(void);
+
 void iommu_config_commit(struct cell *cell_added_removed);
 
 void iommu_prepare_shutdown(void);
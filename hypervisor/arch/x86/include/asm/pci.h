@@ -16,6 +16,7 @@
 
 #include <jailhouse/types.h>
 #include <asm/apic.h>
+#include <asm/pio.h>
 
 /* --- PCI configuration ports --- */
 #define PCI_REG_ADDR_PORT		0xcf8
@@ -32,7 +33,7 @@
  * @{
  */
 
-int x86_pci_config_handler(u16 port, bool dir_in, unsigned int size);
+int x86_pci_config_handler(void *arg, struct pio_access *pio);
 
 struct apic_irq_message
 x86_pci_translate_msi(struct pci_device *device, unsigned int vector,
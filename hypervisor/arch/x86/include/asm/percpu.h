@@ -13,6 +13,7 @@
  */
 
 #include <jailhouse/cell.h>
+#include <asm/pmu.h>
 #include <asm/svm.h>
 #include <asm/vmx.h>
 
@@ -84,6 +85,9 @@
 		volatile u32 vtd_iq_completed;				\
 		volatile u64 amd_iommu_sem;				\
 	};								\
+	/* Staged VT-d IRTE index range, empty if first > last */	\
+	unsigned int vtd_irte_batch;					\
+	unsigned int vtd_irte_first, vtd_irte_last;			\
 									\
 	/** True when CPU is initialized by hypervisor. */		\
 	bool initialized;						\
@@ -94,8 +98,25 @@
 		enum {SVMOFF = 0, SVMON} svm_state;			\
 	};								\
 									\
+	/** VMCS fields cached during VM exit handling (Intel only). */	\
+	struct vmcs_cache vmcs_cache;					\
+	/** ASID of the cell last entered on this CPU (AMD only). */	\
+	u32 svm_cell_asid;						\
+	/** ASID generation of the last full TLB flush (AMD only). */	\
+	u32 svm_asid_generation;					\
+									\
+	/** True while the root cell's PMU state is held in		\
+	 *  @c pmu_root_state. */					\
+	bool pmu_root_saved;						\
+	/** PMU state of the root cell while the CPU is assigned to	\
+	 *  another cell. */						\
+	u64 pmu_root_state[PMU_MAX_STATE_MSRS];				\
+									\
 	/** Number of iterations to clear pending APIC IRQs. */		\
 	unsigned int num_clear_apic_irqs;				\
+	/** Virtual APIC page that host-taken IRQs are forwarded to,	\
+	 *  NULL if they are just acknowledged (AMD AVIC only). */	\
+	u8 *vapic_page;							\
 									\
 	union {								\
 		struct {						\
@@ -113,5 +134,8 @@
 			/** SVM Host save area; opaque to us. */	\
 			u8 host_state[PAGE_SIZE]			\
 				__attribute__((aligned(PAGE_SIZE)));	\
+			/** AVIC backing page of this CPU. */		\
+			u8 avic_backing_page[PAGE_SIZE]			\
+				__attribute__((aligned(PAGE_SIZE)));	\
 		};							\
 	};
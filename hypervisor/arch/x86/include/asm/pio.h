@@ -0,0 +1,74 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_ASM_PIO_H
+#define _JAILHOUSE_ASM_PIO_H
+
+#include <jailhouse/types.h>
+
+struct cell;
+
+/** Maximum number of port I/O handlers per cell. */
+#define PIO_MAX_REGIONS		8
+/** Maximum number of 256-port pages containing handled ports per cell. */
+#define PIO_MAX_PAGES		4
+
+/** Port I/O access description. */
+struct pio_access {
+	/** Accessed port. */
+	u16 port;
+	/** Size of the access (1, 2 or 4 bytes). */
+	unsigned int size;
+	/** True for input, false for output. */
+	bool in;
+	/** The value to be written or the read value to return. */
+	u32 value;
+};
+
+/**
+ * Port I/O handler.
+ * @param arg		Opaque argument defined via pio_region_register().
+ * @param pio		Port I/O access description.
+ *
+ * @return 1 if handled successfully, 0 if unhandled, -1 on access error.
+ */
+typedef int (*pio_handler)(void *arg, struct pio_access *pio);
+
+/** Port I/O region access handler description. */
+struct pio_region_handler {
+	/** Access handling function. */
+	pio_handler function;
+	/** Argument to pass to the function. */
+	void *arg;
+};
+
+/**
+ * Per-cell dispatch table of intercepted ports. Ports are looked up in two
+ * steps, by their upper and lower byte, so that finding the handler takes
+ * constant time.
+ */
+struct pio_dispatch {
+	/** Registered handlers. */
+	struct pio_region_handler handlers[PIO_MAX_REGIONS];
+	/** Number of registered handlers. */
+	unsigned int num_handlers;
+	/** Index into @c ports plus one per 256-port page, 0 if unused. */
+	u8 pages[0x100];
+	/** Index into @c handlers plus one per port, 0 if unhandled. */
+	u8 ports[PIO_MAX_PAGES][0x100];
+	/** Number of used entries in @c ports. */
+	unsigned int num_pages;
+};
+
+int pio_region_register(struct cell *cell, u16 start, unsigned int length,
+			pio_handler handler, void *handler_arg);
+
+int pio_handle_access(struct pio_access *pio);
+
+#endif /* !_JAILHOUSE_ASM_PIO_H */
@@ -0,0 +1,38 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_ASM_PMU_H
+#define _JAILHOUSE_ASM_PMU_H
+
+#include <jailhouse/types.h>
+
+struct cell;
+
+/** Maximum number of registered PMU MSR ranges, as used by the vendor code. */
+#define PMU_MAX_RANGES		8
+/**
+ * Maximum number of PMU MSRs saved and restored on CPU handover. This covers
+ * 16 general-purpose and 6 fixed counters plus two controls on Intel.
+ */
+#define PMU_MAX_STATE_MSRS	40
+
+/** The MSRs hold state that has to be switched on CPU handover. */
+#define PMU_MSR_STATE		0x1
+/** The MSRs are intercepted for the root cell as well. */
+#define PMU_MSR_ROOT_INTERCEPT	0x2
+
+void pmu_register_msrs(u32 start, unsigned int count, unsigned int flags);
+
+bool pmu_is_msr(u32 msr);
+
+int pmu_cell_init(struct cell *cell);
+
+void pmu_load_cell_state(void);
+
+#endif /* !_JAILHOUSE_ASM_PMU_H */
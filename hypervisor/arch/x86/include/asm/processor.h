@@ -40,6 +40,7 @@
 
 /* leaf 0x80000001, ECX */
 #define X86_FEATURE_SVM					(1 << 2)
+#define X86_FEATURE_PERFCTR_CORE			(1 << 23)
 
 /* leaf 0x80000001, EDX */
 #define X86_FEATURE_GBPAGES				(1 << 26)
@@ -51,6 +52,10 @@
 #define X86_FEATURE_DECODE_ASSISTS			(1 << 7)
 #define X86_FEATURE_AVIC				(1 << 13)
 
+/* leaf 0x80000022, EAX */
+#define X86_FEATURE_PERFMON_V2				(1 << 0)
+
+#define X86_RFLAGS_DF					(1 << 10)
 #define X86_RFLAGS_VM					(1 << 17)
 
 #define X86_CR0_PE					(1UL << 0)
@@ -75,12 +80,18 @@
 
 #define MSR_IA32_APICBASE				0x0000001b
 #define MSR_IA32_FEATURE_CONTROL			0x0000003a
+#define MSR_IA32_PMC0					0x000000c1
 #define MSR_IA32_PAT					0x00000277
 #define MSR_IA32_MTRR_DEF_TYPE				0x000002ff
 #define MSR_IA32_SYSENTER_CS				0x00000174
 #define MSR_IA32_SYSENTER_ESP				0x00000175
 #define MSR_IA32_SYSENTER_EIP				0x00000176
+#define MSR_IA32_PERFEVTSEL0				0x00000186
+#define MSR_IA32_FIXED_CTR0				0x00000309
+#define MSR_IA32_FIXED_CTR_CTRL				0x0000038d
+#define MSR_IA32_PERF_GLOBAL_STATUS			0x0000038e
 #define MSR_IA32_PERF_GLOBAL_CTRL			0x0000038f
+#define MSR_IA32_PERF_GLOBAL_OVF_CTRL			0x00000390
 #define MSR_IA32_VMX_BASIC				0x00000480
 #define MSR_IA32_VMX_PINBASED_CTLS			0x00000481
 #define MSR_IA32_VMX_PROCBASED_CTLS			0x00000482
@@ -97,6 +108,7 @@
 #define MSR_X2APIC_BASE					0x00000800
 #define MSR_X2APIC_ICR					0x00000830
 #define MSR_X2APIC_END					0x0000083f
+#define MSR_IA32_A_PMC0					0x000004c1
 #define MSR_IA32_PQR_ASSOC				0x00000c8f
 #define MSR_IA32_L3_MASK_0				0x00000c90
 #define MSR_EFER					0xc0000080
@@ -107,6 +119,12 @@
 #define MSR_FS_BASE					0xc0000100
 #define MSR_GS_BASE					0xc0000101
 #define MSR_KERNGS_BASE					0xc0000102
+#define MSR_AMD64_PERF_CNTR_GLOBAL_STATUS		0xc0000300
+#define MSR_AMD64_PERF_CNTR_GLOBAL_CTL			0xc0000301
+#define MSR_AMD64_PERF_CNTR_GLOBAL_STATUS_CLR		0xc0000302
+#define MSR_K7_EVNTSEL0					0xc0010000
+#define MSR_K7_PERFCTR0					0xc0010004
+#define MSR_F15H_PERF_CTL0				0xc0010200
 
 #define FEATURE_CONTROL_LOCKED				(1 << 0)
 #define FEATURE_CONTROL_VMXON_ENABLED_OUTSIDE_SMX	(1 << 2)
@@ -236,6 +254,12 @@ static inline void memory_load_barrier(void)
 	asm volatile("lfence" : : : "memory");
 }
 
+/* stores are not reordered against other stores on x86 */
+static inline void memory_store_barrier(void)
+{
+	asm volatile("" : : : "memory");
+}
+
 static inline void cpuid(unsigned int *eax, unsigned int *ebx,
 			 unsigned int *ecx, unsigned int *edx)
 {
@@ -35,6 +35,7 @@
 #define SVM_MSRPM_C001		2
 #define SVM_MSRPM_RESV		3
 
+#define SVM_TLB_FLUSH_NONE	0x00
 #define SVM_TLB_FLUSH_ALL	0x01
 #define SVM_TLB_FLUSH_GUEST	0x03
 
@@ -42,6 +43,26 @@
 #define SVM_EVENTINJ_ERR_VALID	(1UL << 11)
 #define SVM_EVENTINJ_VALID	(1UL << 31)
 
+#define SVM_VINTR_MASKING	(1UL << 24)
+#define SVM_VINTR_AVIC_ENABLE	(1UL << 31)
+
+#define AVIC_PHYS_ENTRY_VALID		(1UL << 63)
+#define AVIC_PHYS_ENTRY_IS_RUNNING	(1UL << 62)
+#define AVIC_PHYS_ENTRY_BACKING_PAGE	BIT_MASK(51, 12)
+#define AVIC_LOG_ENTRY_VALID		(1U << 31)
+
+/* exitinfo1 of VMEXIT_AVIC_NOACCEL */
+#define AVIC_NOACCEL_OFFSET_MASK	BIT_MASK(11, 4)
+#define AVIC_NOACCEL_WRITE		(1UL << 32)
+
+/* exitinfo2[63:32] of VMEXIT_AVIC_INCOMPLETE_IPI */
+enum avic_ipi_failure {
+	AVIC_IPI_FAILURE_INVALID_INT_TYPE	= 0,
+	AVIC_IPI_FAILURE_TARGET_NOT_RUNNING	= 1,
+	AVIC_IPI_FAILURE_INVALID_TARGET		= 2,
+	AVIC_IPI_FAILURE_INVALID_BACKING_PAGE	= 3,
+};
+
 struct svm_segment {
 	u16 selector;
 	u16 attributes;
@@ -247,6 +268,8 @@ enum vm_exit_code {
 	VMEXIT_MWAIT_CONDITIONAL	= 140,
 	VMEXIT_XSETBV                   = 141,
 	VMEXIT_NPF			= 1024, /* nested paging fault */
+	VMEXIT_AVIC_INCOMPLETE_IPI	= 1025,
+	VMEXIT_AVIC_NOACCEL		= 1026,
 	VMEXIT_INVALID			=  -1
 };
 
@@ -295,7 +318,8 @@ struct vmcb {
 	u64 exitinfo2;			/* offset 0x80 */
 	u64 exitintinfo;		/* offset 0x88 */
 	u64 np_enable;			/* offset 0x90 */
-	u64 res08[2];
+	u64 avic_apic_bar;		/* offset 0x98 */
+	u64 res08;
 	u32 eventinj;			/* offset 0xA8 */
 	u32 eventinj_err;		/* offset 0xAC */
 	u64 n_cr3;			/* offset 0xB0 */
@@ -304,7 +328,11 @@ struct vmcb {
 	u64 nextrip;			/* offset 0xC8 */
 	u8 bytes_fetched;		/* offset 0xD0 */
 	u8 guest_bytes[15];
-	u64 res10a[100];		/* offset 0xE0 pad to save area */
+	u64 avic_backing_page;		/* offset 0xE0 */
+	u64 res09;
+	u64 avic_logical_id;		/* offset 0xF0 */
+	u64 avic_physical_id;		/* offset 0xF8 */
+	u64 res10a[96];			/* offset 0x100 pad to save area */
 
 	struct svm_segment es;		/* offset 1024 */
 	struct svm_segment cs;
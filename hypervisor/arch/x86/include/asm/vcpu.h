@@ -25,12 +25,23 @@
 	 X86_CR0_MP | X86_CR0_PE)
 #define X86_CR4_HOST_STATE	X86_CR4_PAE
 
+/* Segment register numbers as reported for string I/O instructions */
+#define VCPU_SEG_ES		0
+#define VCPU_SEG_FS		4
+#define VCPU_SEG_GS		5
+
 struct vcpu_io_intercept {
 	u16 port;
 	unsigned int size;
 	bool in;
 	unsigned int inst_len;
-	bool rep_or_str;
+	bool rep;
+	bool string;
+	/* only valid for string instructions */
+	unsigned int addr_size;
+	/* segment of the memory operand, -1 if unknown */
+	int seg;
+	unsigned long seg_base;
 };
 
 struct vcpu_mmio_intercept {
@@ -52,6 +63,8 @@ int vcpu_unmap_memory_region(struct cell *cell,
 void vcpu_cell_exit(struct cell *cell);
 void vcpu_vendor_cell_exit(struct cell *cell);
 
+void vcpu_config_commit(struct cell *cell_added_removed);
+
 int vcpu_init(struct per_cpu *cpu_data);
 void vcpu_exit(struct per_cpu *cpu_data);
 
@@ -84,6 +97,10 @@ const u8 *vcpu_get_inst_bytes(const struct guest_paging_structures *pg_structs,
 void vcpu_skip_emulated_instruction(unsigned int inst_len);
 
 unsigned int vcpu_vendor_get_io_bitmap_pages(void);
+unsigned int vcpu_vendor_get_msr_bitmap_pages(void);
+
+void vcpu_vendor_set_msr_intercept(struct cell *cell, u32 msr,
+				   bool intercept);
 
 #define VCPU_CS_DPL_MASK	BIT_MASK(6, 5)
 #define VCPU_CS_L		(1 << 13)
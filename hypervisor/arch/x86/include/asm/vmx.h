@@ -201,6 +201,42 @@ struct vmcs {
 
 enum vmx_state { VMXOFF = 0, VMXON, VMCS_READY };
 
+/** Slots of the VMCS field cache, see struct vmcs_cache. */
+enum vmcs_cache_slot {
+	VMCS_CACHE_EXIT_REASON,
+	VMCS_CACHE_EXIT_QUALIFICATION,
+	VMCS_CACHE_EXIT_INSTRUCTION_LEN,
+	VMCS_CACHE_EXIT_INTR_INFO,
+	VMCS_CACHE_GUEST_PHYSICAL_ADDRESS,
+	VMCS_CACHE_GUEST_RIP,
+	VMCS_CACHE_GUEST_RSP,
+	VMCS_CACHE_GUEST_RFLAGS,
+	VMCS_CACHE_GUEST_CS_AR_BYTES,
+	VMCS_CACHE_GUEST_IA32_EFER,
+	VMCS_CACHE_GUEST_CR0,
+	VMCS_CACHE_GUEST_CR3,
+	VMCS_CACHE_GUEST_CR4,
+	VMCS_CACHE_CR0_READ_SHADOW,
+	VMCS_CACHE_CR4_READ_SHADOW,
+	NUM_VMCS_CACHE_SLOTS
+};
+
+/**
+ * Cache of VMCS fields that are accessed frequently while handling a VM exit.
+ * Each field is read at most once per exit, writes are collected and
+ * written back before VM entry.
+ */
+struct vmcs_cache {
+	/** True while a VM exit is handled. */
+	bool active;
+	/** Bitmap of slots holding the current field value. */
+	u32 valid;
+	/** Bitmap of slots that have to be written back. */
+	u32 dirty;
+	/** Field values. */
+	unsigned long value[NUM_VMCS_CACHE_SLOTS];
+};
+
 #define GUEST_SEG_LIMIT			(GUEST_ES_LIMIT - GUEST_ES_SELECTOR)
 #define GUEST_SEG_AR_BYTES		(GUEST_ES_AR_BYTES - GUEST_ES_SELECTOR)
 #define GUEST_SEG_BASE			(GUEST_ES_BASE - GUEST_ES_SELECTOR)
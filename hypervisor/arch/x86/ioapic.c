@@ -107,17 +107,58 @@ ioapic_translate_redir_entry(struct cell_ioapic *ioapic, unsigned int pin,
 	return irq_msg;
 }
 
+/* Redirection entry without the mask and status bits. */
+static u64 ioapic_entry_key(union ioapic_redir_entry entry)
+{
+	entry.native.mask = 0;
+	entry.native.delivery_status = 0;
+	entry.native.remote_irr = 0;
+	return (u64)entry.raw[1] << 32 | entry.raw[0];
+}
+
+/*
+ * Map the interrupt of an unmasked pin, reusing the previous remapping if
+ * only the mask or status bits changed since then. Linux toggles the mask of
+ * level-triggered lines around each interrupt.
+ */
+static int ioapic_remap_pin(struct cell_ioapic *ioapic, unsigned int pin,
+			    union ioapic_redir_entry entry)
+{
+	struct phys_ioapic *phys_ioapic = ioapic->phys_ioapic;
+	u32 *stats = this_cpu_public()->stats;
+	struct apic_irq_message irq_msg;
+	int result;
+
+	if (phys_ioapic->remap_valid[pin]) {
+		stats[JAILHOUSE_CPU_STAT_IOAPIC_REMAPS_SKIPPED]++;
+		return phys_ioapic->remap_index[pin];
+	}
+
+	irq_msg = ioapic_translate_redir_entry(ioapic, pin, entry);
+	result = iommu_map_interrupt(ioapic->cell, (u16)ioapic->info->id, pin,
+				     irq_msg);
+	if (result < 0)
+		return result;
+
+	phys_ioapic->remap_index[pin] = result;
+	phys_ioapic->remap_valid[pin] = true;
+
+	return result;
+}
+
 static int ioapic_virt_redir_write(struct cell_ioapic *ioapic,
 				   unsigned int reg, u32 value)
 {
 	unsigned int pin = (reg - IOAPIC_REDIR_TBL_START) / 2;
 	struct phys_ioapic *phys_ioapic = ioapic->phys_ioapic;
-	struct apic_irq_message irq_msg;
 	union ioapic_redir_entry entry;
 	int result = 0xffff;
 
 	entry = phys_ioapic->shadow_redir_table[pin];
 	entry.raw[reg & 1] = value;
+	if (ioapic_entry_key(entry) !=
+	    ioapic_entry_key(phys_ioapic->shadow_redir_table[pin]))
+		phys_ioapic->remap_valid[pin] = false;
 	phys_ioapic->shadow_redir_table[pin] = entry;
 
 	/*
@@ -126,11 +167,7 @@ static int ioapic_virt_redir_write(struct cell_ioapic *ioapic,
 	 * while the mask is set.
 	 */
 	if (!entry.native.mask) {
-		irq_msg = ioapic_translate_redir_entry(ioapic, pin, entry);
-
-		result = iommu_map_interrupt(ioapic->cell,
-					     (u16)ioapic->info->id, pin,
-					     irq_msg);
+		result = ioapic_remap_pin(ioapic, pin, entry);
 		// HACK for QEMU
 		if (result == -ENOSYS) {
 			/* see regular update below, lazy version */
@@ -414,6 +451,7 @@ static void ioapic_cell_exit(struct cell *cell)
 
 void ioapic_config_commit(struct cell *cell_added_removed)
 {
+	struct phys_ioapic *phys_ioapic;
 	struct apic_irq_message irq_msg;
 	union ioapic_redir_entry entry;
 	struct cell_ioapic *ioapic;
@@ -422,6 +460,11 @@ void ioapic_config_commit(struct cell *cell_added_removed)
 	if (!cell_added_removed)
 		return;
 
+	/* pins may have changed their owner, remap them on next unmask */
+	for_each_phys_ioapic(phys_ioapic, n)
+		memset(phys_ioapic->remap_valid, 0,
+		       sizeof(phys_ioapic->remap_valid));
+
 	for_each_cell_ioapic(ioapic, &root_cell, n)
 		for (pin = 0; pin < ioapic->phys_ioapic->pins; pin++) {
 			if (!test_bit(pin, (unsigned long *)ioapic->pin_bitmap))
@@ -49,10 +49,14 @@ struct parse_context {
 	unsigned int count;
 	unsigned int size;
 	const u8 *inst;
+	unsigned int operand_size;
+	unsigned int address_size;
 	bool has_immediate;
 	bool does_write;
+	bool has_rex;
 	bool has_rex_w;
 	bool has_rex_r;
+	bool has_rex_x;
 	bool has_addrsz_prefix;
 	bool has_opsz_prefix;
 	bool zero_extend;
@@ -61,11 +65,12 @@ struct parse_context {
 static bool ctx_update(struct parse_context *ctx, u64 *pc, unsigned int advance,
 		       const struct guest_paging_structures *pg)
 {
-	ctx->inst += advance;
 	ctx->count += advance;
-	if (ctx->size > advance) {
-		ctx->size -= advance;
-	} else {
+	/* the target may lie beyond the next page if advancing by several */
+	while (ctx->size <= advance) {
+		advance -= ctx->size;
+		if (ctx->remaining == 0)
+			return false;
 		ctx->size = ctx->remaining;
 		ctx->inst = vcpu_get_inst_bytes(pg, *pc, &ctx->size);
 		if (!ctx->inst)
@@ -73,36 +78,30 @@ static bool ctx_update(struct parse_context *ctx, u64 *pc, unsigned int advance,
 		ctx->remaining -= ctx->size;
 		*pc += ctx->size;
 	}
+	ctx->inst += advance;
+	ctx->size -= advance;
 	return true;
 }
 
-static void parse_widths(struct parse_context *ctx,
-		         struct mmio_instruction *inst, bool parse_addr_width)
+static void parse_widths(struct parse_context *ctx)
 {
 	u16 cs_attr = vcpu_vendor_get_cs_attr();
 	bool cs_db = !!(cs_attr & VCPU_CS_DB);
 	bool long_mode =
 		(vcpu_vendor_get_efer() & EFER_LMA) && (cs_attr & VCPU_CS_L);
 
-	/* Op size prefix is ignored if rex.w = 1 */
-	if (ctx->has_rex_w) {
-		inst->access_size = 8;
+	/* CS.d is ignored in long mode */
+	if (long_mode) {
+		ctx->operand_size = ctx->has_opsz_prefix ? 2 : 4;
+		ctx->address_size = ctx->has_addrsz_prefix ? 4 : 8;
 	} else {
-		/* CS.d is ignored in long mode */
-		if (long_mode)
-			inst->access_size = ctx->has_opsz_prefix ? 2 : 4;
-		else
-			inst->access_size =
-				(cs_db ^ ctx->has_opsz_prefix) ? 4 : 2;
+		ctx->operand_size = (cs_db ^ ctx->has_opsz_prefix) ? 4 : 2;
+		ctx->address_size = (cs_db ^ ctx->has_addrsz_prefix) ? 4 : 2;
 	}
 
-	if (parse_addr_width) {
-		if (long_mode)
-			inst->inst_len += ctx->has_addrsz_prefix ? 4 : 8;
-		else
-			inst->inst_len +=
-				(cs_db ^ ctx->has_addrsz_prefix) ? 4 : 2;
-	}
+	/* Op size prefix is ignored if rex.w = 1 */
+	if (ctx->has_rex_w)
+		ctx->operand_size = 8;
 }
 
 struct mmio_instruction
@@ -113,7 +112,7 @@ x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write)
 	union registers *guest_regs = &this_cpu_data()->guest_regs;
 	struct mmio_instruction inst = { 0 };
 	u64 pc = vcpu_vendor_get_rip();
-	unsigned int n, skip_len = 0;
+	unsigned int n, imm_size, skip_len = 0;
 	union opcode op[4] = { };
 
 	if (!ctx_update(&ctx, &pc, 0, pg_structs))
@@ -122,28 +121,37 @@ x86_mmio_parse(const struct guest_paging_structures *pg_structs, bool is_write)
 restart:
 	op[0].raw = *ctx.inst;
 	if (op[0].rex.code == X86_REX_CODE) {
-		if (op[0].rex.w)
-			ctx.has_rex_w = true;
-		if (op[0].rex.r)
-			ctx.has_rex_r = true;
-		if (op[0].rex.x)
-			goto error_unsupported;
+		/* only the REX prefix right before the opcode is effective */
+		ctx.has_rex = true;
+		ctx.has_rex_w = op[0].rex.w;
+		ctx.has_rex_r = op[0].rex.r;
+		ctx.has_rex_x = op[0].rex.x;
 
 		if (!ctx_update(&ctx, &pc, 1, pg_structs))
 			goto error_noinst;
 		goto restart;
 	}
-	switch (op[0].raw) {
-	case X86_PREFIX_ADDR_SZ:
-		if (!ctx_update(&ctx, &pc, 1, pg_structs))
-			goto error_noinst;
-		ctx.has_addrsz_prefix = true;
-		goto restart;
-	case X86_PREFIX_OP_SZ:
+	if (op[0].raw == X86_PREFIX_ADDR_SZ || op[0].raw == X86_PREFIX_OP_SZ) {
+		if (op[0].raw == X86_PREFIX_ADDR_SZ)
+			ctx.has_addrsz_prefix = true;
+		else
+			ctx.has_opsz_prefix = true;
+		/* a REX prefix followed by a legacy prefix is ignored */
+		ctx.has_rex = ctx.has_rex_w = false;
+		ctx.has_rex_r = ctx.has_rex_x = false;
+
 		if (!ctx_update(&ctx, &pc, 1, pg_structs))
 			goto error_noinst;
-		ctx.has_opsz_prefix = true;
 		goto restart;
+	}
+
+	/* extended SIB index registers are not supported */
+	if (ctx.has_rex_x)
+		goto error_unsupported;
+
+	parse_widths(&ctx);
+
+	switch (op[0].raw) {
 	case X86_OP_MOVZX_OPC1:
 		ctx.zero_extend = true;
 		if (!ctx_update(&ctx, &pc, 1, pg_structs))
@@ -161,26 +169,31 @@ restart:
 		ctx.does_write = true;
 		break;
 	case X86_OP_MOV_TO_MEM:
-		parse_widths(&ctx, &inst, false);
+		inst.access_size = ctx.operand_size;
 		ctx.does_write = true;
 		break;
 	case X86_OP_MOVB_FROM_MEM:
 		inst.access_size = 1;
 		break;
 	case X86_OP_MOV_FROM_MEM:
-		parse_widths(&ctx, &inst, false);
+		inst.access_size = ctx.operand_size;
 		break;
 	case X86_OP_MOV_IMMEDIATE_TO_MEM:
-		parse_widths(&ctx, &inst, false);
+		inst.access_size = ctx.operand_size;
 		ctx.has_immediate = true;
 		ctx.does_write = true;
 		break;
 	case X86_OP_MOV_MEM_TO_AX:
-		parse_widths(&ctx, &inst, true);
+		inst.access_size = ctx.operand_size;
+		inst.inst_len += ctx.address_size;
 		inst.in_reg_num = 15;
+		/* a 16-bit read must preserve the upper bits, see below */
+		if (inst.access_size < 4)
+			inst.reg_preserve_mask = ~BYTE_MASK(inst.access_size);
 		goto final;
 	case X86_OP_MOV_AX_TO_MEM:
-		parse_widths(&ctx, &inst, true);
+		inst.access_size = ctx.operand_size;
+		inst.inst_len += ctx.address_size;
 		inst.out_val = guest_regs->by_index[15];
 		ctx.does_write = true;
 		goto final;
@@ -210,7 +223,7 @@ restart:
 		 * For regular instructions, this is the case if access_size < 4.
 		 *
 		 * For zero-extend instructions, this is the case if the
-		 * operand size override prefix is set.
+		 * destination register is 16 bit wide.
 		 */
 		if (!ctx.zero_extend && inst.access_size < 4) {
 			/*
@@ -218,7 +231,7 @@ restart:
 			 * preserve all other bits
 			 */
 			inst.reg_preserve_mask = ~BYTE_MASK(inst.access_size);
-		} else if (ctx.zero_extend && ctx.has_opsz_prefix) {
+		} else if (ctx.zero_extend && ctx.operand_size == 2) {
 			/*
 			 * Always preserve bits 16-63. Potential zero-extend of
 			 * bits 8-15 is ensured by access_size
@@ -231,8 +244,17 @@ restart:
 	if (op[0].raw == X86_OP_MOV_IMMEDIATE_TO_MEM && op[2].modrm.reg != 0)
 		goto error_unsupported;
 
-	switch (op[2].modrm.mod) {
-	case 0:
+	/* register operands do not access MMIO */
+	if (op[2].modrm.mod == 3)
+		goto error_unsupported;
+
+	if (ctx.address_size == 2) {
+		/* 16-bit addressing: no SIB, 16-bit displacements */
+		if (op[2].modrm.mod == 1)
+			skip_len = 1;
+		else if (op[2].modrm.mod == 2 || op[2].modrm.rm == 6)
+			skip_len = 2;
+	} else if (op[2].modrm.mod == 0) {
 		if (op[2].modrm.rm == 4) { /* SIB */
 			if (!ctx_update(&ctx, &pc, 1, pg_structs))
 				goto error_noinst;
@@ -243,21 +265,20 @@ restart:
 		} else if (op[2].modrm.rm == 5) { /* 32-bit displacement */
 			skip_len = 4;
 		}
-		break;
-	case 1:
-	case 2:
+	} else {
 		skip_len = op[2].modrm.mod == 1 ? 1 : 4;
 		if (op[2].modrm.rm == 4) /* SIB */
 			skip_len++;
-		break;
-	default:
-		goto error_unsupported;
 	}
 
 	if (ctx.has_rex_r)
 		inst.in_reg_num = 7 - op[2].modrm.reg;
 	else if (op[2].modrm.reg == 4)
 		goto error_unsupported;
+	/* without REX, byte registers 4..7 are AH..BH, not supported */
+	else if (op[2].modrm.reg > 4 && inst.access_size == 1 &&
+		 !ctx.zero_extend && !ctx.has_rex)
+		goto error_unsupported;
 	else
 		inst.in_reg_num = 15 - op[2].modrm.reg;
 
@@ -266,8 +287,9 @@ restart:
 		if (!ctx_update(&ctx, &pc, skip_len, pg_structs))
 			goto error_noinst;
 
-		/* retrieve immediate value */
-		for (n = 0; n < IMMEDIATE_SIZE; n++) {
+		/* retrieve immediate value, 16 bits with a 16-bit operand */
+		imm_size = MIN(ctx.operand_size, IMMEDIATE_SIZE);
+		for (n = 0; n < imm_size; n++) {
 			if (!ctx_update(&ctx, &pc, 1, pg_structs))
 				goto error_noinst;
 			inst.out_val |= (unsigned long)*ctx.inst << (n * 8);
@@ -11,6 +11,7 @@
  * the COPYING file in the top-level directory.
  */
 
+#include <jailhouse/bitops.h>
 #include <jailhouse/control.h>
 #include <jailhouse/mmio.h>
 #include <jailhouse/pci.h>
@@ -64,57 +65,27 @@ void arch_pci_write_config(u16 bdf, u16 address, u32 value, unsigned int size)
 	spin_unlock(&pci_lock);
 }
 
-/**
- * Set value of RAX in current CPU's guest register set.
- * @param value		Value to be written.
- * @param size		Access size (1, 2 or 4 bytes).
- *
- * @private
- */
-static void set_guest_rax_reg(u32 value, u8 size)
-{
-	union registers *guest_regs = &this_cpu_data()->guest_regs;
-	/* 32-bit access is special since it clears all the upper part of RAX.
-	 * Any other types of access leave it intact. */
-	u64 mask = (size == 4 ? BYTE_MASK(8) : BYTE_MASK(size));
-
-	guest_regs->rax = (guest_regs->rax & ~mask) | (value & mask);
-}
-
-/**
- * Get value of RAX from current CPU's guest register set.
- * @param size		Access size (1, 2 or 4 bytes).
- *
- * @return Register value.
- *
- * @private
- */
-static u32 get_guest_rax_reg(u8 size)
-{
-	return this_cpu_data()->guest_regs.rax & BYTE_MASK(size);
-}
-
 /**
  * Handler for IN accesses to data port.
  * @param device	Structure describing PCI device.
  * @param address	Config space access address.
- * @param size		Access size (1, 2 or 4 bytes).
+ * @param pio		Port I/O access description.
  *
  * @return 1 if handled successfully, -1 on access error.
  *
  * @private
  */
 static int data_port_in_handler(struct pci_device *device, u16 address,
-				unsigned int size)
+				struct pio_access *pio)
 {
 	u32 reg_data;
 
 	if (pci_cfg_read_moderate(device, address,
-				  size, &reg_data) == PCI_ACCESS_PERFORM)
+				  pio->size, &reg_data) == PCI_ACCESS_PERFORM)
 		reg_data = arch_pci_read_config(device->info->bdf, address,
-						size);
+						pio->size);
 
-	set_guest_rax_reg(reg_data, size);
+	pio->value = reg_data;
 
 	return 1;
 }
@@ -123,36 +94,35 @@ static int data_port_in_handler(struct pci_device *device, u16 address,
  * Handler for OUT accesses to data port.
  * @param device	Structure describing PCI device.
  * @param address	Config space access address.
- * @param size		Access size (1, 2 or 4 bytes).
+ * @param pio		Port I/O access description.
  *
  * @return 1 if handled successfully, -1 on access error.
  *
  * @private
  */
 static int data_port_out_handler(struct pci_device *device, u16 address,
-				 unsigned int size)
+				 struct pio_access *pio)
 {
-	u32 reg_data = get_guest_rax_reg(size);
+	u32 reg_data = pio->value;
 	enum pci_access access;
 
-	access = pci_cfg_write_moderate(device, address, size, reg_data);
+	access = pci_cfg_write_moderate(device, address, pio->size, reg_data);
 	if (access == PCI_ACCESS_REJECT)
 		return -1;
 	if (access == PCI_ACCESS_PERFORM)
 		arch_pci_write_config(device->info->bdf, address, reg_data,
-				      size);
+				      pio->size);
 	return 1;
 }
 
 /**
  * Handler for accesses to PCI config space.
- * @param port		I/O port number of this access.
- * @param dir_in	True for input, false for output.
- * @param size		Size of access in bytes (1, 2 or 4 bytes).
+ * @param arg		Unused.
+ * @param pio		Port I/O access description.
  *
  * @return 1 if handled successfully, 0 if unhandled, -1 on access error.
  */
-int x86_pci_config_handler(u16 port, bool dir_in, unsigned int size)
+int x86_pci_config_handler(void *arg, struct pio_access *pio)
 {
 	struct cell *cell = this_cell();
 	struct pci_device *device;
@@ -160,20 +130,20 @@ int x86_pci_config_handler(u16 port, bool dir_in, unsigned int size)
 	u16 bdf, address;
 	int result = 0;
 
-	if (port == PCI_REG_ADDR_PORT) {
+	if (pio->port == PCI_REG_ADDR_PORT) {
 		/* only 4-byte accesses are valid */
-		if (size != 4)
+		if (pio->size != 4)
 			goto invalid_access;
 
-		if (dir_in)
-			set_guest_rax_reg(cell->arch.pci_addr_port_val, size);
+		if (pio->in)
+			pio->value = cell->arch.pci_addr_port_val;
 		else
-			cell->arch.pci_addr_port_val = get_guest_rax_reg(size);
+			cell->arch.pci_addr_port_val = pio->value;
 		result = 1;
-	} else if (port >= PCI_REG_DATA_PORT &&
-		   port < (PCI_REG_DATA_PORT + 4)) {
+	} else if (pio->port >= PCI_REG_DATA_PORT &&
+		   pio->port < (PCI_REG_DATA_PORT + 4)) {
 		/* overflowing accesses are invalid */
-		if (port + size > PCI_REG_DATA_PORT + 4)
+		if (pio->port + pio->size > PCI_REG_DATA_PORT + 4)
 			goto invalid_access;
 
 		/*
@@ -188,17 +158,17 @@ int x86_pci_config_handler(u16 port, bool dir_in, unsigned int size)
 		device = pci_get_assigned_device(cell, bdf);
 
 		address = (addr_port_val & PCI_ADDR_REGNUM_MASK) +
-			port - PCI_REG_DATA_PORT;
+			pio->port - PCI_REG_DATA_PORT;
 
-		if (dir_in)
-			result = data_port_in_handler(device, address, size);
+		if (pio->in)
+			result = data_port_in_handler(device, address, pio);
 		else
-			result = data_port_out_handler(device, address, size);
+			result = data_port_out_handler(device, address, pio);
 		if (result < 0) {
 			panic_printk("FATAL: Invalid PCI config %s, device "
 				     "%02x:%02x.%x, reg: 0x%x, size: %d\n",
-				     dir_in ? "read" : "write",
-				     PCI_BDF_PARAMS(bdf), address, size);
+				     pio->in ? "read" : "write",
+				     PCI_BDF_PARAMS(bdf), address, pio->size);
 			return -1;
 		}
 	}
@@ -207,7 +177,7 @@ int x86_pci_config_handler(u16 port, bool dir_in, unsigned int size)
 
 invalid_access:
 	panic_printk("FATAL: Invalid PCI config %s, port: 0x%x, size: %d\n",
-		     dir_in ? "read" : "write", port, size);
+		     pio->in ? "read" : "write", pio->port, pio->size);
 	return -1;
 
 }
@@ -357,19 +327,24 @@ int arch_pci_update_msi(struct pci_device *device,
 	if (vectors == 0)
 		return 0;
 
+	iommu_begin_interrupt_batch();
 	for (n = 0; n < vectors; n++) {
 		irq_msg = x86_pci_translate_msi(device, n, vectors, msi);
 		result = iommu_map_interrupt(device->cell, bdf, n, irq_msg);
-		// HACK for QEMU
-		if (result == -ENOSYS) {
-			for (n = 1; n < (info->msi_64bits ? 4 : 3); n++)
-				pci_write_config(bdf, cap->start + n * 4,
-					device->msi_registers.raw[n], 4);
-			return 0;
-		}
 		if (result < 0)
-			return result;
+			break;
+	}
+	iommu_end_interrupt_batch();
+
+	// HACK for QEMU
+	if (result == -ENOSYS) {
+		for (n = 1; n < (info->msi_64bits ? 4 : 3); n++)
+			pci_write_config(bdf, cap->start + n * 4,
+					 device->msi_registers.raw[n], 4);
+		return 0;
 	}
+	if (result < 0)
+		return result;
 
 	/* set result to the base index again */
 	result -= vectors - 1;
@@ -384,7 +359,16 @@ int arch_pci_update_msi(struct pci_device *device,
 	return 0;
 }
 
-int arch_pci_update_msix_vector(struct pci_device *device, unsigned int index)
+/*
+ * Returned by pci_map_msix_vector if the table entry needs no update. Beyond
+ * any interrupt remapping index.
+ */
+#define MSIX_VECTOR_UNCHANGED	0x10000
+
+/* Number of MSI-X vectors whose remapping is invalidated in one go. */
+#define MSIX_BATCH_SIZE		32
+
+static int pci_map_msix_vector(struct pci_device *device, unsigned int index)
 {
 	union x86_msi_vector msi = {
 		.raw.address = device->msix_vectors[index].address,
@@ -394,8 +378,9 @@ int arch_pci_update_msix_vector(struct pci_device *device, unsigned int index)
 	int result;
 
 	if (!device->msix_registers.enable || device->msix_registers.fmask ||
-	    device->msix_vectors[index].masked)
-		return 0;
+	    device->msix_vectors[index].masked ||
+	    test_bit(index, device->msix_programmed))
+		return MSIX_VECTOR_UNCHANGED;
 
 	irq_msg = x86_pci_translate_msi(device, index, 0, msi);
 	result = iommu_map_interrupt(device->cell, device->info->bdf, index,
@@ -406,14 +391,69 @@ int arch_pci_update_msix_vector(struct pci_device *device, unsigned int index)
 				   device->msix_vectors[index].address);
 		mmio_write32(&device->msix_table[index].data,
 			     device->msix_vectors[index].data);
-		return 0;
+		set_bit(index, device->msix_programmed);
+		return MSIX_VECTOR_UNCHANGED;
 	}
-	if (result < 0)
-		return result;
+	return result;
+}
 
+static void pci_write_msix_remap(struct pci_device *device, unsigned int index,
+				 unsigned int remap_index)
+{
 	mmio_write64_split(&device->msix_table[index].address,
-			   pci_get_x86_msi_remap_address(result));
+			   pci_get_x86_msi_remap_address(remap_index));
 	mmio_write32(&device->msix_table[index].data, 0);
+	set_bit(index, device->msix_programmed);
+}
+
+int arch_pci_update_msix_vector(struct pci_device *device, unsigned int index)
+{
+	int result = pci_map_msix_vector(device, index);
+
+	if (result < 0)
+		return result;
+	if (result != MSIX_VECTOR_UNCHANGED)
+		pci_write_msix_remap(device, index, result);
+	return 0;
+}
+
+int arch_pci_update_msix(struct pci_device *device)
+{
+	struct {
+		u16 vector;
+		u16 remap_index;
+	} batch[MSIX_BATCH_SIZE];
+	unsigned int n, queued = 0, index = 0;
+	int result = 0;
+
+	/*
+	 * Remap the vectors in chunks, invalidating the IOMMU's interrupt
+	 * cache once per chunk before pointing the table entries to it.
+	 */
+	while (index < device->info->num_msix_vectors) {
+		iommu_begin_interrupt_batch();
+		while (index < device->info->num_msix_vectors &&
+		       queued < MSIX_BATCH_SIZE) {
+			result = pci_map_msix_vector(device, index);
+			if (result < 0)
+				break;
+			if (result != MSIX_VECTOR_UNCHANGED) {
+				batch[queued].vector = index;
+				batch[queued].remap_index = result;
+				queued++;
+			}
+			index++;
+		}
+		iommu_end_interrupt_batch();
+
+		for (n = 0; n < queued; n++)
+			pci_write_msix_remap(device, batch[n].vector,
+					     batch[n].remap_index);
+		queued = 0;
+
+		if (result < 0)
+			return result;
+	}
 
 	return 0;
 }
@@ -0,0 +1,91 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/cell.h>
+#include <jailhouse/control.h>
+#include <jailhouse/printk.h>
+#include <jailhouse/percpu.h>
+#include <asm/pio.h>
+
+static const struct pio_region_handler *
+find_handler(const struct pio_dispatch *dispatch, u16 port)
+{
+	unsigned int page = dispatch->pages[port >> 8];
+	unsigned int index;
+
+	if (page == 0)
+		return NULL;
+	index = dispatch->ports[page - 1][port & 0xff];
+	return index ? &dispatch->handlers[index - 1] : NULL;
+}
+
+/**
+ * Register a handler for a range of intercepted I/O ports.
+ * @param cell		Cell the ports belong to.
+ * @param start		First port of the range.
+ * @param length	Number of ports.
+ * @param handler	Access handler.
+ * @param handler_arg	Opaque argument to pass to the handler.
+ *
+ * The ports must also be intercepted via the cell's I/O bitmap. Ranges must
+ * not overlap.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int pio_region_register(struct cell *cell, u16 start, unsigned int length,
+			pio_handler handler, void *handler_arg)
+{
+	struct pio_dispatch *dispatch = &cell->arch.pio;
+	unsigned int end = start + length;
+	unsigned int port, page, new_pages = 0;
+
+	if (length == 0 || end > 0x10000)
+		return trace_error(-EINVAL);
+	if (dispatch->num_handlers >= PIO_MAX_REGIONS)
+		return trace_error(-ENOMEM);
+
+	for (port = start; port < end; port++)
+		if (find_handler(dispatch, port))
+			return trace_error(-EBUSY);
+	for (page = start >> 8; page <= (end - 1) >> 8; page++)
+		if (dispatch->pages[page] == 0)
+			new_pages++;
+	if (dispatch->num_pages + new_pages > PIO_MAX_PAGES)
+		return trace_error(-ENOMEM);
+
+	dispatch->handlers[dispatch->num_handlers].function = handler;
+	dispatch->handlers[dispatch->num_handlers].arg = handler_arg;
+	dispatch->num_handlers++;
+
+	for (port = start; port < end; port++) {
+		page = port >> 8;
+		if (dispatch->pages[page] == 0)
+			dispatch->pages[page] = ++dispatch->num_pages;
+		dispatch->ports[dispatch->pages[page] - 1][port & 0xff] =
+			dispatch->num_handlers;
+	}
+
+	return 0;
+}
+
+/**
+ * Dispatch an intercepted port I/O access of the current cell.
+ * @param pio		Port I/O access description.
+ *
+ * @return 1 if handled successfully, 0 if unhandled, -1 on access error.
+ */
+int pio_handle_access(struct pio_access *pio)
+{
+	const struct pio_region_handler *handler =
+		find_handler(&this_cell()->arch.pio, pio->port);
+
+	if (!handler)
+		return 0;
+	return handler->function(handler->arg, pio);
+}
@@ -0,0 +1,185 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/cell.h>
+#include <jailhouse/control.h>
+#include <jailhouse/percpu.h>
+#include <jailhouse/printk.h>
+#include <asm/pmu.h>
+#include <asm/vcpu.h>
+
+struct pmu_msr_range {
+	u32 start;
+	unsigned int count;
+	unsigned int flags;
+};
+
+static struct pmu_msr_range pmu_ranges[PMU_MAX_RANGES];
+static unsigned int pmu_num_ranges;
+static unsigned int pmu_num_state_msrs;
+static bool pmu_ranges_lost;
+
+static inline bool pmu_state_switchable(void)
+{
+	return pmu_num_state_msrs <= PMU_MAX_STATE_MSRS;
+}
+
+/**
+ * Register a range of performance monitoring MSRs.
+ * @param start		First MSR of the range.
+ * @param count		Number of MSRs.
+ * @param flags		PMU_MSR_STATE if the MSRs hold state that has to be
+ * 			switched on CPU handover, not set for aliases and status
+ * 			registers. PMU_MSR_ROOT_INTERCEPT if the root cell shall
+ * 			not access the MSRs directly.
+ *
+ * Registered MSRs are passed through to the root cell, unless
+ * PMU_MSR_ROOT_INTERCEPT is set, and to cells with
+ * JAILHOUSE_CELL_PMU_PASSTHROUGH set, and intercepted for all others. Ranges
+ * have to be registered in the order their state can be cleared, i.e.
+ * controls before counters.
+ *
+ * If the state MSRs exceed PMU_MAX_STATE_MSRS, they cannot be switched on
+ * CPU handover. All cells are intercepted then. If a range does not fit
+ * into PMU_MAX_RANGES, its MSRs cannot be intercepted at all, and creating
+ * any cell fails.
+ */
+void pmu_register_msrs(u32 start, unsigned int count, unsigned int flags)
+{
+	struct pmu_msr_range *range = &pmu_ranges[pmu_num_ranges];
+
+	if (count == 0)
+		return;
+
+	if (pmu_num_ranges >= PMU_MAX_RANGES) {
+		pmu_ranges_lost = true;
+		return;
+	}
+
+	range->start = start;
+	range->count = count;
+	range->flags = flags;
+	pmu_num_ranges++;
+	if (!(flags & PMU_MSR_STATE))
+		return;
+
+	if (pmu_state_switchable() &&
+	    pmu_num_state_msrs + count > PMU_MAX_STATE_MSRS)
+		printk("WARNING: Too many PMU counters, intercepting them "
+		       "in all cells\n");
+	pmu_num_state_msrs += count;
+}
+
+bool pmu_is_msr(u32 msr)
+{
+	unsigned int n;
+
+	for (n = 0; n < pmu_num_ranges; n++)
+		if (msr - pmu_ranges[n].start < pmu_ranges[n].count)
+			return true;
+	return false;
+}
+
+int pmu_cell_init(struct cell *cell)
+{
+	bool passthrough = cell == &root_cell ||
+		(cell->config->flags & JAILHOUSE_CELL_PMU_PASSTHROUGH);
+	bool intercept;
+	unsigned int n, i;
+
+	if (pmu_ranges_lost)
+		return trace_error(-ENOMEM);
+
+	if (passthrough && !pmu_state_switchable()) {
+		if (cell != &root_cell)
+			return trace_error(-EINVAL);
+		passthrough = false;
+	}
+
+	for (n = 0; n < pmu_num_ranges; n++) {
+		intercept = !passthrough ||
+			(cell == &root_cell &&
+			 pmu_ranges[n].flags & PMU_MSR_ROOT_INTERCEPT);
+		for (i = 0; i < pmu_ranges[n].count; i++)
+			vcpu_vendor_set_msr_intercept(cell,
+						      pmu_ranges[n].start + i,
+						      intercept);
+	}
+	return 0;
+}
+
+static void pmu_save_state(u64 *state)
+{
+	const struct pmu_msr_range *range;
+	unsigned int i;
+
+	for (range = pmu_ranges; range < &pmu_ranges[pmu_num_ranges]; range++)
+		if (range->flags & PMU_MSR_STATE)
+			for (i = 0; i < range->count; i++)
+				*state++ = read_msr(range->start + i);
+}
+
+static void pmu_clear_state(void)
+{
+	const struct pmu_msr_range *range;
+	unsigned int i;
+
+	for (range = pmu_ranges; range < &pmu_ranges[pmu_num_ranges]; range++)
+		if (range->flags & PMU_MSR_STATE)
+			for (i = 0; i < range->count; i++)
+				write_msr(range->start + i, 0);
+}
+
+static void pmu_restore_state(const u64 *state)
+{
+	const struct pmu_msr_range *range;
+	unsigned int i;
+
+	/* counters first, controls last */
+	state += pmu_num_state_msrs;
+	for (range = &pmu_ranges[pmu_num_ranges]; range-- > pmu_ranges; )
+		if (range->flags & PMU_MSR_STATE)
+			for (i = range->count; i-- > 0; )
+				write_msr(range->start + i, *--state);
+}
+
+/**
+ * Switch the performance monitoring state to the cell the calling CPU
+ * currently belongs to.
+ *
+ * The root cell's state is saved when its CPU is handed over to another
+ * cell and restored when the CPU returns. Other cells start with cleared
+ * counters, and their state is discarded when the CPU leaves them. If the
+ * state does not fit into the save area, all cells are intercepted, and the
+ * counters are only cleared.
+ */
+void pmu_load_cell_state(void)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	bool root = cpu_data->public.cell == &root_cell;
+
+	if (!pmu_state_switchable()) {
+		pmu_clear_state();
+		return;
+	}
+
+	if (!cpu_data->pmu_root_saved) {
+		if (root)
+			return;
+		pmu_save_state(cpu_data->pmu_root_state);
+		cpu_data->pmu_root_saved = true;
+	}
+
+	pmu_clear_state();
+
+	if (root) {
+		pmu_restore_state(cpu_data->pmu_root_state);
+		cpu_data->pmu_root_saved = false;
+	}
+}
@@ -22,12 +22,14 @@
 #include <jailhouse/printk.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/string.h>
+#include <jailhouse/trace.h>
 #include <jailhouse/utils.h>
 #include <asm/amd_iommu.h>
 #include <asm/apic.h>
 #include <asm/control.h>
 #include <asm/iommu.h>
 #include <asm/paging.h>
+#include <asm/pmu.h>
 #include <jailhouse/percpu.h>
 #include <asm/processor.h>
 #include <asm/svm.h>
@@ -42,16 +44,29 @@
 
 /* IOPM size: two 4-K pages + 3 bits */
 #define IOPM_PAGES			3
+/* MSRPM size: 8 K */
+#define MSRPM_PAGES			2
 
 #define NPT_IOMMU_PAGE_DIR_LEVELS	4
 
+/* Parked CPUs share one ASID, the parking page table never changes. */
+#define SVM_PARKING_ASID		1
+#define SVM_FIRST_CELL_ASID		2
+
 static bool has_avic, has_assists, has_flush_by_asid;
 
+static unsigned int num_asids;
+static unsigned int next_asid = SVM_FIRST_CELL_ASID;
+static unsigned int asid_generation = 1;
+
 static const struct segment invalid_seg;
 
 static struct paging npt_iommu_paging[NPT_IOMMU_PAGE_DIR_LEVELS];
 
-/* bit cleared: direct access allowed */
+/*
+ * bit cleared: direct access allowed
+ * Template for the per-cell maps, PMU MSRs are set up by pmu_cell_init.
+ */
 // TODO: convert to whitelist
 static u8 __attribute__((aligned(PAGE_SIZE))) msrpm[][0x2000/4] = {
 	[ SVM_MSRPM_0000 ] = {
@@ -92,6 +107,11 @@ static u8 __attribute__((aligned(PAGE_SIZE))) msrpm[][0x2000/4] = {
 
 static void *avic_page;
 
+static bool cell_uses_avic(struct cell *cell)
+{
+	return has_avic && (cell->config->flags & JAILHOUSE_CELL_AVIC);
+}
+
 static int svm_check_features(void)
 {
 	/* SVM is available */
@@ -106,15 +126,19 @@ static int svm_check_features(void)
 	if ((cpuid_edx(0x8000000A, 0) & X86_FEATURE_DECODE_ASSISTS))
 		has_assists = true;
 
-	/* AVIC support */
-	/* FIXME: Jailhouse support is incomplete so far
-	if (cpuid_edx(0x8000000A, 0) & X86_FEATURE_AVIC)
-		has_avic = true; */
+	/* AVIC support, only usable with xAPIC */
+	if (!using_x2apic && (cpuid_edx(0x8000000A, 0) & X86_FEATURE_AVIC))
+		has_avic = true;
 
 	/* TLB Flush by ASID support */
 	if (cpuid_edx(0x8000000A, 0) & X86_FEATURE_FLUSH_BY_ASID)
 		has_flush_by_asid = true;
 
+	/* Parking and at least the root cell need their own ASIDs */
+	num_asids = cpuid_ebx(0x8000000A, 0);
+	if (num_asids <= SVM_FIRST_CELL_ASID)
+		return trace_error(-EIO);
+
 	return 0;
 }
 
@@ -138,8 +162,83 @@ static void set_svm_segment_from_segment(struct svm_segment *svm_segment,
 static void svm_set_cell_config(struct cell *cell, struct vmcb *vmcb)
 {
 	vmcb->iopm_base_pa = paging_hvirt2phys(cell->arch.io_bitmap);
+	vmcb->msrpm_base_pa = paging_hvirt2phys(cell->arch.msr_bitmap);
+	vmcb->guest_asid = cell->arch.svm.asid;
 	vmcb->n_cr3 =
 		paging_hvirt2phys(cell->arch.svm.npt_iommu_structs.root_table);
+	vmcb->clean_bits &=
+		~(CLEAN_BITS_IOPM | CLEAN_BITS_ASID | CLEAN_BITS_NP);
+
+	if (cell_uses_avic(cell)) {
+		vmcb->avic_logical_id =
+			paging_hvirt2phys(cell->arch.svm.avic_logical_table);
+		vmcb->avic_physical_id =
+			paging_hvirt2phys(cell->arch.svm.avic_physical_table) |
+			APIC_MAX_PHYS_ID;
+		vmcb->clean_bits &= ~CLEAN_BITS_AVIC;
+	}
+}
+
+static void avic_set_table_entries(struct cell *cell, unsigned int cpu)
+{
+	unsigned int apic_id = public_per_cpu(cpu)->apic_id;
+
+	/*
+	 * Our vCPUs never leave guest mode for longer than an exit, so they
+	 * are always flagged as running. Doorbells hitting a CPU while it is
+	 * in the hypervisor are picked up on the next VMRUN.
+	 */
+	cell->arch.svm.avic_physical_table[apic_id] = apic_id |
+		(paging_hvirt2phys(per_cpu(cpu)->avic_backing_page) &
+		 AVIC_PHYS_ENTRY_BACKING_PAGE) |
+		AVIC_PHYS_ENTRY_IS_RUNNING | AVIC_PHYS_ENTRY_VALID;
+
+	/* flat logical mode with one bit per CPU, see apic_mmio_access */
+	if (cpu < 8)
+		cell->arch.svm.avic_logical_table[cpu] =
+			apic_id | AVIC_LOG_ENTRY_VALID;
+}
+
+/*
+ * Only CPUs of the cell are valid IPI targets for AVIC. Everything else
+ * raises VMEXIT_AVIC_INCOMPLETE_IPI and is checked by apic_handle_icr_write.
+ */
+static void avic_update_tables(struct cell *cell)
+{
+	unsigned int cpu;
+
+	memset(cell->arch.svm.avic_physical_table, 0, PAGE_SIZE);
+	memset(cell->arch.svm.avic_logical_table, 0, PAGE_SIZE);
+	for_each_cpu(cpu, cell->cpu_set)
+		avic_set_table_entries(cell, cpu);
+}
+
+static void avic_vcpu_setup(struct vmcb *vmcb)
+{
+	/*
+	 * The guest works on the virtual APIC in the backing page, so its EOIs
+	 * never reach the physical APIC. Physical interrupts are therefore
+	 * taken by the host and forwarded to it. This requires them to be
+	 * masked by the host IF, not the guest one.
+	 */
+	vmcb->general1_intercepts |= GENERAL1_INTERCEPT_INTR;
+	vmcb->vintr = SVM_VINTR_MASKING | SVM_VINTR_AVIC_ENABLE;
+	vmcb->avic_apic_bar = XAPIC_BASE;
+	vmcb->avic_backing_page =
+		paging_hvirt2phys(per_cpu(this_cpu_id())->avic_backing_page);
+	vmcb->clean_bits &= ~(CLEAN_BITS_I | CLEAN_BITS_TPR | CLEAN_BITS_AVIC);
+
+	apic_vapic_init(this_cpu_data()->avic_backing_page);
+}
+
+/* Deliver physical interrupts directly again, see avic_vcpu_setup */
+static void avic_vcpu_disable(struct vmcb *vmcb)
+{
+	vmcb->general1_intercepts &= ~GENERAL1_INTERCEPT_INTR;
+	vmcb->vintr = 0;
+	vmcb->clean_bits &= ~(CLEAN_BITS_I | CLEAN_BITS_TPR);
+
+	asm volatile("cli" : : : "memory");
 }
 
 static void vmcb_setup(struct per_cpu *cpu_data)
@@ -212,13 +311,14 @@ static void vmcb_setup(struct per_cpu *cpu_data)
 	 */
 	vmcb->exception_intercepts |= (1 << DB_VECTOR) | (1 << AC_VECTOR);
 
-	vmcb->msrpm_base_pa = paging_hvirt2phys(msrpm);
-
 	vmcb->np_enable = 1;
-	/* No more than one guest owns the CPU */
-	vmcb->guest_asid = 1;
+	/* Drop whatever was cached before we took over the CPU */
+	vmcb->tlb_control = SVM_TLB_FLUSH_ALL;
+	cpu_data->svm_asid_generation = asid_generation;
+	cpu_data->svm_cell_asid = cpu_data->public.cell->arch.svm.asid;
 
-	/* TODO: Setup AVIC */
+	if (cell_uses_avic(cpu_data->public.cell))
+		avic_vcpu_setup(vmcb);
 
 	/* Explicitly mark all of the state as new */
 	vmcb->clean_bits = 0;
@@ -272,6 +372,33 @@ static unsigned long npt_iommu_get_phys_l2(pt_entry_t pte, unsigned long virt)
 	return (*pte & BIT_MASK(51, 21)) | (virt & BIT_MASK(20, 0));
 }
 
+static void svm_pmu_init(void)
+{
+	unsigned int counters = 6;
+
+	if (cpuid_eax(0x80000000, 0) >= 0x80000022 &&
+	    (cpuid_eax(0x80000022, 0) & X86_FEATURE_PERFMON_V2)) {
+		counters = cpuid_ebx(0x80000022, 0) & 0xf;
+		pmu_register_msrs(MSR_AMD64_PERF_CNTR_GLOBAL_CTL, 1,
+				  PMU_MSR_STATE);
+		pmu_register_msrs(MSR_AMD64_PERF_CNTR_GLOBAL_STATUS, 1, 0);
+		pmu_register_msrs(MSR_AMD64_PERF_CNTR_GLOBAL_STATUS_CLR, 1, 0);
+	}
+
+	if (cpuid_ecx(0x80000001, 0) & X86_FEATURE_PERFCTR_CORE) {
+		/*
+		 * Interleaved PERF_CTL/PERF_CTR pairs, the legacy MSRs alias
+		 * the first four of them.
+		 */
+		pmu_register_msrs(MSR_F15H_PERF_CTL0, counters * 2,
+				  PMU_MSR_STATE);
+		pmu_register_msrs(MSR_K7_EVNTSEL0, 8, 0);
+	} else {
+		pmu_register_msrs(MSR_K7_EVNTSEL0, 4, PMU_MSR_STATE);
+		pmu_register_msrs(MSR_K7_PERFCTR0, 4, PMU_MSR_STATE);
+	}
+}
+
 int vcpu_vendor_early_init(void)
 {
 	unsigned long vm_cr;
@@ -286,6 +413,8 @@ int vcpu_vendor_early_init(void)
 		/* SVM disabled in BIOS */
 		return trace_error(-EPERM);
 
+	svm_pmu_init();
+
 	/*
 	 * Nested paging is almost the same as the native one. However, we
 	 * need to override some handlers in order to reuse the page table for
@@ -318,16 +447,82 @@ int vcpu_vendor_early_init(void)
 	return vcpu_cell_init(&root_cell);
 }
 
+static void avic_free_tables(struct cell *cell)
+{
+	page_free(&mem_pool, cell->arch.svm.avic_physical_table, 1);
+	page_free(&mem_pool, cell->arch.svm.avic_logical_table, 1);
+}
+
+static bool asid_in_use(unsigned int asid)
+{
+	struct cell *cell;
+
+	for_each_cell(cell)
+		if (cell->arch.svm.asid == asid)
+			return true;
+	return false;
+}
+
+/*
+ * ASIDs are handed out in ascending order, so a new cell does not find TLB
+ * entries of a destroyed one under its ASID. Only after wrapping around,
+ * CPUs have to flush all ASIDs before entering a cell of the new generation.
+ */
+static int svm_alloc_asid(struct cell *cell)
+{
+	unsigned int n;
+
+	for (n = SVM_FIRST_CELL_ASID; n < num_asids; n++) {
+		if (next_asid >= num_asids) {
+			next_asid = SVM_FIRST_CELL_ASID;
+			asid_generation++;
+		}
+		if (!asid_in_use(next_asid)) {
+			cell->arch.svm.asid = next_asid++;
+			cell->arch.svm.asid_generation = asid_generation;
+			return 0;
+		}
+		next_asid++;
+	}
+	return trace_error(-ENOMEM);
+}
+
+/*
+ * Only flush the TLB when entering a cell if this CPU may hold stale entries
+ * under the cell's ASID: after ASIDs were recycled, when re-entering the cell
+ * it ran before, or when returning to the root cell whose memory may have
+ * changed meanwhile. Entries of other cells are left alone.
+ */
+static void svm_flush_on_cell_entry(struct per_cpu *cpu_data,
+				    struct cell *cell)
+{
+	if (cpu_data->svm_asid_generation < cell->arch.svm.asid_generation) {
+		cpu_data->vmcb.tlb_control = SVM_TLB_FLUSH_ALL;
+		cpu_data->svm_asid_generation = asid_generation;
+	} else if (cell == &root_cell ||
+		   cpu_data->svm_cell_asid == cell->arch.svm.asid) {
+		vcpu_tlb_flush();
+	}
+	cpu_data->svm_cell_asid = cell->arch.svm.asid;
+}
+
 int vcpu_vendor_cell_init(struct cell *cell)
 {
 	u64 flags;
+	int err;
+
+	memcpy(cell->arch.msr_bitmap, msrpm, sizeof(msrpm));
+
+	err = svm_alloc_asid(cell);
+	if (err)
+		return err;
 
 	/* build root NPT of cell */
 	cell->arch.svm.npt_iommu_structs.root_paging = npt_iommu_paging;
 	cell->arch.svm.npt_iommu_structs.root_table =
 		(page_table_t)cell->arch.root_table_page;
 
-	if (!has_avic) {
+	if (!cell_uses_avic(cell)) {
 		/*
 		 * Map xAPIC as is; reads are passed, writes are trapped.
 		 */
@@ -335,13 +530,34 @@ int vcpu_vendor_cell_init(struct cell *cell)
 		return paging_create(&cell->arch.svm.npt_iommu_structs,
 				     XAPIC_BASE, PAGE_SIZE, XAPIC_BASE, flags,
 				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
+	}
+
+	cell->arch.svm.avic_physical_table = page_alloc(&mem_pool, 1);
+	cell->arch.svm.avic_logical_table = page_alloc(&mem_pool, 1);
+	if (!cell->arch.svm.avic_physical_table ||
+	    !cell->arch.svm.avic_logical_table) {
+		avic_free_tables(cell);
+		return -ENOMEM;
+	}
+
+	/*
+	 * The root cell's CPUs register themselves in vcpu_init, their APIC
+	 * IDs are not known yet.
+	 */
+	if (cell == &root_cell) {
+		memset(cell->arch.svm.avic_physical_table, 0, PAGE_SIZE);
+		memset(cell->arch.svm.avic_logical_table, 0, PAGE_SIZE);
 	} else {
-		flags = PAGE_DEFAULT_FLAGS | PAGE_FLAG_DEVICE;
-		return paging_create(&cell->arch.svm.npt_iommu_structs,
-				     paging_hvirt2phys(avic_page),
-				     PAGE_SIZE, XAPIC_BASE, flags,
-				     PAGING_NON_COHERENT | PAGING_NO_HUGE);
+		avic_update_tables(cell);
 	}
+
+	flags = PAGE_DEFAULT_FLAGS | PAGE_FLAG_DEVICE;
+	err = paging_create(&cell->arch.svm.npt_iommu_structs,
+			    paging_hvirt2phys(avic_page), PAGE_SIZE, XAPIC_BASE,
+			    flags, PAGING_NON_COHERENT | PAGING_NO_HUGE);
+	if (err)
+		avic_free_tables(cell);
+	return err;
 }
 
 int vcpu_map_memory_region(struct cell *cell,
@@ -384,6 +600,16 @@ void vcpu_vendor_cell_exit(struct cell *cell)
 {
 	paging_destroy(&cell->arch.svm.npt_iommu_structs, XAPIC_BASE,
 		       PAGE_SIZE, PAGING_NON_COHERENT);
+
+	if (cell_uses_avic(cell))
+		avic_free_tables(cell);
+}
+
+void vcpu_config_commit(struct cell *cell_added_removed)
+{
+	/* Only the root cell's CPU set changes after creation */
+	if (cell_uses_avic(&root_cell))
+		avic_update_tables(&root_cell);
 }
 
 int vcpu_init(struct per_cpu *cpu_data)
@@ -406,6 +632,9 @@ int vcpu_init(struct per_cpu *cpu_data)
 
 	vmcb_setup(cpu_data);
 
+	if (cell_uses_avic(&root_cell))
+		avic_set_table_entries(&root_cell, this_cpu_id());
+
 	/*
 	 * APM Volume 2, 3.1.1: "When writing the CR0 register, software should
 	 * set the values of reserved bits to the values found during the
@@ -437,6 +666,15 @@ void vcpu_exit(struct per_cpu *cpu_data)
 
 	cpu_data->svm_state = SVMOFF;
 
+	/*
+	 * Leave pending physical interrupts to Linux and hand back those we
+	 * already took for it.
+	 */
+	if (cell_uses_avic(&root_cell)) {
+		asm volatile ("cli" : : : "memory");
+		apic_vapic_release(this_cpu_data()->avic_backing_page);
+	}
+
 	/* We are leaving - set the GIF */
 	asm volatile ("stgi" : : : "memory");
 
@@ -455,6 +693,13 @@ void __attribute__((noreturn)) vcpu_activate_vmm(void)
 	vmcb_pa = paging_hvirt2phys(&per_cpu(this_cpu_id())->vmcb);
 	host_stack = (unsigned long)cpu_data->stack + sizeof(cpu_data->stack);
 
+	/* The first VMRUN always loads the complete state, see vmcb_setup */
+	cpu_data->public.stats[JAILHOUSE_CPU_STAT_VMCB_RELOADS]++;
+
+	/* Physical interrupts are masked by the host IF with AVIC */
+	if (cell_uses_avic(&root_cell))
+		asm volatile("clgi; sti" : : : "memory");
+
 	/* We enter Linux at the point arch_entry would return to as well.
 	 * rax is cleared to signal success to the caller. */
 	asm volatile(
@@ -609,10 +854,24 @@ void vcpu_vendor_reset(unsigned int sipi_vector)
 
 	vmcb->eventinj = 0;
 
-	/* Almost all of the guest state changed */
-	vmcb->clean_bits = 0;
+	/*
+	 * Intercepts, MSR permissions, CR2 and LBR state are not touched by a
+	 * reset, so the CPU may keep its cached copies of them.
+	 */
+	vmcb->clean_bits &= ~(CLEAN_BITS_CRX | CLEAN_BITS_DRX | CLEAN_BITS_DT |
+			      CLEAN_BITS_SEG);
 
 	svm_set_cell_config(cpu_data->public.cell, vmcb);
+	svm_flush_on_cell_entry(cpu_data, cpu_data->public.cell);
+
+	/*
+	 * apic_clear left the APIC in reset state, take it over. The CPU may
+	 * have moved between cells with and without AVIC.
+	 */
+	if (cell_uses_avic(cpu_data->public.cell))
+		avic_vcpu_setup(vmcb);
+	else if (has_avic)
+		avic_vcpu_disable(vmcb);
 
 	vmcb_pa = paging_hvirt2phys(&per_cpu(this_cpu_id())->vmcb);
 	asm volatile("vmload %%rax" : : "a" (vmcb_pa) : "memory");
@@ -793,18 +1052,13 @@ static bool svm_handle_msr_write(struct per_cpu *cpu_data)
 }
 
 /*
- * TODO: This handles unaccelerated (non-AVIC) access. AVIC should
- * be treated separately in svm_handle_avic_access().
+ * Emulates the instruction that accessed the xAPIC. Used for all accesses
+ * without AVIC and for those AVIC faults on.
  */
-static bool svm_handle_apic_access(struct vmcb *vmcb)
+static bool svm_handle_apic_access(unsigned int offset, bool is_write)
 {
 	struct guest_paging_structures pg_structs;
-	unsigned int inst_len, offset;
-	bool is_write;
-
-	/* The caller is responsible for sanity checks */
-	is_write = !!(vmcb->exitinfo1 & 0x2);
-	offset = vmcb->exitinfo2 - XAPIC_BASE;
+	unsigned int inst_len;
 
 	if (offset & 0x00f)
 		goto out_err;
@@ -824,6 +1078,75 @@ out_err:
 	return false;
 }
 
+/* Writes to these registers are completed before VMEXIT_AVIC_NOACCEL */
+static bool avic_write_traps(unsigned int reg)
+{
+	switch (reg) {
+	case APIC_REG_ID:
+	case APIC_REG_EOI:
+	case APIC_REG_LDR:
+	case APIC_REG_DFR:
+	case APIC_REG_SVR:
+	case APIC_REG_ESR:
+	case APIC_REG_ICR:
+	case APIC_REG_LVTT ... APIC_REG_TMICT:
+	case APIC_REG_TDCR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool svm_handle_avic_noaccel(struct per_cpu *cpu_data)
+{
+	struct vmcb *vmcb = &cpu_data->vmcb;
+	u8 *vapic = cpu_data->avic_backing_page;
+	bool is_write = !!(vmcb->exitinfo1 & AVIC_NOACCEL_WRITE);
+	unsigned int offset = vmcb->exitinfo1 & AVIC_NOACCEL_OFFSET_MASK;
+	unsigned int reg = offset >> 4;
+	u32 *val, icr_hi;
+
+	if (!is_write || !avic_write_traps(reg))
+		return svm_handle_apic_access(offset, is_write);
+
+	/* The value is already in the backing page, RIP points past it. */
+	val = (u32 *)&vapic[offset];
+	if (reg == APIC_REG_EOI) {
+		/* only level-triggered interrupts trap */
+		apic_vapic_eoi(vapic);
+		return true;
+	}
+
+	icr_hi = *(u32 *)&vapic[APIC_REG_ICR_HI << 4] >> XAPIC_DEST_SHIFT;
+	if (!apic_handle_xapic_write(reg, *val, icr_hi)) {
+		panic_printk("FATAL: Invalid APIC write, offset %d\n", offset);
+		return false;
+	}
+
+	/* the APIC ID is read-only for us */
+	if (reg == APIC_REG_ID)
+		*val = cpu_data->public.apic_id << XAPIC_DEST_SHIFT;
+	return true;
+}
+
+static bool svm_handle_avic_incomplete_ipi(struct vmcb *vmcb)
+{
+	switch (vmcb->exitinfo2 >> 32) {
+	case AVIC_IPI_FAILURE_TARGET_NOT_RUNNING:
+		/* IRR is already set, the target evaluates it on VMRUN */
+		return true;
+	default:
+		/*
+		 * Delivery modes AVIC cannot handle and targets outside the
+		 * cell take the regular path which enforces the cell
+		 * boundaries.
+		 */
+		return apic_handle_icr_write(vmcb->exitinfo1,
+					     (vmcb->exitinfo1 >> 32) >>
+					     XAPIC_DEST_SHIFT);
+	}
+}
+
 static void dump_guest_regs(union registers *guest_regs, struct vmcb *vmcb)
 {
 	panic_printk("RIP: 0x%016llx RSP: 0x%016llx FLAGS: %llx\n", vmcb->rip,
@@ -850,7 +1173,29 @@ void vcpu_vendor_get_io_intercept(struct vcpu_io_intercept *io)
 	io->size = (exitinfo >> 4) & 0x7;
 	io->in = !!(exitinfo & 0x1);
 	io->inst_len = vmcb->exitinfo2 - vmcb->rip;
-	io->rep_or_str = !!(exitinfo & 0x0c);
+	io->rep = !!(exitinfo & 0x8);
+	io->string = !!(exitinfo & 0x4);
+	if (!io->string)
+		return;
+
+	/* A16, A32 or A64 */
+	io->addr_size = (exitinfo >> 6) & 0xe;
+	/* INS always writes via ES, the OUTS segment is a decode assist */
+	if (io->in)
+		io->seg = VCPU_SEG_ES;
+	else if (has_assists)
+		io->seg = (exitinfo >> 10) & 0x7;
+	else
+		io->seg = -1;
+	/*
+	 * Without VMSAVE, the FS base in the VMCB is stale. The guest's value
+	 * is still loaded in the CPU as the hypervisor does not use FS. GS is
+	 * refreshed on every exit, see vcpu_handle_exit.
+	 */
+	if (io->seg == VCPU_SEG_FS)
+		io->seg_base = read_msr(MSR_FS_BASE);
+	else if (io->seg >= 0)
+		io->seg_base = (&vmcb->es)[io->seg].base;
 }
 
 void vcpu_vendor_get_mmio_intercept(struct vcpu_mmio_intercept *mmio)
@@ -878,20 +1223,35 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	write_msr(MSR_GS_BASE, (unsigned long)cpu_data);
 
 	cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
+	trace_event(JAILHOUSE_TRACE_VMEXIT, vmcb->exitcode, vmcb->rip);
 	/*
 	 * All guest state is marked unmodified; individual handlers must clear
 	 * the bits as needed.
 	 */
 	vmcb->clean_bits = 0xffffffff;
+	/* The TLB control is not reset by hardware, flush only on request. */
+	vmcb->tlb_control = SVM_TLB_FLUSH_NONE;
 
 	switch (vmcb->exitcode) {
 	case VMEXIT_INVALID:
 		panic_printk("FATAL: VM-Entry failure, error %lld\n",
 			     vmcb->exitcode);
 		break;
+	case VMEXIT_INTR:
+		/*
+		 * With AVIC, physical interrupts replace the EOI exits of the
+		 * non-AVIC mode. Let the host take and forward them.
+		 */
+		cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_XAPIC]++;
+		asm volatile("stgi; clgi" : : : "memory");
+		goto vmentry;
 	case VMEXIT_NMI:
 		cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_MANAGEMENT]++;
-		/* Temporarily enable GIF to consume pending NMI */
+		/*
+		 * Temporarily enable GIF to consume pending NMI. Performance
+		 * counter overflows are not forwarded to the cell, see
+		 * JAILHOUSE_CELL_PMU_PASSTHROUGH.
+		 */
 		asm volatile("stgi; clgi" : : : "memory");
 		x86_check_events();
 		goto vmentry;
@@ -920,7 +1280,8 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 		     vmcb->exitinfo2 < XAPIC_BASE + PAGE_SIZE) {
 			/* APIC access in non-AVIC mode */
 			cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_XAPIC]++;
-			if (svm_handle_apic_access(vmcb))
+			if (svm_handle_apic_access(vmcb->exitinfo2 - XAPIC_BASE,
+						   !!(vmcb->exitinfo1 & 0x2)))
 				goto vmentry;
 		} else {
 			/* General MMIO (IOAPIC, PCI etc) */
@@ -946,7 +1307,16 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 		}
 		x86_check_events();
 		goto vmentry;
-	/* TODO: Handle VMEXIT_AVIC_NOACCEL and VMEXIT_AVIC_INCOMPLETE_IPI */
+	case VMEXIT_AVIC_INCOMPLETE_IPI:
+		cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_XAPIC]++;
+		if (svm_handle_avic_incomplete_ipi(vmcb))
+			goto vmentry;
+		break;
+	case VMEXIT_AVIC_NOACCEL:
+		cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_XAPIC]++;
+		if (svm_handle_avic_noaccel(cpu_data))
+			goto vmentry;
+		break;
 	default:
 		panic_printk("FATAL: Unexpected #VMEXIT, exitcode %llx, "
 			     "exitinfo1 0x%016llx exitinfo2 0x%016llx\n",
@@ -956,6 +1326,12 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	panic_park();
 
 vmentry:
+	/* Exits start with all bits set, see above */
+	if (vmcb->clean_bits != 0xffffffff)
+		cpu_public->stats[JAILHOUSE_CPU_STAT_VMCB_RELOADS]++;
+	/* apic_clear may have disabled interrupts, see vcpu_activate_vmm */
+	if (cell_uses_avic(cpu_public->cell))
+		asm volatile("sti" : : : "memory");
 	write_msr(MSR_GS_BASE, vmcb->gs.base);
 }
 
@@ -968,11 +1344,9 @@ void vcpu_park(void)
 	}
 #endif
 	vcpu_vendor_reset(0);
-	/* No need to clear VMCB Clean bit: vcpu_vendor_reset() already does
-	 * this. */
+	this_cpu_data()->vmcb.guest_asid = SVM_PARKING_ASID;
 	this_cpu_data()->vmcb.n_cr3 = paging_hvirt2phys(parking_pt.root_table);
-
-	vcpu_tlb_flush();
+	this_cpu_data()->vmcb.clean_bits &= ~(CLEAN_BITS_ASID | CLEAN_BITS_NP);
 }
 
 void vcpu_nmi_handler(void)
@@ -995,7 +1369,8 @@ const u8 *vcpu_get_inst_bytes(const struct guest_paging_structures *pg_structs,
 	struct vmcb *vmcb = &this_cpu_data()->vmcb;
 	unsigned long start;
 
-	if (has_assists) {
+	/* Decode assists only provide the bytes on nested page faults */
+	if (has_assists && vmcb->exitcode == VMEXIT_NPF) {
 		if (!*size)
 			return NULL;
 		start = vmcb->rip - pc;
@@ -1015,6 +1390,33 @@ unsigned int vcpu_vendor_get_io_bitmap_pages(void)
 	return IOPM_PAGES;
 }
 
+unsigned int vcpu_vendor_get_msr_bitmap_pages(void)
+{
+	return MSRPM_PAGES;
+}
+
+void vcpu_vendor_set_msr_intercept(struct cell *cell, u32 msr,
+				   bool intercept)
+{
+	u8 (*bitmap)[0x2000/4] = (u8 (*)[0x2000/4])cell->arch.msr_bitmap;
+	unsigned int idx, offset = (msr & 0x1fff) / 4;
+	u8 mask = 0x03 << ((msr % 4) * 2); /* read and write */
+
+	if (msr <= 0x1fff)
+		idx = SVM_MSRPM_0000;
+	else if (msr - 0xc0000000 <= 0x1fff)
+		idx = SVM_MSRPM_C000;
+	else if (msr - 0xc0010000 <= 0x1fff)
+		idx = SVM_MSRPM_C001;
+	else
+		return;
+
+	if (intercept)
+		bitmap[idx][offset] |= mask;
+	else
+		bitmap[idx][offset] &= ~mask;
+}
+
 #define VCPU_VENDOR_GET_REGISTER(__reg__)	\
 u64 vcpu_vendor_get_##__reg__(void)		\
 {						\
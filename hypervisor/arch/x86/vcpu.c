@@ -23,6 +23,8 @@
 #include <asm/i8042.h>
 #include <asm/ioapic.h>
 #include <asm/pci.h>
+#include <asm/pio.h>
+#include <asm/pmu.h>
 #include <jailhouse/percpu.h>
 #include <asm/vcpu.h>
 
@@ -31,6 +33,26 @@
 	     (counter) < (config)->num_pio_regions;		\
 	     (pio)++, (counter)++)
 
+#define CPUID_7_MAX_INDEX	3
+
+#define PIO_DELAY_PORT		0x80
+
+/* String I/O is copied in chunks, up to a page per exit */
+#define PIO_STRING_CHUNK	256
+#define PIO_STRING_MAX_BYTES	PAGE_SIZE
+
+/*
+ * CPUID leaves that are precomputed per cell. Only leaves with the same
+ * content on all CPUs are included, apart from the APIC ID in leaf 1 which is
+ * filled in on access. Cache and PMU descriptions are left out as they can
+ * differ between the core types of hybrid CPUs.
+ */
+static const u32 cpuid_cached_leaves[] = {
+	0x00000000, 0x00000001, 0x00000003, 0x00000005, 0x00000007,
+	0x80000000, 0x80000001, 0x80000002, 0x80000003, 0x80000004,
+	0x80000007, 0x80000008,
+};
+
 static u8 __attribute__((aligned(PAGE_SIZE))) parking_code[PAGE_SIZE] = {
 	0xfa, /* 1: cli */
 	0xf4, /*    hlt */
@@ -92,41 +114,154 @@ static void pio_allow_access(u8 *bm, const struct jailhouse_pio *pio,
 		access_method(start_bit, (unsigned long*)bm);
 }
 
+/* Byte accesses to port 0x80, often used for delaying IO, are ignored. */
+static int pio_delay_handler(void *arg, struct pio_access *pio)
+{
+	if (pio->size != 1)
+		return 0;
+	if (pio->in)
+		pio->value = 0xff;
+	return 1;
+}
+
+static int pio_register_handlers(struct cell *cell, bool i8042_allowed)
+{
+	int err;
+
+	memset(&cell->arch.pio, 0, sizeof(cell->arch.pio));
+
+	err = pio_region_register(cell, PCI_REG_ADDR_PORT, 8,
+				  x86_pci_config_handler, NULL);
+	if (err)
+		return err;
+
+	err = pio_region_register(cell, PIO_DELAY_PORT, 1, pio_delay_handler,
+				  NULL);
+	if (err)
+		return err;
+
+	/* moderate i8042 only if the config allows it */
+	if (i8042_allowed)
+		err = pio_region_register(cell, I8042_CMD_REG, 1,
+					  i8042_access_handler, NULL);
+	return err;
+}
+
+static void cpuid_mask_features(struct cell *cell, u32 function, u32 *ecx)
+{
+	if (cell == &root_cell)
+		return;
+
+	if (function == 0x01) {
+		*ecx &= ~X86_FEATURE_VMX;
+		*ecx |= X86_FEATURE_HYPERVISOR;
+	} else if (function == 0x80000001) {
+		*ecx &= ~X86_FEATURE_SVM;
+	}
+}
+
+static void cpuid_cache_add(struct cell *cell, u32 function, u32 index,
+			    bool indexed)
+{
+	struct cpuid_entry *entry;
+
+	if (cell->arch.num_cpuid_entries >= ARRAY_SIZE(cell->arch.cpuid))
+		return;
+
+	entry = &cell->arch.cpuid[cell->arch.num_cpuid_entries++];
+	entry->function = function;
+	entry->index = index;
+	entry->indexed = indexed;
+	entry->eax = function;
+	entry->ecx = index;
+	cpuid(&entry->eax, &entry->ebx, &entry->ecx, &entry->edx);
+	cpuid_mask_features(cell, function, &entry->ecx);
+}
+
+static void cpuid_cache_init(struct cell *cell)
+{
+	u32 max_basic = cpuid_eax(0, 0);
+	u32 max_extended = cpuid_eax(0x80000000, 0);
+	u32 function, index, max_index;
+	unsigned int n;
+
+	cell->arch.num_cpuid_entries = 0;
+
+	for (n = 0; n < ARRAY_SIZE(cpuid_cached_leaves); n++) {
+		function = cpuid_cached_leaves[n];
+		if (function > ((function & 0x80000000) ? max_extended :
+							    max_basic))
+			continue;
+
+		if (function == 0x07) {
+			max_index = MIN(cpuid_eax(0x07, 0), CPUID_7_MAX_INDEX);
+			for (index = 0; index <= max_index; index++)
+				cpuid_cache_add(cell, function, index, true);
+		} else {
+			cpuid_cache_add(cell, function, 0, false);
+		}
+	}
+}
+
+static const struct cpuid_entry *
+cpuid_cache_lookup(struct cell *cell, u32 function, u32 index)
+{
+	const struct cpuid_entry *entry = cell->arch.cpuid;
+	unsigned int n;
+
+	for (n = 0; n < cell->arch.num_cpuid_entries; n++, entry++)
+		if (entry->function == function &&
+		    (!entry->indexed || entry->index == index))
+			return entry;
+	return NULL;
+}
+
 int vcpu_cell_init(struct cell *cell)
 {
 	const unsigned int io_bitmap_pages = vcpu_vendor_get_io_bitmap_pages();
+	const unsigned int msr_bitmap_pages =
+		vcpu_vendor_get_msr_bitmap_pages();
 	const struct jailhouse_pio *pio;
 	unsigned int n, pm_timer_addr;
-	int err;
+	bool i8042_allowed = false;
+	int err = -ENOMEM;
 
 	cell->arch.io_bitmap = page_alloc(&mem_pool, io_bitmap_pages);
 	if (!cell->arch.io_bitmap)
-		return -ENOMEM;
+		return err;
+
+	cell->arch.msr_bitmap = page_alloc(&mem_pool, msr_bitmap_pages);
+	if (!cell->arch.msr_bitmap)
+		goto err_free_io_bitmap;
 
 	err = vcpu_vendor_cell_init(cell);
-	if (err) {
-		page_free(&mem_pool, cell->arch.io_bitmap, io_bitmap_pages);
-		return err;
-	}
+	if (err)
+		goto err_free_msr_bitmap;
+
+	cpuid_cache_init(cell);
+	err = pmu_cell_init(cell);
+	if (err)
+		goto err_vendor_exit;
 
 	/* initialize io bitmap to trap all accesses */
 	memset(cell->arch.io_bitmap, -1, io_bitmap_pages * PAGE_SIZE);
 
 	/* cells have no access to i8042, unless the port is whitelisted */
-	cell->arch.pio_i8042_allowed = false;
-
 	for_each_pio_region(pio, cell->config, n) {
 		pio_allow_access(cell->arch.io_bitmap, pio, true);
 
-		/* moderate i8042 only if the config allows it */
 		if (pio->base <= I8042_CMD_REG &&
 		    pio->base + pio->length > I8042_CMD_REG)
-			cell->arch.pio_i8042_allowed = true;
+			i8042_allowed = true;
 	}
 
 	/* but always intercept access to i8042 command register */
 	cell->arch.io_bitmap[I8042_CMD_REG / 8] |= 1 << (I8042_CMD_REG % 8);
 
+	err = pio_register_handlers(cell, i8042_allowed);
+	if (err)
+		goto err_vendor_exit;
+
 	if (cell != &root_cell) {
 		/*
 		 * Shrink PIO access of root cell corresponding to new cell's
@@ -144,6 +279,14 @@ int vcpu_cell_init(struct cell *cell)
 				~(1 << (pm_timer_addr % 8));
 
 	return 0;
+
+err_vendor_exit:
+	vcpu_vendor_cell_exit(cell);
+err_free_msr_bitmap:
+	page_free(&mem_pool, cell->arch.msr_bitmap, msr_bitmap_pages);
+err_free_io_bitmap:
+	page_free(&mem_pool, cell->arch.io_bitmap, io_bitmap_pages);
+	return err;
 }
 
 void vcpu_cell_exit(struct cell *cell)
@@ -170,6 +313,8 @@ void vcpu_cell_exit(struct cell *cell)
 
 	page_free(&mem_pool, cell->arch.io_bitmap,
 		  vcpu_vendor_get_io_bitmap_pages());
+	page_free(&mem_pool, cell->arch.msr_bitmap,
+		  vcpu_vendor_get_msr_bitmap_pages());
 
 	vcpu_vendor_cell_exit(cell);
 }
@@ -220,32 +365,177 @@ void vcpu_handle_hypercall(void)
 	}
 }
 
+/*
+ * Writes to the lower 32 bits of a register clear the upper half, narrower
+ * writes leave the rest of the register intact.
+ */
+static void set_guest_reg(unsigned long *reg, unsigned long value,
+			  unsigned int size)
+{
+	u64 mask = (size == 4 ? BYTE_MASK(8) : BYTE_MASK(size));
+
+	*reg = (*reg & ~mask) | (value & mask);
+}
+
+static void report_invalid_pio(const struct vcpu_io_intercept *io)
+{
+	panic_printk("FATAL: Invalid PIO %s, port: %x size: %d\n",
+		     io->in ? "read" : "write", io->port, io->size);
+}
+
+static u8 *map_string_operand(const struct guest_paging_structures *pg_structs,
+			      unsigned long start, unsigned long end,
+			      unsigned long flags)
+{
+	unsigned int pages =
+		((end - 1) >> PAGE_SHIFT) - (start >> PAGE_SHIFT) + 1;
+	u8 *page;
+
+	page = paging_get_guest_pages(pg_structs, start, pages, flags);
+	return page ? page + (start & PAGE_OFFS_MASK) : NULL;
+}
+
+/*
+ * Emulates INS and OUTS, optionally REP-prefixed. The memory operand is
+ * copied via a local buffer as the port handlers may reuse the temporary
+ * mappings. Longer REP sequences are split over multiple exits by leaving
+ * the instruction pointer unchanged until the count register reached zero.
+ */
+static bool vcpu_handle_string_io(const struct vcpu_io_intercept *io)
+{
+	union registers *guest_regs = &this_cpu_data()->guest_regs;
+	unsigned long *index_reg = io->in ? &guest_regs->rdi : &guest_regs->rsi;
+	const unsigned long addr_mask = BYTE_MASK(io->addr_size);
+	const unsigned long flags =
+		io->in ? PAGE_DEFAULT_FLAGS : PAGE_READONLY_FLAGS;
+	unsigned long count, todo, done, index, seg_base, start, end;
+	struct guest_paging_structures pg_structs;
+	unsigned int chunk, offs, n;
+	struct pio_access pio;
+	u8 buf[PIO_STRING_CHUNK];
+	int result = 1;
+	bool down;
+	u8 *mem;
+
+	if (io->seg < 0) {
+		panic_printk("FATAL: Unsupported string PIO, port: %x\n",
+			     io->port);
+		return false;
+	}
+
+	/* In 64-bit mode, only FS and GS provide a segment base. */
+	seg_base = io->seg_base;
+	if ((vcpu_vendor_get_efer() & EFER_LMA) &&
+	    (vcpu_vendor_get_cs_attr() & VCPU_CS_L) &&
+	    io->seg != VCPU_SEG_FS && io->seg != VCPU_SEG_GS)
+		seg_base = 0;
+
+	count = io->rep ? guest_regs->rcx & addr_mask : 1;
+	todo = MIN(count, PIO_STRING_MAX_BYTES / io->size);
+	down = !!(vcpu_vendor_get_rflags() & X86_RFLAGS_DF);
+	index = *index_reg & addr_mask;
+
+	vcpu_get_guest_paging_structs(&pg_structs);
+
+	pio.port = io->port;
+	pio.size = io->size;
+	pio.in = io->in;
+
+	for (done = 0; done < todo && result == 1; done += n) {
+		chunk = MIN(todo - done, PIO_STRING_CHUNK / io->size);
+		/* do not wrap around within a chunk */
+		if (down)
+			chunk = MIN(chunk, index / io->size + 1);
+		else
+			chunk = MIN(chunk, (addr_mask - index) / io->size + 1);
+
+		start = seg_base + index;
+		if (down)
+			start -= (chunk - 1) * io->size;
+		end = start + chunk * io->size;
+
+		/* also validates the target of INS before touching the port */
+		mem = map_string_operand(&pg_structs, start, end, flags);
+		if (!mem)
+			goto invalid_operand;
+		if (!io->in)
+			memcpy(buf, mem, chunk * io->size);
+
+		for (n = 0; n < chunk; n++) {
+			offs = (down ? chunk - 1 - n : n) * io->size;
+			pio.value = 0;
+			if (!io->in)
+				memcpy(&pio.value, &buf[offs], io->size);
+			result = pio_handle_access(&pio);
+			if (result != 1)
+				break;
+			if (io->in)
+				memcpy(&buf[offs], &pio.value, io->size);
+		}
+
+		if (io->in && n > 0) {
+			mem = map_string_operand(&pg_structs, start, end,
+						 flags);
+			if (!mem)
+				goto invalid_operand;
+			offs = down ? (chunk - n) * io->size : 0;
+			memcpy(mem + offs, &buf[offs], n * io->size);
+		}
+
+		if (down)
+			index = (index - n * io->size) & addr_mask;
+		else
+			index = (index + n * io->size) & addr_mask;
+	}
+
+	set_guest_reg(index_reg, index, io->addr_size);
+	if (io->rep)
+		set_guest_reg(&guest_regs->rcx, count - done, io->addr_size);
+
+	if (result == 1) {
+		if (done == count)
+			vcpu_skip_emulated_instruction(io->inst_len);
+		return true;
+	}
+
+	/* report only unhandled access failures */
+	if (result == 0)
+		report_invalid_pio(io);
+	return false;
+
+invalid_operand:
+	panic_printk("FATAL: Invalid PIO string operand at %lx\n", start);
+	return false;
+}
+
 bool vcpu_handle_io_access(void)
 {
+	union registers *guest_regs = &this_cpu_data()->guest_regs;
 	struct vcpu_io_intercept io;
-	int result = 0;
+	struct pio_access pio;
+	int result;
 
 	vcpu_vendor_get_io_intercept(&io);
 
-	/* string and REP-prefixed instructions are not supported */
-	if (io.rep_or_str)
-		goto invalid_access;
+	if (io.string)
+		return vcpu_handle_string_io(&io);
 
-	result = x86_pci_config_handler(io.port, io.in, io.size);
-	if (result == 0)
-		result = i8042_access_handler(io.port, io.in, io.size);
+	pio.port = io.port;
+	pio.size = io.size;
+	pio.in = io.in;
+	pio.value = io.in ? 0 : guest_regs->rax & BYTE_MASK(io.size);
 
-	/* Also ignore byte access to port 80, often used for delaying IO. */
-	if (result == 1 || (io.port == 0x80 && io.size == 1)) {
+	result = pio_handle_access(&pio);
+	if (result == 1) {
+		if (io.in)
+			set_guest_reg(&guest_regs->rax, pio.value, io.size);
 		vcpu_skip_emulated_instruction(io.inst_len);
 		return true;
 	}
 
-invalid_access:
 	/* report only unhandled access failures */
 	if (result == 0)
-		panic_printk("FATAL: Invalid PIO %s, port: %x size: %d\n",
-			     io.in ? "read" : "write", io.port, io.size);
+		report_invalid_pio(&io);
 	return false;
 }
 
@@ -294,6 +584,22 @@ invalid_access:
 	return false;
 }
 
+/*
+ * Intercepted performance monitoring MSRs read as zero and ignore writes.
+ * This affects non-root cells without JAILHOUSE_CELL_PMU_PASSTHROUGH and the
+ * MSRs registered with PMU_MSR_ROOT_INTERCEPT in the root cell.
+ */
+static bool vcpu_handle_pmu_msr(struct per_cpu *cpu_data, bool is_write)
+{
+	if (!pmu_is_msr(cpu_data->guest_regs.rcx))
+		return false;
+
+	cpu_data->public.stats[JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER]++;
+	if (!is_write)
+		set_rdmsr_value(&cpu_data->guest_regs, 0);
+	return true;
+}
+
 bool vcpu_handle_msr_read(void)
 {
 	struct per_cpu *cpu_data = this_cpu_data();
@@ -312,6 +618,8 @@ bool vcpu_handle_msr_read(void)
 				cpu_data->mtrr_def_type);
 		break;
 	default:
+		if (vcpu_handle_pmu_msr(cpu_data, false))
+			break;
 		panic_printk("FATAL: Unhandled MSR read: %lx\n",
 			     cpu_data->guest_regs.rcx);
 		return false;
@@ -362,6 +670,8 @@ bool vcpu_handle_msr_write(void)
 					  cpu_data->pat : 0);
 		break;
 	default:
+		if (vcpu_handle_pmu_msr(cpu_data, true))
+			break;
 		panic_printk("FATAL: Unhandled MSR write: %lx\n",
 			     cpu_data->guest_regs.rcx);
 		return false;
@@ -375,7 +685,9 @@ void vcpu_handle_cpuid(void)
 {
 	static const char signature[12] = "Jailhouse";
 	union registers *guest_regs = &this_cpu_data()->guest_regs;
+	const struct cpuid_entry *entry;
 	u32 function = guest_regs->rax;
+	struct cell *cell = this_cell();
 
 	this_cpu_data()->public.stats[JAILHOUSE_CPU_STAT_VMEXITS_CPUID]++;
 
@@ -393,26 +705,34 @@ void vcpu_handle_cpuid(void)
 		guest_regs->rdx = 0;
 		break;
 	default:
-		/* clear upper 32 bits of the involved registers */
-		guest_regs->rax &= 0xffffffff;
-		guest_regs->rbx &= 0xffffffff;
-		guest_regs->rcx &= 0xffffffff;
-		guest_regs->rdx &= 0xffffffff;
-
-		cpuid((u32 *)&guest_regs->rax, (u32 *)&guest_regs->rbx,
-		      (u32 *)&guest_regs->rcx, (u32 *)&guest_regs->rdx);
+		entry = cpuid_cache_lookup(cell, function, guest_regs->rcx);
+		if (entry) {
+			guest_regs->rax = entry->eax;
+			guest_regs->rbx = entry->ebx;
+			guest_regs->rcx = entry->ecx;
+			guest_regs->rdx = entry->edx;
+		} else {
+			/* clear upper 32 bits of the involved registers */
+			guest_regs->rax &= 0xffffffff;
+			guest_regs->rbx &= 0xffffffff;
+			guest_regs->rcx &= 0xffffffff;
+			guest_regs->rdx &= 0xffffffff;
+
+			cpuid((u32 *)&guest_regs->rax, (u32 *)&guest_regs->rbx,
+			      (u32 *)&guest_regs->rcx, (u32 *)&guest_regs->rdx);
+			cpuid_mask_features(cell, function,
+					    (u32 *)&guest_regs->rcx);
+		}
+
 		if (function == 0x01) {
-			if (this_cell() != &root_cell) {
-				guest_regs->rcx &= ~X86_FEATURE_VMX;
-				guest_regs->rcx |= X86_FEATURE_HYPERVISOR;
-			}
+			/* initial APIC ID of the calling CPU */
+			guest_regs->rbx &= 0x00ffffff;
+			guest_regs->rbx |=
+				(this_cpu_public()->apic_id & 0xff) << 24;
 
 			guest_regs->rcx &= ~X86_FEATURE_OSXSAVE;
 			if (vcpu_vendor_get_guest_cr4() & X86_CR4_OSXSAVE)
 				guest_regs->rcx |= X86_FEATURE_OSXSAVE;
-		} else if (function == 0x80000001) {
-			if (this_cell() != &root_cell)
-				guest_regs->rcx &= ~X86_FEATURE_SVM;
 		}
 		break;
 	}
@@ -19,9 +19,11 @@
 #include <jailhouse/string.h>
 #include <jailhouse/control.h>
 #include <jailhouse/hypercall.h>
+#include <jailhouse/trace.h>
 #include <asm/apic.h>
 #include <asm/control.h>
 #include <asm/iommu.h>
+#include <asm/pmu.h>
 #include <asm/vcpu.h>
 #include <asm/vmx.h>
 
@@ -29,12 +31,16 @@
 #define CR4_IDX			1
 
 #define PIO_BITMAP_PAGES	2
+#define MSR_BITMAP_PAGES	1
 
 static const struct segment invalid_seg = {
 	.access_rights = 0x10000
 };
 
-/* bit cleared: direct access allowed */
+/*
+ * bit cleared: direct access allowed
+ * Template for the per-cell bitmaps, PMU MSRs are set up by pmu_cell_init.
+ */
 // TODO: convert to whitelist
 static u8 __attribute__((aligned(PAGE_SIZE))) msr_bitmap[][0x2000/8] = {
 	[ VMX_MSR_BMP_0000_READ ] = {
@@ -63,9 +69,7 @@ static u8 __attribute__((aligned(PAGE_SIZE))) msr_bitmap[][0x2000/8] = {
 		[  0x200/8 ...  0x277/8 ] = 0xff, /* 0x200 - 0x277 */
 		[  0x278/8 ...  0x2f7/8 ] = 0,
 		[  0x2f8/8 ...  0x2ff/8 ] = 0x80, /* 0x2ff */
-		[  0x300/8 ...  0x387/8 ] = 0,
-		[  0x388/8 ...  0x38f/8 ] = 0x80, /* 0x38f */
-		[  0x390/8 ...  0x7ff/8 ] = 0,
+		[  0x300/8 ...  0x7ff/8 ] = 0,
 		[  0x808/8 ...  0x80f/8 ] = 0x89, /* 0x808, 0x80b, 0x80f */
 		[  0x810/8 ...  0x827/8 ] = 0,
 		[  0x828/8 ...  0x82f/8 ] = 0x81, /* 0x828, 0x82f */
@@ -84,6 +88,7 @@ static u8 __attribute__((aligned(PAGE_SIZE))) apic_access_page[PAGE_SIZE];
 static struct paging ept_paging[EPT_PAGE_DIR_LEVELS];
 static u32 secondary_exec_addon;
 static unsigned long cr_maybe1[2], cr_required1[2];
+static bool has_ins_outs_info;
 
 static bool vmxon(void)
 {
@@ -130,28 +135,77 @@ static bool vmcs_load(void)
 	return ok;
 }
 
-static inline unsigned long vmcs_read64(unsigned long field)
-{
-	unsigned long value;
-
-	asm volatile("vmread %1,%0" : "=r" (value) : "r" (field) : "cc");
-	return value;
-}
+static const unsigned long vmcs_cache_fields[NUM_VMCS_CACHE_SLOTS] = {
+	[VMCS_CACHE_EXIT_REASON]		= VM_EXIT_REASON,
+	[VMCS_CACHE_EXIT_QUALIFICATION]		= EXIT_QUALIFICATION,
+	[VMCS_CACHE_EXIT_INSTRUCTION_LEN]	= VM_EXIT_INSTRUCTION_LEN,
+	[VMCS_CACHE_EXIT_INTR_INFO]		= VM_EXIT_INTR_INFO,
+	[VMCS_CACHE_GUEST_PHYSICAL_ADDRESS]	= GUEST_PHYSICAL_ADDRESS,
+	[VMCS_CACHE_GUEST_RIP]			= GUEST_RIP,
+	[VMCS_CACHE_GUEST_RSP]			= GUEST_RSP,
+	[VMCS_CACHE_GUEST_RFLAGS]		= GUEST_RFLAGS,
+	[VMCS_CACHE_GUEST_CS_AR_BYTES]		= GUEST_CS_AR_BYTES,
+	[VMCS_CACHE_GUEST_IA32_EFER]		= GUEST_IA32_EFER,
+	[VMCS_CACHE_GUEST_CR0]			= GUEST_CR0,
+	[VMCS_CACHE_GUEST_CR3]			= GUEST_CR3,
+	[VMCS_CACHE_GUEST_CR4]			= GUEST_CR4,
+	[VMCS_CACHE_CR0_READ_SHADOW]		= CR0_READ_SHADOW,
+	[VMCS_CACHE_CR4_READ_SHADOW]		= CR4_READ_SHADOW,
+};
 
-static inline u16 vmcs_read16(unsigned long field)
+/* Folds to a constant for constant fields, keep in sync with the table. */
+static inline int vmcs_cache_slot(unsigned long field)
 {
-	return vmcs_read64(field);
+	switch (field) {
+	case VM_EXIT_REASON:
+		return VMCS_CACHE_EXIT_REASON;
+	case EXIT_QUALIFICATION:
+		return VMCS_CACHE_EXIT_QUALIFICATION;
+	case VM_EXIT_INSTRUCTION_LEN:
+		return VMCS_CACHE_EXIT_INSTRUCTION_LEN;
+	case VM_EXIT_INTR_INFO:
+		return VMCS_CACHE_EXIT_INTR_INFO;
+	case GUEST_PHYSICAL_ADDRESS:
+		return VMCS_CACHE_GUEST_PHYSICAL_ADDRESS;
+	case GUEST_RIP:
+		return VMCS_CACHE_GUEST_RIP;
+	case GUEST_RSP:
+		return VMCS_CACHE_GUEST_RSP;
+	case GUEST_RFLAGS:
+		return VMCS_CACHE_GUEST_RFLAGS;
+	case GUEST_CS_AR_BYTES:
+		return VMCS_CACHE_GUEST_CS_AR_BYTES;
+	case GUEST_IA32_EFER:
+		return VMCS_CACHE_GUEST_IA32_EFER;
+	case GUEST_CR0:
+		return VMCS_CACHE_GUEST_CR0;
+	case GUEST_CR3:
+		return VMCS_CACHE_GUEST_CR3;
+	case GUEST_CR4:
+		return VMCS_CACHE_GUEST_CR4;
+	case CR0_READ_SHADOW:
+		return VMCS_CACHE_CR0_READ_SHADOW;
+	case CR4_READ_SHADOW:
+		return VMCS_CACHE_CR4_READ_SHADOW;
+	default:
+		return -1;
+	}
 }
 
-static inline u32 vmcs_read32(unsigned long field)
+static inline unsigned long vmread(unsigned long field)
 {
-	return vmcs_read64(field);
+	unsigned long value;
+
+	this_cpu_public()->stats[JAILHOUSE_CPU_STAT_VMCS_READS]++;
+	asm volatile("vmread %1,%0" : "=r" (value) : "r" (field) : "cc");
+	return value;
 }
 
-static bool vmcs_write64(unsigned long field, unsigned long val)
+static bool vmwrite(unsigned long field, unsigned long val)
 {
 	u8 ok;
 
+	this_cpu_public()->stats[JAILHOUSE_CPU_STAT_VMCS_WRITES]++;
 	asm volatile(
 		"vmwrite %1,%2\n\t"
 		"setnz %0"
@@ -160,11 +214,72 @@ static bool vmcs_write64(unsigned long field, unsigned long val)
 		: "cc");
 	if (!ok)
 		printk("FATAL: vmwrite %08lx failed, error %d, caller %p\n",
-		       field, vmcs_read32(VM_INSTRUCTION_ERROR),
+		       field, (u32)vmread(VM_INSTRUCTION_ERROR),
 		       __builtin_return_address(0));
 	return ok;
 }
 
+static inline unsigned long vmcs_read64(unsigned long field)
+{
+	struct vmcs_cache *cache = &this_cpu_data()->vmcs_cache;
+	int slot = vmcs_cache_slot(field);
+
+	if (slot < 0 || !cache->active)
+		return vmread(field);
+
+	if (!(cache->valid & (1 << slot))) {
+		cache->value[slot] = vmread(field);
+		cache->valid |= 1 << slot;
+	}
+	return cache->value[slot];
+}
+
+static inline u16 vmcs_read16(unsigned long field)
+{
+	return vmcs_read64(field);
+}
+
+static inline u32 vmcs_read32(unsigned long field)
+{
+	return vmcs_read64(field);
+}
+
+static inline bool vmcs_write64(unsigned long field, unsigned long val)
+{
+	struct vmcs_cache *cache = &this_cpu_data()->vmcs_cache;
+	int slot = vmcs_cache_slot(field);
+
+	if (slot < 0 || !cache->active)
+		return vmwrite(field, val);
+
+	cache->value[slot] = val;
+	cache->valid |= 1 << slot;
+	cache->dirty |= 1 << slot;
+	return true;
+}
+
+/* Start caching, all field values are fresh after a VM exit. */
+static void vmcs_cache_begin(void)
+{
+	struct vmcs_cache *cache = &this_cpu_data()->vmcs_cache;
+
+	cache->valid = 0;
+	cache->dirty = 0;
+	cache->active = true;
+}
+
+/* Write back modified fields and stop caching before VM entry. */
+static void vmcs_cache_end(void)
+{
+	struct vmcs_cache *cache = &this_cpu_data()->vmcs_cache;
+	unsigned int slot;
+
+	cache->active = false;
+	for (slot = 0; slot < NUM_VMCS_CACHE_SLOTS; slot++)
+		if (cache->dirty & (1 << slot))
+			vmwrite(vmcs_cache_fields[slot], cache->value[slot]);
+}
+
 static bool vmcs_write16(unsigned long field, u16 value)
 {
 	return vmcs_write64(field, value);
@@ -208,6 +323,10 @@ static int vmx_check_features(void)
 	    !(vmx_basic & (1UL << 55)))
 		return trace_error(-EIO);
 
+	/* string I/O emulation needs the instruction information */
+	if (vmx_basic & (1UL << 54))
+		has_ins_outs_info = true;
+
 	/* require NMI exiting and preemption timer support */
 	vmx_pin_ctrl = read_msr(MSR_IA32_VMX_PINBASED_CTLS) >> 32;
 	if (!(vmx_pin_ctrl & PIN_BASED_NMI_EXITING) ||
@@ -297,6 +416,35 @@ static void ept_set_next_pt(pt_entry_t pte, unsigned long next_pt)
 		EPT_FLAG_EXECUTE;
 }
 
+static void vmx_pmu_init(void)
+{
+	u32 eax = cpuid_eax(0x0a, 0);
+	unsigned int version = eax & 0xff;
+	unsigned int counters = (eax >> 8) & 0xff;
+	unsigned int fixed_counters = cpuid_edx(0x0a, 0) & 0x1f;
+
+	if (version == 0)
+		return;
+
+	if (version >= 2) {
+		/*
+		 * The root cell keeps running with all counters globally
+		 * disabled, see vcpu_init. Its writes are ignored.
+		 */
+		pmu_register_msrs(MSR_IA32_PERF_GLOBAL_CTRL, 1,
+				  PMU_MSR_STATE | PMU_MSR_ROOT_INTERCEPT);
+		pmu_register_msrs(MSR_IA32_FIXED_CTR_CTRL, 1, PMU_MSR_STATE);
+		pmu_register_msrs(MSR_IA32_PERF_GLOBAL_STATUS, 1, 0);
+		pmu_register_msrs(MSR_IA32_PERF_GLOBAL_OVF_CTRL, 1, 0);
+		pmu_register_msrs(MSR_IA32_FIXED_CTR0, fixed_counters,
+				  PMU_MSR_STATE);
+	}
+	pmu_register_msrs(MSR_IA32_PERFEVTSEL0, counters, PMU_MSR_STATE);
+	pmu_register_msrs(MSR_IA32_PMC0, counters, PMU_MSR_STATE);
+	/* full-width aliases of the general-purpose counters */
+	pmu_register_msrs(MSR_IA32_A_PMC0, counters, 0);
+}
+
 int vcpu_vendor_early_init(void)
 {
 	unsigned int n;
@@ -306,6 +454,8 @@ int vcpu_vendor_early_init(void)
 	if (err)
 		return err;
 
+	vmx_pmu_init();
+
 	/* derive ept_paging from very similar x86_64_paging */
 	memcpy(ept_paging, x86_64_paging, sizeof(ept_paging));
 	for (n = 0; n < EPT_PAGE_DIR_LEVELS; n++)
@@ -337,6 +487,8 @@ unsigned long arch_paging_gphys2phys(unsigned long gphys, unsigned long flags)
 
 int vcpu_vendor_cell_init(struct cell *cell)
 {
+	memcpy(cell->arch.msr_bitmap, msr_bitmap, sizeof(msr_bitmap));
+
 	/* build root EPT of cell */
 	cell->arch.vmx.ept_structs.root_paging = ept_paging;
 	cell->arch.vmx.ept_structs.root_table =
@@ -386,6 +538,10 @@ void vcpu_vendor_cell_exit(struct cell *cell)
 		       PAGING_NON_COHERENT);
 }
 
+void vcpu_config_commit(struct cell *cell_added_removed)
+{
+}
+
 void vcpu_tlb_flush(void)
 {
 	unsigned long ept_cap = read_msr(MSR_IA32_VMX_EPT_VPID_CAP);
@@ -452,6 +608,8 @@ static bool vmx_set_cell_config(void)
 	ok &= vmcs_write64(IO_BITMAP_A, paging_hvirt2phys(io_bitmap));
 	ok &= vmcs_write64(IO_BITMAP_B,
 			   paging_hvirt2phys(io_bitmap + PAGE_SIZE));
+	ok &= vmcs_write64(MSR_BITMAP,
+			   paging_hvirt2phys(cell->arch.msr_bitmap));
 
 	ok &= vmcs_write64(EPT_POINTER,
 		paging_hvirt2phys(cell->arch.vmx.ept_structs.root_table) |
@@ -570,8 +728,6 @@ static bool vmcs_setup(void)
 	val &= ~(CPU_BASED_CR3_LOAD_EXITING | CPU_BASED_CR3_STORE_EXITING);
 	ok &= vmcs_write32(CPU_BASED_VM_EXEC_CONTROL, val);
 
-	ok &= vmcs_write64(MSR_BITMAP, paging_hvirt2phys(msr_bitmap));
-
 	val = read_msr(MSR_IA32_VMX_PROCBASED_CTLS2);
 	val |= SECONDARY_EXEC_VIRTUALIZE_APIC_ACCESSES |
 		SECONDARY_EXEC_ENABLE_EPT | SECONDARY_EXEC_UNRESTRICTED_GUEST |
@@ -927,6 +1083,11 @@ static void vmx_handle_exception_nmi(void)
 	u32 intr_info = vmcs_read32(VM_EXIT_INTR_INFO);
 
 	if ((intr_info & INTR_INFO_INTR_TYPE_MASK) == INTR_TYPE_NMI_INTR) {
+		/*
+		 * NMIs are management events. Performance counter overflow
+		 * NMIs of cells with PMU access are swallowed as well, see
+		 * JAILHOUSE_CELL_PMU_PASSTHROUGH.
+		 */
 		cpu_public->stats[JAILHOUSE_CPU_STAT_VMEXITS_MANAGEMENT]++;
 		asm volatile("int %0" : : "i" (NMI_VECTOR));
 	} else {
@@ -1127,13 +1288,28 @@ static void dump_guest_regs(union registers *guest_regs)
 void vcpu_vendor_get_io_intercept(struct vcpu_io_intercept *io)
 {
 	u64 exitq = vmcs_read64(EXIT_QUALIFICATION);
+	u32 info;
 
 	/* parse exit qualification for I/O instructions (see SDM, 27.2.1 ) */
 	io->port = (exitq >> 16) & 0xFFFF;
 	io->size = (exitq & 0x3) + 1;
 	io->in = !!((exitq & 0x8) >> 3);
 	io->inst_len = vmcs_read64(VM_EXIT_INSTRUCTION_LEN);
-	io->rep_or_str = !!(exitq & 0x30);
+	io->rep = !!(exitq & 0x20);
+	io->string = !!(exitq & 0x10);
+	if (!io->string)
+		return;
+
+	if (!has_ins_outs_info) {
+		io->seg = -1;
+		return;
+	}
+
+	/* instruction information for INS/OUTS (see SDM, 27.2.5) */
+	info = vmcs_read32(VMX_INSTRUCTION_INFO);
+	io->addr_size = 2 << ((info >> 7) & 0x7);
+	io->seg = io->in ? VCPU_SEG_ES : (info >> 15) & 0x7;
+	io->seg_base = vmcs_read64(GUEST_ES_BASE + io->seg * 2);
 }
 
 void vcpu_vendor_get_mmio_intercept(struct vcpu_mmio_intercept *mmio)
@@ -1146,12 +1322,13 @@ void vcpu_vendor_get_mmio_intercept(struct vcpu_mmio_intercept *mmio)
 	mmio->is_write = !!(exitq & 0x2);
 }
 
-void vcpu_handle_exit(struct per_cpu *cpu_data)
+static void vmx_handle_exit(struct per_cpu *cpu_data)
 {
 	u32 reason = vmcs_read32(VM_EXIT_REASON);
 	u32 *stats = cpu_data->public.stats;
 
 	stats[JAILHOUSE_CPU_STAT_VMEXITS_TOTAL]++;
+	trace_event(JAILHOUSE_TRACE_VMEXIT, reason, vmcs_read64(GUEST_RIP));
 
 	switch (reason) {
 	case EXIT_REASON_EXCEPTION_NMI:
@@ -1177,12 +1354,7 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 			return;
 		break;
 	case EXIT_REASON_MSR_WRITE:
-		if (cpu_data->guest_regs.rcx == MSR_IA32_PERF_GLOBAL_CTRL) {
-			/* ignore writes */
-			stats[JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER]++;
-			vcpu_skip_emulated_instruction(X86_INST_LEN_WRMSR);
-			return;
-		} else if (vcpu_handle_msr_write())
+		if (vcpu_handle_msr_write())
 			return;
 		break;
 	case EXIT_REASON_APIC_ACCESS:
@@ -1217,6 +1389,13 @@ void vcpu_handle_exit(struct per_cpu *cpu_data)
 	panic_park();
 }
 
+void vcpu_handle_exit(struct per_cpu *cpu_data)
+{
+	vmcs_cache_begin();
+	vmx_handle_exit(cpu_data);
+	vmcs_cache_end();
+}
+
 void vmx_entry_failure(void)
 {
 	panic_printk("FATAL: vmresume failed, error %d\n",
@@ -1229,6 +1408,37 @@ unsigned int vcpu_vendor_get_io_bitmap_pages(void)
 	return PIO_BITMAP_PAGES;
 }
 
+unsigned int vcpu_vendor_get_msr_bitmap_pages(void)
+{
+	return MSR_BITMAP_PAGES;
+}
+
+void vcpu_vendor_set_msr_intercept(struct cell *cell, u32 msr,
+				   bool intercept)
+{
+	u8 (*bitmap)[0x2000/8] = (u8 (*)[0x2000/8])cell->arch.msr_bitmap;
+	unsigned int read_idx, write_idx, offset = (msr & 0x1fff) / 8;
+	u8 mask = 1 << (msr % 8);
+
+	if (msr <= 0x1fff) {
+		read_idx = VMX_MSR_BMP_0000_READ;
+		write_idx = VMX_MSR_BMP_0000_WRITE;
+	} else if (msr - 0xc0000000 <= 0x1fff) {
+		read_idx = VMX_MSR_BMP_C000_READ;
+		write_idx = VMX_MSR_BMP_C000_WRITE;
+	} else {
+		return;
+	}
+
+	if (intercept) {
+		bitmap[read_idx][offset] |= mask;
+		bitmap[write_idx][offset] |= mask;
+	} else {
+		bitmap[read_idx][offset] &= ~mask;
+		bitmap[write_idx][offset] &= ~mask;
+	}
+}
+
 #define VCPU_VENDOR_GET_REGISTER(__reg__, __field__)	\
 u64 vcpu_vendor_get_##__reg__(void)			\
 {							\
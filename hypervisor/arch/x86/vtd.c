@@ -556,16 +556,37 @@ static void vtd_init_unit(void *reg_base, void *inv_queue)
 	vtd_update_gcmd_reg(reg_base, VTD_GCMD_IRE, 1);
 }
 
-static void vtd_update_irte(unsigned int index, union vtd_irte content)
+/*
+ * Invalidate the interrupt entry caches of all units for the given index
+ * range, rounded up to the naturally aligned power-of-two block covering it.
+ */
+static void vtd_invalidate_irtes(unsigned int first, unsigned int last)
 {
-	const struct vtd_entry inv_int = {
-		.lo_word = VTD_REQ_INV_INT | VTD_INV_INT_INDEX |
-			((u64)index << VTD_INV_INT_IIDX_SHIFT),
-	};
-	union vtd_irte *irte = &int_remap_table[index];
+	struct vtd_entry inv_int;
 	void *inv_queue = unit_inv_queue;
 	void *reg_base = dmar_reg_base;
-	unsigned int n;
+	unsigned int n, mask = 0;
+
+	while ((first >> mask) != (last >> mask))
+		mask++;
+	first &= ~((1U << mask) - 1);
+
+	inv_int.lo_word = VTD_REQ_INV_INT | VTD_INV_INT_INDEX |
+		((u64)mask << VTD_INV_INT_IM_SHIFT) |
+		((u64)first << VTD_INV_INT_IIDX_SHIFT);
+	inv_int.hi_word = 0;
+
+	for (n = 0; n < dmar_units; n++) {
+		vtd_submit_iq_request(reg_base, inv_queue, &inv_int);
+		reg_base += DMAR_MMIO_SIZE;
+		inv_queue += PAGE_SIZE;
+	}
+}
+
+static void vtd_update_irte(unsigned int index, union vtd_irte content)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+	union vtd_irte *irte = &int_remap_table[index];
 
 	if (content.field.p) {
 		/*
@@ -586,10 +607,18 @@ static void vtd_update_irte(unsigned int index, union vtd_irte content)
 	}
 	arch_paging_flush_cpu_caches(irte, sizeof(*irte));
 
-	for (n = 0; n < dmar_units; n++) {
-		vtd_submit_iq_request(reg_base, inv_queue, &inv_int);
-		reg_base += DMAR_MMIO_SIZE;
-		inv_queue += PAGE_SIZE;
+	if (cpu_data->vtd_irte_batch == 0) {
+		vtd_invalidate_irtes(index, index);
+		return;
+	}
+
+	/* stage the entry, invalidated by iommu_end_interrupt_batch */
+	if (cpu_data->vtd_irte_first > cpu_data->vtd_irte_last) {
+		cpu_data->vtd_irte_first = index;
+		cpu_data->vtd_irte_last = index;
+	} else {
+		cpu_data->vtd_irte_first = MIN(cpu_data->vtd_irte_first, index);
+		cpu_data->vtd_irte_last = MAX(cpu_data->vtd_irte_last, index);
 	}
 }
 
@@ -643,8 +672,10 @@ static void vtd_free_int_remap_region(u16 device_id, unsigned int length)
 	if (pos >= 0) {
 		printk("Freeing %u interrupt(s) for device %02x:%02x.%x at "
 		       "index %d\n", length, PCI_BDF_PARAMS(device_id), pos);
+		iommu_begin_interrupt_batch();
 		while (length-- > 0)
 			vtd_update_irte(pos++, free_irte);
+		iommu_end_interrupt_batch();
 	}
 }
 
@@ -874,6 +905,38 @@ update_irte:
 	return base_index + vector;
 }
 
+/**
+ * Start staging interrupt remapping entries updated by the calling CPU.
+ *
+ * Staged entries are written to the table immediately but may still be served
+ * from the caches of the remapping units until iommu_end_interrupt_batch().
+ * Batches can be nested.
+ */
+void iommu_begin_interrupt_batch(void)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+
+	if (cpu_data->vtd_irte_batch++ == 0) {
+		cpu_data->vtd_irte_first = 1;
+		cpu_data->vtd_irte_last = 0;
+	}
+}
+
+/**
+ * Invalidate the cached interrupt remapping entries staged since the
+ * outermost iommu_begin_interrupt_batch(), issuing a single index-range
+ * request per remapping unit.
+ */
+void iommu_end_interrupt_batch(void)
+{
+	struct per_cpu *cpu_data = this_cpu_data();
+
+	if (--cpu_data->vtd_irte_batch == 0 &&
+	    cpu_data->vtd_irte_first <= cpu_data->vtd_irte_last)
+		vtd_invalidate_irtes(cpu_data->vtd_irte_first,
+				     cpu_data->vtd_irte_last);
+}
+
 static void vtd_cell_exit(struct cell *cell)
 {
 	page_free(&mem_pool, cell->arch.vtd.pg_structs.root_table, 1);
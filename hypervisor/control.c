@@ -17,6 +17,7 @@
 #include <jailhouse/paging.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/string.h>
+#include <jailhouse/trace.h>
 #include <jailhouse/unit.h>
 #include <jailhouse/utils.h>
 #include <asm/control.h>
@@ -34,6 +35,18 @@ struct cell root_cell;
 static spinlock_t shutdown_lock;
 static unsigned int num_cells = 1;
 
+/* Set while a cell management hypercall is in progress. */
+static unsigned long management_busy;
+
+/* Root cell suspension statistics of management hypercalls, in us. */
+static u64 root_suspend_start;
+static u32 root_suspend_last_us, root_suspend_max_us;
+
+/** Per-CPU statistics published read-only to the root cell. */
+struct jailhouse_stats_page *stats_page;
+/** Size of the statistics page(s) in bytes. */
+unsigned long stats_page_size;
+
 volatile unsigned long panic_in_progress;
 unsigned long panic_cpu = -1;
 
@@ -155,6 +168,48 @@ static void cell_resume(struct cell *cell)
 		resume_cpu(cpu);
 }
 
+/*
+ * Cell management hypercalls are split into a preparation phase that runs
+ * while the root cell continues to execute and a commit phase that runs with
+ * the root cell suspended. The preparation phase may only build up state that
+ * is not yet visible to any other CPU, e.g. data structures of a new cell.
+ * Concurrent management requests are rejected, so the cell list and the
+ * memory pools are only modified by the caller of management_begin().
+ */
+static bool management_begin(void)
+{
+	return !atomic_test_and_set_bit(0, &management_busy);
+}
+
+static void management_end(void)
+{
+	memory_barrier();
+	clear_bit(0, &management_busy);
+}
+
+static void root_cell_suspend(void)
+{
+	trace_event(JAILHOUSE_TRACE_MANAGEMENT_BEGIN, 0, 0);
+	root_suspend_start = arch_read_timestamp();
+	cell_suspend(&root_cell);
+}
+
+static void root_cell_resume(void)
+{
+	u32 duration_us;
+
+	cell_resume(&root_cell);
+
+	duration_us = timestamp_to_us(arch_read_timestamp() -
+				      root_suspend_start);
+	root_suspend_last_us = duration_us;
+	if (duration_us > root_suspend_max_us)
+		root_suspend_max_us = duration_us;
+	trace_event(JAILHOUSE_TRACE_MANAGEMENT_END, duration_us, 0);
+
+	printk("Root cell suspended for %u us\n", duration_us);
+}
+
 /**
  * Deliver a message to cell and wait for the reply.
  * @param cell		Target cell.
@@ -230,6 +285,105 @@ static void cell_reconfig_completed(void)
 				      MSG_INFORMATION);
 }
 
+/*
+ * Build the index of the cell's memory regions, sorted by physical start
+ * address. Configurations are usually already sorted, which makes insertion
+ * sort cheap here.
+ */
+static int mem_index_init(struct cell *cell)
+{
+	unsigned int num = cell->config->num_memory_regions;
+	struct mem_region_index_entry *index;
+	const struct jailhouse_memory *mem;
+	unsigned int n, pos;
+	u64 max_end = 0;
+
+	if (num == 0)
+		return 0;
+
+	index = page_alloc(&mem_pool, PAGES(num * sizeof(*index)));
+	if (!index)
+		return -ENOMEM;
+
+	for_each_mem_region(mem, cell->config, n) {
+		for (pos = n; pos > 0; pos--) {
+			if (index[pos - 1].mem->phys_start <= mem->phys_start)
+				break;
+			index[pos] = index[pos - 1];
+		}
+		index[pos].mem = mem;
+	}
+
+	for (n = 0; n < num; n++) {
+		max_end = MAX(max_end,
+			      index[n].mem->phys_start + index[n].mem->size);
+		index[n].max_phys_end = max_end;
+	}
+
+	cell->mem_index = index;
+
+	return 0;
+}
+
+static void mem_index_exit(struct cell *cell)
+{
+	page_free(&mem_pool, cell->mem_index,
+		  PAGES(cell->config->num_memory_regions *
+			sizeof(*cell->mem_index)));
+}
+
+/**
+ * Find the start position for searching overlapping memory regions.
+ * @param cell		Cell to search.
+ * @param start		Physical start address of the searched range.
+ *
+ * @return Position of the first index entry that may overlap with @c start.
+ *
+ * @note For internal use only. Use for_each_overlapping_mem_region() instead.
+ */
+unsigned int mem_index_first(struct cell *cell, u64 start)
+{
+	unsigned int low = 0, high = cell->config->num_memory_regions;
+	unsigned int mid;
+
+	/* max_phys_end is monotonic, find the first one beyond start */
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (cell->mem_index[mid].max_phys_end > start)
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	return low;
+}
+
+/**
+ * Return the next memory region that overlaps with the searched range.
+ * @param cell		Cell to search.
+ * @param start		Physical start address of the searched range.
+ * @param size		Size of the searched range.
+ * @param pos		Current search position, will be advanced.
+ *
+ * @return Overlapping memory region or NULL if there are no more.
+ *
+ * @note For internal use only. Use for_each_overlapping_mem_region() instead.
+ */
+const struct jailhouse_memory *
+mem_index_next_overlap(struct cell *cell, u64 start, u64 size,
+		       unsigned int *pos)
+{
+	const struct jailhouse_memory *mem;
+
+	while (*pos < cell->config->num_memory_regions) {
+		mem = cell->mem_index[(*pos)++].mem;
+		if (mem->phys_start >= start + size)
+			break;
+		if (mem->phys_start + mem->size > start)
+			return mem;
+	}
+	return NULL;
+}
+
 /**
  * Initialize a new cell.
  * @param cell	Cell to be initialized.
@@ -260,8 +414,20 @@ int cell_init(struct cell *cell)
 
 	cell->cpu_set = cpu_set;
 
+	err = mem_index_init(cell);
+	if (err)
+		goto err_free_cpu_set;
+
 	err = mmio_cell_init(cell);
-	if (err && cell->cpu_set != &cell->small_cpu_set)
+	if (err)
+		goto err_mem_index_exit;
+
+	return 0;
+
+err_mem_index_exit:
+	mem_index_exit(cell);
+err_free_cpu_set:
+	if (cell->cpu_set != &cell->small_cpu_set)
 		page_free(&mem_pool, cell->cpu_set, 1);
 
 	return err;
@@ -270,6 +436,7 @@ int cell_init(struct cell *cell)
 static void cell_exit(struct cell *cell)
 {
 	mmio_cell_exit(cell);
+	mem_index_exit(cell);
 
 	if (cell->cpu_set != &cell->small_cpu_set)
 		page_free(&mem_pool, cell->cpu_set, 1);
@@ -324,10 +491,11 @@ static int remap_to_root_cell(const struct jailhouse_memory *mem,
 {
 	const struct jailhouse_memory *root_mem;
 	struct jailhouse_memory overlap;
-	unsigned int n;
+	unsigned int pos;
 	int err = 0;
 
-	for_each_mem_region(root_mem, root_cell.config, n) {
+	for_each_overlapping_mem_region(root_mem, &root_cell, mem->phys_start,
+					mem->size, pos) {
 		if (address_in_region(mem->phys_start, root_mem)) {
 			overlap.phys_start = mem->phys_start;
 			overlap.size = root_mem->size -
@@ -375,8 +543,7 @@ static void cell_destroy_internal(struct cell *cell)
 		set_bit(cpu, root_cell.cpu_set->bitmap);
 		public_per_cpu(cpu)->cell = &root_cell;
 		public_per_cpu(cpu)->failed = false;
-		memset(public_per_cpu(cpu)->stats, 0,
-		       sizeof(public_per_cpu(cpu)->stats));
+		reset_cpu_stats(public_per_cpu(cpu));
 	}
 
 	for_each_mem_region(mem, cell->config, n) {
@@ -418,11 +585,12 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 	if (cpu_data->public.cell != &root_cell)
 		return -EPERM;
 
-	cell_suspend(&root_cell);
+	if (!management_begin())
+		return -EBUSY;
 
 	if (!cell_reconfig_ok(NULL)) {
 		err = -EPERM;
-		goto err_resume;
+		goto err_end;
 	}
 
 	cfg_pages = PAGES(cfg_page_offs + sizeof(struct jailhouse_cell_desc));
@@ -430,7 +598,7 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 					     PAGE_READONLY_FLAGS);
 	if (!cfg_mapping) {
 		err = -ENOMEM;
-		goto err_resume;
+		goto err_end;
 	}
 
 	cfg = (struct jailhouse_cell_desc *)(cfg_mapping + cfg_page_offs);
@@ -444,27 +612,27 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 		if (strcmp(cell->config->name, cfg->name) == 0 ||
 		    cell->config->id == cfg->id) {
 			err = -EEXIST;
-			goto err_resume;
+			goto err_end;
 		}
 
 	cfg_total_size = jailhouse_cell_config_size(cfg);
 	cfg_pages = PAGES(cfg_page_offs + cfg_total_size);
 	if (cfg_pages > NUM_TEMPORARY_PAGES) {
 		err = trace_error(-E2BIG);
-		goto err_resume;
+		goto err_end;
 	}
 
 	if (!paging_get_guest_pages(NULL, config_address, cfg_pages,
 				    PAGE_READONLY_FLAGS)) {
 		err = -ENOMEM;
-		goto err_resume;
+		goto err_end;
 	}
 
 	cell_pages = PAGES(sizeof(*cell) + cfg_total_size);
 	cell = page_alloc(&mem_pool, cell_pages);
 	if (!cell) {
 		err = -ENOMEM;
-		goto err_resume;
+		goto err_end;
 	}
 
 	cell->data_pages = cell_pages;
@@ -492,12 +660,33 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 	if (err)
 		goto err_cell_exit;
 
+	/* Build the new cell's mappings, they are not yet visible to anyone. */
+	for_each_mem_region(mem, cell->config, n) {
+		if (JAILHOUSE_MEMORY_IS_SUBPAGE(mem))
+			err = mmio_subpage_register(cell, mem);
+		else
+			err = arch_map_memory_region(cell, mem);
+		if (err)
+			goto err_unmap_cell;
+	}
+
+	/*
+	 * Everything from here on modifies state that is shared with the root
+	 * cell.
+	 */
+	root_cell_suspend();
+
+	/*
+	 * Units take the cell's devices and interrupts away from the root
+	 * cell. That requires it to be stopped.
+	 */
 	for_each_unit(unit) {
 		err = unit->cell_init(cell);
 		if (err) {
 			for_each_unit_before_reverse(unit, unit)
 				unit->cell_exit(cell);
-			goto err_arch_destroy;
+			root_cell_resume();
+			goto err_unmap_cell;
 		}
 	}
 
@@ -510,20 +699,15 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 
 		clear_bit(cpu, root_cell.cpu_set->bitmap);
 		public_per_cpu(cpu)->cell = cell;
-		memset(public_per_cpu(cpu)->stats, 0,
-		       sizeof(public_per_cpu(cpu)->stats));
+		reset_cpu_stats(public_per_cpu(cpu));
 	}
 
 	/*
-	 * Unmap the cell's memory regions from the root cell and map them to
-	 * the new cell instead.
+	 * Unmap the cell's memory regions from the root cell. Exceptions:
+	 *  - the communication region is not backed by root memory
+	 *  - regions that may be shared with the root cell
 	 */
-	for_each_mem_region(mem, cell->config, n) {
-		/*
-		 * Unmap exceptions:
-		 *  - the communication region is not backed by root memory
-		 *  - regions that may be shared with the root cell
-		 */
+	for_each_mem_region(mem, cell->config, n)
 		if (!(mem->flags & (JAILHOUSE_MEM_COMM_REGION |
 				    JAILHOUSE_MEM_ROOTSHARED))) {
 			err = unmap_from_root_cell(mem);
@@ -531,14 +715,6 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 				goto err_destroy_cell;
 		}
 
-		if (JAILHOUSE_MEMORY_IS_SUBPAGE(mem))
-			err = mmio_subpage_register(cell, mem);
-		else
-			err = arch_map_memory_region(cell, mem);
-		if (err)
-			goto err_destroy_cell;
-	}
-
 	config_commit(cell);
 
 	cell->comm_page.comm_region.cell_state = JAILHOUSE_CELL_SHUT_DOWN;
@@ -549,28 +725,34 @@ static int cell_create(struct per_cpu *cpu_data, unsigned long config_address)
 	last->next = cell;
 	num_cells++;
 
+	root_cell_resume();
+
 	cell_reconfig_completed();
 
 	printk("Created cell \"%s\"\n", cell->config->name);
 
 	paging_dump_stats("after cell creation");
 
-	cell_resume(&root_cell);
+	management_end();
 
 	return 0;
 
 err_destroy_cell:
 	cell_destroy_internal(cell);
+	root_cell_resume();
 	/* cell_destroy_internal already calls arch_cell_destroy & cell_exit */
 	goto err_free_cell;
-err_arch_destroy:
+err_unmap_cell:
+	for_each_mem_region(mem, cell->config, n)
+		if (!JAILHOUSE_MEMORY_IS_SUBPAGE(mem))
+			arch_unmap_memory_region(cell, mem);
 	arch_cell_destroy(cell);
 err_cell_exit:
 	cell_exit(cell);
 err_free_cell:
 	page_free(&mem_pool, cell, cell_pages);
-err_resume:
-	cell_resume(&root_cell);
+err_end:
+	management_end();
 
 	return err;
 }
@@ -585,36 +767,48 @@ static int cell_management_prologue(enum management_task task,
 				    struct per_cpu *cpu_data, unsigned long id,
 				    struct cell **cell_ptr)
 {
+	int err;
+
 	/* We do not support management commands over non-root cells. */
 	if (cpu_data->public.cell != &root_cell)
 		return -EPERM;
 
-	cell_suspend(&root_cell);
+	if (!management_begin())
+		return -EBUSY;
 
 	for_each_cell(*cell_ptr)
 		if ((*cell_ptr)->config->id == id)
 			break;
 
 	if (!*cell_ptr) {
-		cell_resume(&root_cell);
-		return -ENOENT;
+		err = -ENOENT;
+		goto err_end;
 	}
 
 	/* root cell cannot be managed */
 	if (*cell_ptr == &root_cell) {
-		cell_resume(&root_cell);
-		return -EINVAL;
+		err = -EINVAL;
+		goto err_end;
 	}
 
+	/*
+	 * Negotiating with the target cell can take a while, so the root cell
+	 * is only suspended afterwards.
+	 */
 	if ((task == CELL_DESTROY && !cell_reconfig_ok(*cell_ptr)) ||
 	    !cell_shutdown_ok(*cell_ptr)) {
-		cell_resume(&root_cell);
-		return -EPERM;
+		err = -EPERM;
+		goto err_end;
 	}
 
+	root_cell_suspend();
 	cell_suspend(*cell_ptr);
 
 	return 0;
+
+err_end:
+	management_end();
+	return err;
 }
 
 static int cell_start(struct per_cpu *cpu_data, unsigned long id)
@@ -672,10 +866,13 @@ static int cell_start(struct per_cpu *cpu_data, unsigned long id)
 		arch_reset_cpu(cpu);
 	}
 
-	printk("Started cell \"%s\"\n", cell->config->name);
-
 out_resume:
-	cell_resume(&root_cell);
+	root_cell_resume();
+
+	if (!err)
+		printk("Started cell \"%s\"\n", cell->config->name);
+
+	management_end();
 
 	return err;
 }
@@ -718,10 +915,13 @@ static int cell_set_loadable(struct per_cpu *cpu_data, unsigned long id)
 
 	config_commit(NULL);
 
-	printk("Cell \"%s\" can be loaded\n", cell->config->name);
-
 out_resume:
-	cell_resume(&root_cell);
+	root_cell_resume();
+
+	if (!err)
+		printk("Cell \"%s\" can be loaded\n", cell->config->name);
+
+	management_end();
 
 	return err;
 }
@@ -735,8 +935,6 @@ static int cell_destroy(struct per_cpu *cpu_data, unsigned long id)
 	if (err)
 		return err;
 
-	printk("Closing cell \"%s\"\n", cell->config->name);
-
 	cell_destroy_internal(cell);
 
 	previous = &root_cell;
@@ -745,12 +943,16 @@ static int cell_destroy(struct per_cpu *cpu_data, unsigned long id)
 	previous->next = cell->next;
 	num_cells--;
 
+	root_cell_resume();
+
+	printk("Closed cell \"%s\"\n", cell->config->name);
+
 	page_free(&mem_pool, cell, cell->data_pages);
 	paging_dump_stats("after cell destruction");
 
 	cell_reconfig_completed();
 
-	cell_resume(&root_cell);
+	management_end();
 
 	return 0;
 }
@@ -792,6 +994,8 @@ void shutdown(void)
 {
 	struct unit *unit;
 
+	printk_rings_stop();
+
 	pci_prepare_handover();
 	arch_prepare_shutdown();
 
@@ -820,6 +1024,9 @@ static int hypervisor_disable(struct per_cpu *cpu_data)
 	 * safe nevertheless because we only need to see a consistent num_cells
 	 * that is not increasing anymore once the shutdown was started:
 	 *
+	 * num_cells is only changed while the root cell is suspended, not in
+	 * the preparation phase of a management hypercall.
+	 *
 	 * If another CPU in a management hypercall already called cell_suspend,
 	 * it is now waiting for this CPU to react. In this case, we see
 	 * num_cells prior to any change, can start the shutdown if it is 1, and
@@ -896,11 +1103,83 @@ static long hypervisor_get_info(struct per_cpu *cpu_data, unsigned long type)
 		return remap_pool.used_pages;
 	case JAILHOUSE_INFO_NUM_CELLS:
 		return num_cells;
+	case JAILHOUSE_INFO_ROOT_SUSPEND_LAST_US:
+		return root_suspend_last_us;
+	case JAILHOUSE_INFO_ROOT_SUSPEND_MAX_US:
+		return root_suspend_max_us;
+	case JAILHOUSE_INFO_STATS_PAGE:
+		return paging_hvirt2phys(stats_page) -
+			system_config->hypervisor_memory.phys_start;
+	case JAILHOUSE_INFO_TRACE_BUFFER:
+		return trace_buffer_offset();
 	default:
 		return -EINVAL;
 	}
 }
 
+/**
+ * Allocate and initialize the statistics page.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int stats_page_init(void)
+{
+	unsigned int cpu;
+
+	stats_page_size = PAGE_ALIGN(sizeof(struct jailhouse_stats_page) +
+		hypervisor_header.max_cpus * sizeof(struct jailhouse_cpu_stats));
+	stats_page = page_alloc(&mem_pool, stats_page_size / PAGE_SIZE);
+	if (!stats_page)
+		return -ENOMEM;
+
+	stats_page->max_cpus = hypervisor_header.max_cpus;
+	stats_page->num_stats = JAILHOUSE_NUM_CPU_STATS;
+	/*
+	 * The CPUs count directly into their slots, so there is nothing to
+	 * copy on VM exits. Only the owning CPU writes to the counters.
+	 */
+	for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++) {
+		stats_page->cpu[cpu].cell_id = root_cell.config->id;
+		public_per_cpu(cpu)->stats =
+			(u32 *)stats_page->cpu[cpu].stats;
+	}
+
+	return 0;
+}
+
+/**
+ * Reset the statistic counters of a CPU and publish its current cell.
+ * @param cpu_public	Public per-CPU data of the CPU.
+ *
+ * @note Must only be called by the CPU managing a cell while the target CPU
+ * is suspended.
+ */
+void reset_cpu_stats(struct public_per_cpu *cpu_public)
+{
+	struct jailhouse_cpu_stats *slot = &stats_page->cpu[cpu_public->cpu_id];
+	unsigned int n;
+
+	slot->seq++;
+	memory_store_barrier();
+	slot->cell_id = cpu_public->cell->config->id;
+	for (n = 0; n < JAILHOUSE_NUM_CPU_STATS; n++)
+		slot->stats[n] = 0;
+	memory_store_barrier();
+	slot->seq++;
+}
+
+/**
+ * Complete the handling of a VM exit right before returning to the guest.
+ *
+ * Writes out pending hypervisor log records on root cell CPUs.
+ */
+void vcpu_exit_done(void)
+{
+	trace_event(JAILHOUSE_TRACE_VMEXIT_DONE, 0, 0);
+	if (this_cell() == &root_cell)
+		printk_drain();
+}
+
 static int cpu_get_info(struct per_cpu *cpu_data, unsigned long cpu_id,
 			unsigned long type)
 {
@@ -927,6 +1206,44 @@ static int cpu_get_info(struct per_cpu *cpu_data, unsigned long cpu_id,
 		return -EINVAL;
 }
 
+static long debug_console_write(struct per_cpu *cpu_data,
+				unsigned long address, unsigned long size)
+{
+	unsigned long page_offs = address & ~PAGE_MASK;
+	const char *msg;
+	unsigned int len;
+	char buf[128];
+
+	if (!CELL_FLAGS_VIRTUAL_CONSOLE_PERMITTED(
+		cpu_data->public.cell->config->flags))
+		return trace_error(-EPERM);
+
+	if (size > JAILHOUSE_DEBUG_CONSOLE_WRITE_MAX)
+		return -EINVAL;
+
+	msg = paging_get_guest_pages(NULL, address, PAGES(page_offs + size),
+				     PAGE_READONLY_FLAGS);
+	if (!msg)
+		return -EINVAL;
+	msg += page_offs;
+
+	/*
+	 * Copy the message in chunks as the guest may modify it concurrently
+	 * and does not have to terminate it.
+	 */
+	while (size > 0) {
+		len = MIN(size, sizeof(buf) - 1);
+		memcpy(buf, msg, len);
+		buf[len] = 0;
+		printk("%s", buf);
+
+		msg += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
 /**
  * Handle hypercall invoked by a cell.
  * @param code		Hypercall code.
@@ -942,6 +1259,7 @@ long hypercall(unsigned long code, unsigned long arg1, unsigned long arg2)
 	struct per_cpu *cpu_data = this_cpu_data();
 
 	cpu_data->public.stats[JAILHOUSE_CPU_STAT_VMEXITS_HYPERCALL]++;
+	trace_event(JAILHOUSE_TRACE_HYPERCALL, code, arg1);
 
 	switch (code) {
 	case JAILHOUSE_HC_DISABLE:
@@ -966,6 +1284,8 @@ long hypercall(unsigned long code, unsigned long arg1, unsigned long arg2)
 			return trace_error(-EPERM);
 		printk("%c", (char)arg1);
 		return 0;
+	case JAILHOUSE_HC_DEBUG_CONSOLE_WRITE:
+		return debug_console_write(cpu_data, arg1, arg2);
 	default:
 		return -ENOSYS;
 	}
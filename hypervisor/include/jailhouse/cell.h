@@ -22,6 +22,14 @@
 #include <jailhouse/cell-config.h>
 #include <jailhouse/hypercall.h>
 
+/** Entry of the sorted memory region index of a cell. */
+struct mem_region_index_entry {
+	/** Memory region of the cell configuration. */
+	const struct jailhouse_memory *mem;
+	/** Highest physical end address of this and all preceding entries. */
+	u64 max_phys_end;
+};
+
 /** Cell-related states. */
 struct cell {
 	union {
@@ -52,6 +60,9 @@ struct cell {
 	/** Pointer to next cell in the system. */
 	struct cell *next;
 
+	/** Memory regions of the cell, sorted by physical start address. */
+	struct mem_region_index_entry *mem_index;
+
 	/** List of PCI devices assigned to this cell. */
 	struct pci_device *pci_devices;
 
@@ -35,6 +35,9 @@ extern unsigned long panic_cpu;
 
 extern struct jailhouse_system *system_config;
 
+extern struct jailhouse_stats_page *stats_page;
+extern unsigned long stats_page_size;
+
 unsigned int next_cpu(unsigned int cpu, struct cpu_set *cpu_set,
 		      unsigned int exception);
 
@@ -106,6 +109,20 @@ unsigned int next_cpu(unsigned int cpu, struct cpu_set *cpu_set,
 	     (counter) < (config)->num_memory_regions;			\
 	     (mem)++, (counter)++)
 
+/**
+ * Iterate over all memory regions of a cell that overlap with the given
+ * physical address range, in ascending order of their start addresses.
+ * @param mem		Iteration variable holding the reference to the current
+ * 			memory region (const struct jailhouse_memory *).
+ * @param cell		Cell to search.
+ * @param start		Physical start address of the range.
+ * @param size		Size of the range.
+ * @param pos		Auxiliary position variable (unsigned int).
+ */
+#define for_each_overlapping_mem_region(mem, cell, start, size, pos)	\
+	for ((pos) = mem_index_first(cell, start);			\
+	     ((mem) = mem_index_next_overlap(cell, start, size, &(pos)));)
+
 /**
  * Check if the CPU is assigned to the specified cell.
  * @param cell		Cell the CPU may belong to.
@@ -123,8 +140,17 @@ bool cpu_id_valid(unsigned long cpu_id);
 
 int cell_init(struct cell *cell);
 
+unsigned int mem_index_first(struct cell *cell, u64 start);
+const struct jailhouse_memory *
+mem_index_next_overlap(struct cell *cell, u64 start, u64 size,
+		       unsigned int *pos);
+
 void config_commit(struct cell *cell_added_removed);
 
+int stats_page_init(void);
+void reset_cpu_stats(struct public_per_cpu *cpu_public);
+void vcpu_exit_done(void);
+
 long hypercall(unsigned long code, unsigned long arg1, unsigned long arg2);
 
 void shutdown(void);
@@ -233,6 +259,10 @@ void arch_flush_cell_vcpu_caches(struct cell *cell);
  *
  * @return 0 on success, negative error code otherwise.
  *
+ * @note This is called while the root cell is still running. Only state of
+ * the new cell may be set up, and root cell resources may only be revoked in
+ * a way that tolerates concurrent accesses by the root cell.
+ *
  * @see arch_cell_destroy
  */
 int arch_cell_create(struct cell *cell);
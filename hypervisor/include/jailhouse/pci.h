@@ -60,6 +60,10 @@ struct ivshmem_endpoint;
 /** MSI-X vectors supported per device without extra allocation. */
 #define PCI_EMBEDDED_MSIX_VECTS	16
 
+/** Size of a bitmap covering the given number of MSI-X vectors, in longs. */
+#define PCI_MSIX_BITMAP_LONGS(vectors)	\
+	(((vectors) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
 /**
  * Access moderation return codes.
  * See pci_cfg_read_moderate() and pci_cfg_write_moderate().
@@ -141,6 +145,15 @@ struct pci_device {
 	union pci_msix_vector *msix_vectors;
 	/** Buffer for shadow table of up to PCI_EMBEDDED_MSIX_VECTS vectors. */
 	union pci_msix_vector msix_vector_array[PCI_EMBEDDED_MSIX_VECTS];
+	/** Bitmap of MSI-X vectors whose physical table entry is programmed
+	 * according to the shadow address and data. Set by architecture
+	 * code, cleared when the shadow changes or the mapping has to be
+	 * revalidated. */
+	unsigned long *msix_programmed;
+	/** Buffer for msix_programmed of up to PCI_EMBEDDED_MSIX_VECTS
+	 * vectors. */
+	unsigned long msix_programmed_array[
+		PCI_MSIX_BITMAP_LONGS(PCI_EMBEDDED_MSIX_VECTS)];
 };
 
 u32 pci_read_config(u16 bdf, u16 address, unsigned int size);
@@ -237,11 +250,26 @@ int arch_pci_update_msi(struct pci_device *device,
  * @param device	Device to be updated.
  * @param index		MSI-X vector number.
  *
+ * Vectors flagged in pci_device::msix_programmed may be skipped.
+ *
  * @return 0 on success, negative error code otherwise.
  *
  * @see arch_pci_update_msi
+ * @see arch_pci_update_msix
  */
 int arch_pci_update_msix_vector(struct pci_device *device, unsigned int index);
 
+/**
+ * Update the mappings of all MSI-X vectors of a given device.
+ * @param device	Device to be updated.
+ *
+ * Architectures may batch the updates of multiple vectors.
+ *
+ * @return 0 on success, negative error code otherwise.
+ *
+ * @see arch_pci_update_msix_vector
+ */
+int arch_pci_update_msix(struct pci_device *device);
+
 /** @} PCI */
 #endif /* !_JAILHOUSE_PCI_H */
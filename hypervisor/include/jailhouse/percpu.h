@@ -28,6 +28,27 @@
  * @{
  */
 
+/** Size of the per-CPU log ring in bytes, must be a power of two. */
+#define LOG_RING_SIZE	2048
+
+/** Per-CPU ring of printk records, drained by root cell CPUs. */
+struct log_ring {
+	/** Write position, only advanced by the owning CPU. */
+	volatile unsigned int head;
+	/** Read position, only advanced by the CPU draining the rings. */
+	volatile unsigned int tail;
+	/** Number of records dropped on overflow, written by the owner. */
+	volatile unsigned int dropped;
+	/** Number of dropped records already reported by the drainer. */
+	unsigned int dropped_reported;
+	/** Write position of the record under construction. */
+	unsigned int pos;
+	/** True if the record under construction does not fit. */
+	bool overflow;
+	/** Record data. */
+	char buf[LOG_RING_SIZE];
+};
+
 /** Per-CPU states accessible across all CPUs. */
 struct public_per_cpu {
 	/** Per-CPU root page table. Public because it has to be accessible for
@@ -39,8 +60,9 @@ struct public_per_cpu {
 	/** Owning cell. */
 	struct cell *cell;
 
-	/** Statistic counters. */
-	u32 stats[JAILHOUSE_NUM_CPU_STATS];
+	/** Statistic counters, located in the CPU's slot of the statistics
+	 *  page. */
+	u32 *stats;
 
 	/** State of the shutdown process. Possible values:
 	 * @li SHUTDOWN_NONE: no shutdown in progress
@@ -60,6 +82,9 @@ struct public_per_cpu {
 	 *  host physical <-> guest physical memory mappings. */
 	bool flush_vcpu_caches;
 
+	/** Ring of printk records not yet written to the console. */
+	struct log_ring log_ring;
+
 	ARCH_PUBLIC_PERCPU_FIELDS;
 } __attribute__((aligned(PAGE_SIZE)));
 
@@ -16,6 +16,10 @@ void __attribute__((format(printf, 1, 2))) printk(const char *fmt, ...);
 
 void __attribute__((format(printf, 1, 2))) panic_printk(const char *fmt, ...);
 
+void printk_rings_start(void);
+void printk_rings_stop(void);
+void printk_drain(void);
+
 #ifdef CONFIG_TRACE_ERROR
 #define trace_error(code) ({						  \
 	printk("%s:%d: returning error %s\n", __FILE__, __LINE__, #code); \
@@ -16,4 +16,23 @@
 
 unsigned long phys_processor_id(void);
 
+/**
+ * Read the free-running timestamp counter of the calling CPU.
+ *
+ * @return Counter value in ticks of arch_timestamp_khz().
+ *
+ * @note The counter is expected to be synchronized across all CPUs.
+ */
+u64 arch_read_timestamp(void);
+
+/**
+ * Return the frequency of the timestamp counter.
+ *
+ * @return Frequency in kHz, 0 if unknown.
+ */
+unsigned long arch_timestamp_khz(void);
+
+u64 timestamp_to_ns(u64 ticks);
+u64 timestamp_to_us(u64 ticks);
+
 #endif
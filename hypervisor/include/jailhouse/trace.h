@@ -0,0 +1,41 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef _JAILHOUSE_TRACE_H
+#define _JAILHOUSE_TRACE_H
+
+#include <jailhouse/entry.h>
+#include <jailhouse/hypercall.h>
+
+#ifdef CONFIG_TRACE_EVENTS
+int trace_init(void);
+bool trace_buffer_contains(unsigned long phys);
+long trace_buffer_offset(void);
+void trace_event(unsigned int event, unsigned long arg0, unsigned long arg1);
+#else
+static inline int trace_init(void)
+{
+	return 0;
+}
+
+static inline bool trace_buffer_contains(unsigned long phys)
+{
+	return false;
+}
+
+static inline long trace_buffer_offset(void)
+{
+	return -ENOSYS;
+}
+
+/* Arguments are not evaluated, they may be costly to obtain. */
+#define trace_event(event, arg0, arg1)	do { } while (0)
+#endif
+
+#endif /* !_JAILHOUSE_TRACE_H */
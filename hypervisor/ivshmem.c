@@ -28,6 +28,7 @@
 #include <jailhouse/utils.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/percpu.h>
+#include <jailhouse/trace.h>
 
 #define PCI_VENDOR_ID_SIEMENS		0x110a
 #define IVSHMEM_DEVICE_ID		0x4106
@@ -95,6 +96,8 @@ static void ivshmem_trigger_interrupt(struct ivshmem_endpoint *ive,
 		    IVSHMEM_CFG_ONESHOT_INT)
 			ive->int_ctrl_reg = 0;
 
+		trace_event(JAILHOUSE_TRACE_IVSHMEM_DOORBELL,
+			    ive->device->info->bdf, vector);
 		arch_ivshmem_trigger_interrupt(ive, vector);
 	}
 
@@ -10,6 +10,7 @@
  * the COPYING file in the top-level directory.
  */
 
+#include <jailhouse/processor.h>
 #include <jailhouse/string.h>
 
 void *memset(void *s, int c, size_t n)
@@ -41,3 +42,41 @@ void *memcpy(void *dest, const void *src, size_t n)
 		*d++ = *s++;
 	return dest;
 }
+
+/*
+ * Scale timestamp ticks by (units_per_ms << shift) / khz, followed by a right
+ * shift. This avoids 64-bit divisions which are not available on all
+ * architectures. The precision of the scaling factor is well below 1% for
+ * counter frequencies up to several GHz.
+ */
+static u64 timestamp_scale(u64 ticks, u32 scaled_units_per_ms,
+			   unsigned int shift)
+{
+	unsigned long khz = arch_timestamp_khz();
+
+	if (khz == 0)
+		return 0;
+	return (ticks * (scaled_units_per_ms / (u32)khz)) >> shift;
+}
+
+/**
+ * Convert a timestamp counter delta into nanoseconds.
+ * @param ticks		Ticks of the timestamp counter.
+ *
+ * @return Nanoseconds, 0 if the counter frequency is unknown.
+ */
+u64 timestamp_to_ns(u64 ticks)
+{
+	return timestamp_scale(ticks, 1000000U << 10, 10);
+}
+
+/**
+ * Convert a timestamp counter delta into microseconds.
+ * @param ticks		Ticks of the timestamp counter.
+ *
+ * @return Microseconds, 0 if the counter frequency is unknown.
+ */
+u64 timestamp_to_us(u64 ticks)
+{
+	return timestamp_scale(ticks, 1000U << 20, 20);
+}
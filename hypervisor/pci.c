@@ -11,6 +11,7 @@
  * the COPYING file in the top-level directory.
  */
 
+#include <jailhouse/bitops.h>
 #include <jailhouse/control.h>
 #include <jailhouse/ivshmem.h>
 #include <jailhouse/mmio.h>
@@ -21,6 +22,7 @@
 #include <jailhouse/utils.h>
 
 #define MSIX_VECTOR_CTRL_DWORD		3
+#define MSIX_VECTOR_CTRL_MASKBIT	0x1
 
 #define for_each_configured_pci_device(dev, cell)			\
 	for ((dev) = (cell)->pci_devices;				\
@@ -251,18 +253,18 @@ enum pci_access pci_cfg_read_moderate(struct pci_device *device, u16 address,
 	return PCI_ACCESS_PERFORM;
 }
 
-static int pci_update_msix(struct pci_device *device,
-			   const struct jailhouse_pci_capability *cap)
+static unsigned int pci_msix_shadow_pages(struct pci_device *device)
 {
-	unsigned int n;
-	int result;
+	unsigned int vectors = device->info->num_msix_vectors;
 
-	for (n = 0; n < device->info->num_msix_vectors; n++) {
-		result = arch_pci_update_msix_vector(device, n);
-		if (result < 0)
-			return result;
-	}
-	return 0;
+	return PAGES(sizeof(union pci_msix_vector) * vectors +
+		     sizeof(unsigned long) * PCI_MSIX_BITMAP_LONGS(vectors));
+}
+
+static void pci_invalidate_msix(struct pci_device *device)
+{
+	memset(device->msix_programmed, 0, sizeof(unsigned long) *
+	       PCI_MSIX_BITMAP_LONGS(device->info->num_msix_vectors));
 }
 
 /**
@@ -350,7 +352,7 @@ enum pci_access pci_cfg_write_moderate(struct pci_device *device, u16 address,
 		device->msix_registers.raw &= ~mask;
 		device->msix_registers.raw |= value;
 
-		if (pci_update_msix(device, cap) < 0)
+		if (arch_pci_update_msix(device) < 0)
 			return PCI_ACCESS_REJECT;
 	}
 
@@ -379,6 +381,20 @@ static enum mmio_result pci_msix_access_handler(void *arg,
 		if (index >= device->info->num_msix_vectors)
 			goto invalid_access;
 
+		/*
+		 * Drivers tend to rewrite unchanged vectors. But a device
+		 * reset we do not see may have cleared the physical entry,
+		 * and drivers restore it before unmasking the vector. So
+		 * program the vector again on unmask as well.
+		 */
+		if (dword == MSIX_VECTOR_CTRL_DWORD) {
+			if (device->msix_vectors[index].masked &&
+			    !(mmio->value & MSIX_VECTOR_CTRL_MASKBIT))
+				clear_bit(index, device->msix_programmed);
+		} else if (device->msix_vectors[index].raw[dword] !=
+			   mmio->value) {
+			clear_bit(index, device->msix_programmed);
+		}
 		device->msix_vectors[index].raw[dword] = mmio->value;
 		if (arch_pci_update_msix_vector(device, index) < 0)
 			goto invalid_access;
@@ -509,6 +525,7 @@ static void pci_restore_msix(struct pci_device *device,
 		for (r = 0; r < 3; r++)
 			mmio_write32(&device->msix_table[n].raw[r],
 				     device->msix_vectors[n].raw[r]);
+	pci_invalidate_msix(device);
 	pci_suppress_msix(device, cap, false);
 }
 
@@ -547,6 +564,7 @@ void pci_reset_device(struct pci_device *device)
 		device->msix_vectors[n].data = 0;
 		device->msix_vectors[n].masked = 1;
 	}
+	pci_invalidate_msix(device);
 
 	if (device->info->type == JAILHOUSE_PCI_TYPE_IVSHMEM) {
 		ivshmem_reset(device);
@@ -577,7 +595,7 @@ void pci_reset_device(struct pci_device *device)
 
 static int pci_add_physical_device(struct cell *cell, struct pci_device *device)
 {
-	unsigned int n, pages, size = device->info->msix_region_size;
+	unsigned int n, size = device->info->msix_region_size;
 	int err;
 
 	printk("Adding PCI device %02x:%02x.%x to cell \"%s\"\n",
@@ -600,14 +618,18 @@ static int pci_add_physical_device(struct cell *cell, struct pci_device *device)
 		}
 
 		if (device->info->num_msix_vectors > PCI_EMBEDDED_MSIX_VECTS) {
-			pages = PAGES(sizeof(union pci_msix_vector) *
-				      device->info->num_msix_vectors);
-			device->msix_vectors = page_alloc(&mem_pool, pages);
+			device->msix_vectors =
+				page_alloc(&mem_pool,
+					   pci_msix_shadow_pages(device));
 			if (!device->msix_vectors) {
 				err = -ENOMEM;
 				goto error_unmap_table;
 			}
+			device->msix_programmed = (unsigned long *)
+				&device->msix_vectors[
+					device->info->num_msix_vectors];
 		}
+		pci_invalidate_msix(device);
 
 		mmio_region_register(cell, device->info->msix_address, size,
 				     pci_msix_access_handler, device);
@@ -647,8 +669,7 @@ static void pci_remove_physical_device(struct pci_device *device)
 
 	if (device->msix_vectors != device->msix_vector_array)
 		page_free(&mem_pool, device->msix_vectors,
-			  PAGES(sizeof(union pci_msix_vector) *
-				device->info->num_msix_vectors));
+			  pci_msix_shadow_pages(device));
 
 	mmio_region_unregister(cell, device->info->msix_address);
 }
@@ -695,6 +716,7 @@ static int pci_cell_init(struct cell *cell)
 		device = &cell->pci_devices[ndev];
 		device->info = &dev_infos[ndev];
 		device->msix_vectors = device->msix_vector_array;
+		device->msix_programmed = device->msix_programmed_array;
 
 		if (device->info->type == JAILHOUSE_PCI_TYPE_IVSHMEM) {
 			err = ivshmem_init(cell, device);
@@ -812,7 +834,9 @@ void pci_config_commit(struct cell *cell_added_removed)
 					arch_pci_set_suppress_msi(device, cap,
 								  false);
 			} else if (cap->id == PCI_CAP_ID_MSIX) {
-				err = pci_update_msix(device, cap);
+				/* revalidate against the new CPU assignment */
+				pci_invalidate_msix(device);
+				err = arch_pci_update_msix(device);
 				if (device->cell == &root_cell)
 					pci_suppress_msix(device, cap, false);
 			}
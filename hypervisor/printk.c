@@ -11,6 +11,8 @@
  */
 
 #include <jailhouse/control.h>
+#include <jailhouse/entry.h>
+#include <jailhouse/percpu.h>
 #include <jailhouse/printk.h>
 #include <jailhouse/processor.h>
 #include <jailhouse/stdarg.h>
@@ -23,6 +25,31 @@ volatile struct jailhouse_virt_console console
 
 static spinlock_t printk_lock;
 
+/*
+ * Once the hypervisor is active, printk no longer serializes the CPUs on
+ * printk_lock and the UART. Each CPU appends its messages as records to its
+ * own log ring (single producer), and a root cell CPU merges all rings in
+ * timestamp order into the console, either when it logs itself or on its
+ * next VM exit. Non-root CPUs never wait for the console this way. Instead,
+ * they kick a root cell CPU via an event when publishing the first pending
+ * record so that the output does not depend on root cell activity.
+ *
+ * Each line written out is tagged with the timestamp and the CPU of its
+ * record. Partial lines of one CPU are terminated before output of another
+ * CPU follows.
+ */
+struct log_record_header {
+	u64 timestamp;
+	u32 len;
+};
+
+static bool log_rings_active;
+static volatile unsigned long log_drain_busy;
+static volatile bool log_pending;
+/* Console line state, owned by the CPU holding log_drain_busy. */
+static unsigned int log_line_cpu;
+static bool log_line_open;
+
 static void console_write(const char *msg)
 {
 	arch_dbg_write(msg);
@@ -147,7 +174,8 @@ static char *align(char *p1, char *p0, unsigned int width, char fill)
 	return p0 + width;
 }
 
-static void __vprintk(const char *fmt, va_list ap)
+static void __vprintk(const char *fmt, va_list ap,
+		      void (*write)(const char *msg))
 {
 	char buf[128];
 	char *p, *p0;
@@ -164,7 +192,7 @@ static void __vprintk(const char *fmt, va_list ap)
 			break;
 		} else if (c == '%') {
 			*p = 0;
-			console_write(buf);
+			write(buf);
 			p = buf;
 
 			c = *fmt++;
@@ -210,7 +238,7 @@ static void __vprintk(const char *fmt, va_list ap)
 				p = hex2str(v, p, (unsigned long)-1);
 				break;
 			case 's':
-				console_write(va_arg(ap, const char *));
+				write(va_arg(ap, const char *));
 				break;
 			case 'u':
 			case 'x':
@@ -236,13 +264,238 @@ static void __vprintk(const char *fmt, va_list ap)
 		}
 		if (p >= &buf[sizeof(buf) - 1]) {
 			*p = 0;
-			console_write(buf);
+			write(buf);
 			p = buf;
 		}
 	}
 
 	*p = 0;
-	console_write(buf);
+	write(buf);
+}
+
+static void log_ring_copy_in(struct log_ring *ring, unsigned int pos,
+			     const void *src, unsigned int len)
+{
+	const char *s = src;
+
+	while (len-- > 0)
+		ring->buf[pos++ % LOG_RING_SIZE] = *s++;
+}
+
+static void log_ring_copy_out(struct log_ring *ring, unsigned int pos,
+			      void *dst, unsigned int len)
+{
+	char *d = dst;
+
+	while (len-- > 0)
+		*d++ = ring->buf[pos++ % LOG_RING_SIZE];
+}
+
+static void log_ring_write(const char *msg)
+{
+	struct log_ring *ring = &this_cpu_public()->log_ring;
+
+	while (*msg && !ring->overflow) {
+		if (ring->pos - ring->tail >= LOG_RING_SIZE)
+			ring->overflow = true;
+		else
+			ring->buf[ring->pos++ % LOG_RING_SIZE] = *msg++;
+	}
+}
+
+static void log_emit(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	__vprintk(fmt, ap, console_write);
+	va_end(ap);
+}
+
+static void log_line_break(void)
+{
+	if (log_line_open) {
+		console_write("\n");
+		log_line_open = false;
+	}
+}
+
+static void log_emit_record(unsigned int cpu, struct log_ring *ring,
+			    const struct log_record_header *hdr,
+			    unsigned int pos)
+{
+	unsigned int len = hdr->len;
+	unsigned long long us, sec;
+	unsigned int chunk;
+	char buf[128];
+
+	if (log_line_cpu != cpu)
+		log_line_break();
+	log_line_cpu = cpu;
+
+	while (len > 0) {
+		if (!log_line_open) {
+			us = timestamp_to_us(hdr->timestamp);
+			sec = div_u64_u64(us, 1000000);
+			log_emit("[%llu.%06u CPU %u] ", sec,
+				 (unsigned int)(us - sec * 1000000), cpu);
+			log_line_open = true;
+		}
+
+		/* stop after a newline to tag the next line */
+		for (chunk = 0; chunk < MIN(len, sizeof(buf) - 1); chunk++) {
+			buf[chunk] = ring->buf[(pos + chunk) % LOG_RING_SIZE];
+			if (buf[chunk] == '\n') {
+				log_line_open = false;
+				chunk++;
+				break;
+			}
+		}
+		buf[chunk] = 0;
+		console_write(buf);
+		pos += chunk;
+		len -= chunk;
+	}
+}
+
+/* Caller must own log_drain_busy. */
+static void log_drain_rings(void)
+{
+	struct log_record_header hdr, oldest = { 0 };
+	struct log_ring *ring, *oldest_ring;
+	unsigned int cpu, oldest_cpu = 0, dropped;
+
+	log_pending = false;
+	memory_barrier();
+
+	do {
+		oldest_ring = NULL;
+		for (cpu = 0; cpu < hypervisor_header.max_cpus; cpu++) {
+			ring = &public_per_cpu(cpu)->log_ring;
+
+			dropped = ring->dropped;
+			if (dropped != ring->dropped_reported) {
+				log_line_break();
+				log_emit("<CPU %u: %u messages dropped>\n",
+					 cpu, dropped - ring->dropped_reported);
+				ring->dropped_reported = dropped;
+			}
+
+			if (ring->tail == ring->head)
+				continue;
+			/* read the record only after its publication */
+			memory_load_barrier();
+			log_ring_copy_out(ring, ring->tail, &hdr, sizeof(hdr));
+			if (!oldest_ring || hdr.timestamp < oldest.timestamp) {
+				oldest = hdr;
+				oldest_ring = ring;
+				oldest_cpu = cpu;
+			}
+		}
+
+		if (oldest_ring) {
+			log_emit_record(oldest_cpu, oldest_ring, &oldest,
+					oldest_ring->tail + sizeof(hdr));
+			/* consume the record before releasing its space */
+			memory_barrier();
+			oldest_ring->tail += sizeof(hdr) + oldest.len;
+		}
+	} while (oldest_ring);
+}
+
+static void log_drain(void)
+{
+	/*
+	 * Records published while another CPU drains set log_pending again
+	 * after that CPU cleared it. Retry so that none of them is left
+	 * behind when the draining CPU just missed them.
+	 */
+	while (!atomic_test_and_set_bit(0, &log_drain_busy)) {
+		log_drain_rings();
+		memory_barrier();
+		log_drain_busy = 0;
+
+		if (!log_pending)
+			break;
+	}
+}
+
+static void log_ring_append(const char *fmt, va_list ap)
+{
+	struct public_per_cpu *cpu_public = this_cpu_public();
+	struct log_ring *ring = &cpu_public->log_ring;
+	struct log_record_header hdr;
+	bool was_pending;
+
+	hdr.timestamp = arch_read_timestamp();
+
+	ring->pos = ring->head + sizeof(hdr);
+	ring->overflow = ring->pos - ring->tail > LOG_RING_SIZE;
+	__vprintk(fmt, ap, log_ring_write);
+
+	if (ring->overflow) {
+		ring->dropped++;
+	} else {
+		hdr.len = ring->pos - ring->head - sizeof(hdr);
+		log_ring_copy_in(ring, ring->head, &hdr, sizeof(hdr));
+		/* publish the record only after it is complete */
+		memory_store_barrier();
+		ring->head = ring->pos;
+		memory_barrier();
+		was_pending = log_pending;
+		log_pending = true;
+
+		if (cpu_public->cell != &root_cell && !was_pending)
+			arch_send_event(public_per_cpu(
+				first_cpu(root_cell.cpu_set)));
+	}
+
+	if (cpu_public->cell == &root_cell)
+		log_drain();
+}
+
+/**
+ * Switch printk to the per-CPU log rings.
+ *
+ * @note Must be called on the master CPU while all other CPUs wait for
+ * hypervisor activation.
+ */
+void printk_rings_start(void)
+{
+	log_rings_active = true;
+}
+
+/**
+ * Write out all pending log records and switch printk back to synchronous
+ * output.
+ *
+ * @note Must be called while all other CPUs are stopped in the hypervisor.
+ */
+void printk_rings_stop(void)
+{
+	if (!log_rings_active)
+		return;
+
+	while (atomic_test_and_set_bit(0, &log_drain_busy))
+		cpu_relax();
+	log_drain_rings();
+	log_line_break();
+	log_rings_active = false;
+	memory_barrier();
+	log_drain_busy = 0;
+}
+
+/**
+ * Write out pending log records of all CPUs if no other CPU is doing this
+ * already.
+ *
+ * @note Only called on root cell CPUs so that non-root cells never wait for
+ * the console.
+ */
+void printk_drain(void)
+{
+	if (log_pending)
+		log_drain();
 }
 
 void printk(const char *fmt, ...)
@@ -251,9 +504,13 @@ void printk(const char *fmt, ...)
 
 	va_start(ap, fmt);
 
-	spin_lock(&printk_lock);
-	__vprintk(fmt, ap);
-	spin_unlock(&printk_lock);
+	if (log_rings_active) {
+		log_ring_append(fmt, ap);
+	} else {
+		spin_lock(&printk_lock);
+		__vprintk(fmt, ap, console_write);
+		spin_unlock(&printk_lock);
+	}
 
 	va_end(ap);
 }
@@ -268,9 +525,15 @@ void panic_printk(const char *fmt, ...)
 		return;
 	panic_cpu = cpu_id;
 
+	/* flush what was logged so far unless another CPU is stuck on it */
+	if (log_rings_active && !atomic_test_and_set_bit(0, &log_drain_busy)) {
+		log_drain_rings();
+		log_line_break();
+	}
+
 	va_start(ap, fmt);
 
-	__vprintk(fmt, ap);
+	__vprintk(fmt, ap, console_write);
 
 	va_end(ap);
 }
@@ -18,6 +18,7 @@
 #include <jailhouse/paging.h>
 #include <jailhouse/control.h>
 #include <jailhouse/string.h>
+#include <jailhouse/trace.h>
 #include <jailhouse/unit.h>
 #include <generated/version.h>
 #include <asm/spinlock.h>
@@ -35,7 +36,7 @@ static void init_early(unsigned int cpu_id)
 {
 	unsigned long core_and_percpu_size = hypervisor_header.core_size +
 		sizeof(struct per_cpu) * hypervisor_header.max_cpus;
-	u64 hyp_phys_start, hyp_phys_end;
+	u64 hyp_phys_start, hyp_phys_end, stats_phys;
 	struct jailhouse_memory hv_page;
 
 	master_cpu_id = cpu_id;
@@ -67,16 +68,26 @@ static void init_early(unsigned int cpu_id)
 	if (error)
 		return;
 
+	error = stats_page_init();
+	if (error)
+		return;
+
+	error = trace_init();
+	if (error)
+		return;
+
 	/*
 	 * Back the region of the hypervisor core and per-CPU page with empty
 	 * pages for Linux. This allows to fault-in the hypervisor region into
 	 * Linux' page table before shutdown without triggering violations.
 	 *
 	 * Allow read access to the console page, if the hypervisor has the
-	 * debug console flag JAILHOUSE_SYS_VIRTUAL_DEBUG_CONSOLE set.
+	 * debug console flag JAILHOUSE_SYS_VIRTUAL_DEBUG_CONSOLE set, and to
+	 * the statistics page and the trace buffer.
 	 */
 	hyp_phys_start = system_config->hypervisor_memory.phys_start;
 	hyp_phys_end = hyp_phys_start + system_config->hypervisor_memory.size;
+	stats_phys = paging_hvirt2phys(stats_page);
 
 	hv_page.virt_start = hyp_phys_start;
 	hv_page.size = PAGE_SIZE;
@@ -85,6 +96,9 @@ static void init_early(unsigned int cpu_id)
 		if (virtual_console &&
 		    hv_page.virt_start == paging_hvirt2phys(&console))
 			hv_page.phys_start = paging_hvirt2phys(&console);
+		else if (hv_page.virt_start - stats_phys < stats_page_size ||
+			 trace_buffer_contains(hv_page.virt_start))
+			hv_page.phys_start = hv_page.virt_start;
 		else
 			hv_page.phys_start = paging_hvirt2phys(empty_page);
 		error = arch_map_memory_region(&root_cell, &hv_page);
@@ -246,6 +260,7 @@ int entry(unsigned int cpu_id, struct per_cpu *cpu_data)
 			 * Make sure everything was committed before we signal
 			 * the other CPUs that they can continue.
 			 */
+			printk_rings_start();
 			memory_barrier();
 			activate = true;
 		}
@@ -0,0 +1,98 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/control.h>
+#include <jailhouse/paging.h>
+#include <jailhouse/percpu.h>
+#include <jailhouse/processor.h>
+#include <jailhouse/trace.h>
+
+/* Entries per CPU, must be a power of two. */
+#define TRACE_ENTRIES		1024
+
+#define TRACE_RING_SIZE		(sizeof(struct jailhouse_trace_ring) + \
+				 TRACE_ENTRIES * \
+				 sizeof(struct jailhouse_trace_entry))
+
+static struct jailhouse_trace_buffer *trace_buffer;
+static unsigned long trace_buffer_size;
+
+static struct jailhouse_trace_ring *trace_ring(unsigned int cpu)
+{
+	return (void *)trace_buffer + sizeof(*trace_buffer) +
+		cpu * TRACE_RING_SIZE;
+}
+
+/**
+ * Allocate and initialize the trace buffer.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int trace_init(void)
+{
+	trace_buffer_size = PAGE_ALIGN(sizeof(*trace_buffer) +
+		hypervisor_header.max_cpus * TRACE_RING_SIZE);
+	trace_buffer = page_alloc(&mem_pool, trace_buffer_size / PAGE_SIZE);
+	if (!trace_buffer)
+		return -ENOMEM;
+
+	trace_buffer->max_cpus = hypervisor_header.max_cpus;
+	trace_buffer->num_entries = TRACE_ENTRIES;
+	trace_buffer->timestamp_khz = arch_timestamp_khz();
+
+	return 0;
+}
+
+/**
+ * Check if a physical address belongs to the trace buffer.
+ * @param phys	Physical address.
+ *
+ * @return True if the address is part of the trace buffer.
+ */
+bool trace_buffer_contains(unsigned long phys)
+{
+	return phys - paging_hvirt2phys(trace_buffer) < trace_buffer_size;
+}
+
+/**
+ * Return the location of the trace buffer.
+ *
+ * @return Offset of the trace buffer inside the hypervisor memory.
+ */
+long trace_buffer_offset(void)
+{
+	return paging_hvirt2phys(trace_buffer) -
+		system_config->hypervisor_memory.phys_start;
+}
+
+/**
+ * Record an event in the trace ring of the calling CPU.
+ * @param event	Event type, see JAILHOUSE_TRACE_*.
+ * @param arg0	First event argument.
+ * @param arg1	Second event argument.
+ */
+void trace_event(unsigned int event, unsigned long arg0, unsigned long arg1)
+{
+	unsigned int cpu = this_cpu_id();
+	struct jailhouse_trace_ring *ring = trace_ring(cpu);
+	struct jailhouse_trace_entry *entry =
+		&ring->entry[ring->head % TRACE_ENTRIES];
+
+	/* order the previous head update before overwriting an old entry */
+	memory_store_barrier();
+	entry->timestamp = arch_read_timestamp();
+	entry->cpu = cpu;
+	entry->event = event;
+	entry->arg[0] = arg0;
+	entry->arg[1] = arg1;
+
+	/* publish the entry only after it is complete */
+	memory_store_barrier();
+	ring->head++;
+}
@@ -64,7 +64,12 @@
 #define JAILHOUSE_CPU_STAT_VMEXITS_MSR_OTHER	JAILHOUSE_GENERIC_CPU_STATS + 6
 #define JAILHOUSE_CPU_STAT_VMEXITS_MSR_X2APIC_ICR \
 						JAILHOUSE_GENERIC_CPU_STATS + 7
-#define JAILHOUSE_NUM_CPU_STATS			JAILHOUSE_GENERIC_CPU_STATS + 8
+#define JAILHOUSE_CPU_STAT_VMCS_READS		JAILHOUSE_GENERIC_CPU_STATS + 8
+#define JAILHOUSE_CPU_STAT_VMCS_WRITES		JAILHOUSE_GENERIC_CPU_STATS + 9
+#define JAILHOUSE_CPU_STAT_VMCB_RELOADS		JAILHOUSE_GENERIC_CPU_STATS + 10
+#define JAILHOUSE_CPU_STAT_IOAPIC_REMAPS_SKIPPED \
+						JAILHOUSE_GENERIC_CPU_STATS + 11
+#define JAILHOUSE_NUM_CPU_STATS			JAILHOUSE_GENERIC_CPU_STATS + 12
 
 /* CPUID interface */
 #define JAILHOUSE_CPUID_SIGNATURE		0x40000000
@@ -67,6 +67,30 @@
 #define JAILHOUSE_CELL_TEST_DEVICE	0x00000002
 #define JAILHOUSE_CELL_AARCH32		0x00000004
 
+/*
+ * Only available on x86. Grants the cell direct access to the architectural
+ * performance monitoring counters. The counter state is switched when CPUs
+ * are handed over between cells. The root cell always has this access, so
+ * the flag only matters for non-root cells. Without it, the counters read
+ * as zero and ignore writes.
+ *
+ * Only counting is supported. Overflow interrupts are delivered as NMIs,
+ * which the hypervisor consumes as management events without forwarding
+ * them, so sampling does not work. On Intel, the root cell cannot enable
+ * the counters globally, as before the flag existed.
+ */
+#define JAILHOUSE_CELL_PMU_PASSTHROUGH	0x00000008
+
+/*
+ * Only available on AMD with xAPIC. Lets the cell use the Advanced Virtual
+ * Interrupt Controller if the CPU supports it. xAPIC accesses and IPIs
+ * within the cell are then handled by the hardware, but all physical
+ * interrupts of the cell's CPUs have to be taken by the hypervisor and
+ * posted to the virtual APIC. This only pays off for cells that are heavy
+ * on IPIs and APIC register accesses.
+ */
+#define JAILHOUSE_CELL_AVIC		0x00000010
+
 /*
  * The flag JAILHOUSE_CELL_VIRTUAL_CONSOLE_PERMITTED allows inmates to invoke
  * the dbg putc hypercall.
@@ -40,6 +40,7 @@
 #define _JAILHOUSE_HYPERCALL_H
 
 #include <jailhouse/console.h>
+#include <jailhouse/trace-events.h>
 
 #define JAILHOUSE_HC_DISABLE			0
 #define JAILHOUSE_HC_CELL_CREATE		1
@@ -50,6 +51,10 @@
 #define JAILHOUSE_HC_CELL_GET_STATE		6
 #define JAILHOUSE_HC_CPU_GET_INFO		7
 #define JAILHOUSE_HC_DEBUG_CONSOLE_PUTC		8
+#define JAILHOUSE_HC_DEBUG_CONSOLE_WRITE	9
+
+/* maximum length of a Debug Console write */
+#define JAILHOUSE_DEBUG_CONSOLE_WRITE_MAX	4096
 
 /* Hypervisor information type */
 #define JAILHOUSE_INFO_MEM_POOL_SIZE		0
@@ -57,6 +62,10 @@
 #define JAILHOUSE_INFO_REMAP_POOL_SIZE		2
 #define JAILHOUSE_INFO_REMAP_POOL_USED		3
 #define JAILHOUSE_INFO_NUM_CELLS		4
+#define JAILHOUSE_INFO_ROOT_SUSPEND_LAST_US	5
+#define JAILHOUSE_INFO_ROOT_SUSPEND_MAX_US	6
+#define JAILHOUSE_INFO_STATS_PAGE		7
+#define JAILHOUSE_INFO_TRACE_BUFFER		8
 
 /* Hypervisor information type */
 #define JAILHOUSE_CPU_INFO_STATE		0
@@ -125,4 +134,71 @@
 
 #include <asm/jailhouse_hypercall.h>
 
+/**
+ * Statistic counters of a CPU as published in the statistics page.
+ * The owning CPU increments the counters in place. seq only brackets the
+ * reassignment of the CPU to another cell, which updates cell_id and resets
+ * the counters. Readers have to retry if seq was odd or changed while reading
+ * the slot.
+ */
+struct jailhouse_cpu_stats {
+	volatile __u32 seq;
+	/** ID of the cell the CPU is assigned to. */
+	volatile __u32 cell_id;
+	volatile __u32 stats[JAILHOUSE_NUM_CPU_STATS];
+};
+
+/**
+ * Statistics page, mapped read-only into the root cell at the offset inside
+ * the hypervisor memory reported by JAILHOUSE_INFO_STATS_PAGE.
+ */
+struct jailhouse_stats_page {
+	__u32 max_cpus;
+	__u32 num_stats;
+	struct jailhouse_cpu_stats cpu[];
+};
+
+/**
+ * Event recorded in a trace ring. Meaning of the arguments:
+ * @li VMEXIT: architecture-specific exit reason, guest instruction pointer
+ * @li VMEXIT_DONE: none
+ * @li IRQ_INJECT: vector or interrupt ID, target CPU
+ * @li HYPERCALL: hypercall code, first argument
+ * @li IVSHMEM_DOORBELL: device ID of the target endpoint, vector
+ * @li MANAGEMENT_BEGIN: none
+ * @li MANAGEMENT_END: root cell suspension time in microseconds
+ */
+struct jailhouse_trace_entry {
+	/** Timestamp in ticks, see jailhouse_trace_buffer.timestamp_khz. */
+	__u64 timestamp;
+	__u32 cpu;
+	__u32 event;
+	__u64 arg[2];
+};
+
+/**
+ * Per-CPU trace ring. The owning CPU writes entry number n into slot
+ * n % num_entries and only then increments head to n + 1. Old entries are
+ * overwritten. Readers have to discard entry n if head was larger than
+ * n + num_entries - 1 after copying it.
+ */
+struct jailhouse_trace_ring {
+	volatile __u32 head;
+	__u32 padding[7];
+	struct jailhouse_trace_entry entry[];
+};
+
+/**
+ * Trace buffer, mapped read-only into the root cell at the offset inside the
+ * hypervisor memory reported by JAILHOUSE_INFO_TRACE_BUFFER. It is followed
+ * by max_cpus rings, each with num_entries entries.
+ */
+struct jailhouse_trace_buffer {
+	__u32 max_cpus;
+	__u32 num_entries;
+	/** Frequency of the timestamps, 0 if unknown. */
+	__u32 timestamp_khz;
+	__u32 padding[5];
+};
+
 #endif /* !_JAILHOUSE_HYPERCALL_H */
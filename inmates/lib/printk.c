@@ -49,7 +49,41 @@
 static struct uart_chip *chip;
 static bool virtual_console;
 
-static void console_write_char(char c)
+/*
+ * Output to the virtual console is collected on the stack of the caller and
+ * passed to the hypervisor with a single write hypercall at the end of each
+ * console write, or earlier if the buffer runs full. This keeps CPUs that
+ * print concurrently apart. If the hypervisor lacks support for the write
+ * hypercall, we fall back to the putc hypercall.
+ */
+struct virtual_console_buf {
+	char data[128];
+	unsigned int len;
+};
+
+static bool virtual_console_putc;
+
+static void virtual_console_flush(struct virtual_console_buf *vbuf)
+{
+	unsigned int n;
+
+	if (vbuf->len == 0)
+		return;
+
+	if (!virtual_console_putc &&
+	    jailhouse_call_arg2(JAILHOUSE_HC_DEBUG_CONSOLE_WRITE,
+				(unsigned long)vbuf->data, vbuf->len) != 0)
+		virtual_console_putc = true;
+
+	if (virtual_console_putc)
+		for (n = 0; n < vbuf->len; n++)
+			jailhouse_call_arg1(JAILHOUSE_HC_DEBUG_CONSOLE_PUTC,
+					    vbuf->data[n]);
+
+	vbuf->len = 0;
+}
+
+static void console_write_char(struct virtual_console_buf *vbuf, char c)
 {
 	if (chip) {
 		while (chip->is_busy(chip))
@@ -57,27 +91,35 @@ static void console_write_char(char c)
 		chip->write(chip, c);
 	}
 
-	if (virtual_console)
-		jailhouse_call_arg1(JAILHOUSE_HC_DEBUG_CONSOLE_PUTC, c);
+	if (virtual_console) {
+		vbuf->data[vbuf->len++] = c;
+		if (vbuf->len >= sizeof(vbuf->data))
+			virtual_console_flush(vbuf);
+	}
 }
 
 static void console_write(const char *msg)
 {
+	struct virtual_console_buf vbuf;
 	char c;
 
 	if (!chip && !virtual_console)
 		return;
 
+	vbuf.len = 0;
 	while (1) {
 		c = *msg++;
 		if (!c)
 			break;
 
 		if (c == '\n')
-			console_write_char('\r');
+			console_write_char(&vbuf, '\r');
 
-		console_write_char(c);
+		console_write_char(&vbuf, c);
 	}
+
+	if (virtual_console)
+		virtual_console_flush(&vbuf);
 }
 
 static void console_init(void)
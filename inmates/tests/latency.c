@@ -0,0 +1,256 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Measures the round-trip cost of the basic hypervisor interactions of a
+ * cell: an intercepted MMIO read, a null hypercall, a self-IPI and a self-
+ * doorbell on an ivshmem device. Results are reported on the console in a
+ * machine-readable form:
+ *
+ * JAILHOUSE-LATENCY <test> samples=<n> min_ns=<n> avg_ns=<n> max_ns=<n>
+ *
+ * followed by a final "JAILHOUSE-LATENCY done" line. Tests that lack their
+ * device are skipped.
+ */
+
+#include <inmate.h>
+
+#ifdef __aarch64__
+#include <asm/sysregs.h>
+#endif
+
+#define VENDORID			0x110a
+#define DEVICEID			0x4106
+
+#define BAR_BASE			0xff000000
+
+#define JAILHOUSE_HC_INVALID		0xffff
+
+#define DEFAULT_SAMPLES			10000
+#define IRQ_TIMEOUT_NS			(10 * 1000 * 1000ULL)
+
+#if defined(__x86_64__)
+#define DEFAULT_IRQ_BASE	32
+#define IPI_IRQ			(DEFAULT_IRQ_BASE + MAX_INTERRUPT_VECTORS - 1)
+#define HAS_SELF_IPI		true
+
+static inline u64 get_time_ns(void)
+{
+	return tsc_read_ns();
+}
+
+static void send_self_ipi(void)
+{
+	irq_send_ipi(cpu_id(), IPI_IRQ);
+}
+#elif defined(__aarch64__)
+#define DEFAULT_IRQ_BASE	(comm_region->vpci_irq_base + 32)
+#define IPI_IRQ			1
+/* self-SGIs are only implemented via the GICv3 system register interface */
+#define HAS_SELF_IPI		(comm_region->gic_version == 3)
+
+#define ICC_SGI1R_EL1		SYSREG_32(0, c12, c11, 5)
+
+static inline u64 get_time_ns(void)
+{
+	return timer_ticks_to_ns(timer_get_ticks());
+}
+
+static void send_self_ipi(void)
+{
+	unsigned long mpidr;
+
+	arm_read_sysreg(MPIDR, mpidr);
+	arm_write_sysreg(ICC_SGI1R_EL1,
+			 (u64)MPIDR_AFFINITY_LEVEL(mpidr, 3) << 48 |
+			 (u64)MPIDR_AFFINITY_LEVEL(mpidr, 2) << 32 |
+			 (u64)IPI_IRQ << 24 |
+			 MPIDR_AFFINITY_LEVEL(mpidr, 1) << 16 |
+			 1 << (MPIDR_AFFINITY_LEVEL(mpidr, 0) & 0xf));
+}
+#else
+#error Not implemented!
+#endif
+
+struct ivshm_regs {
+	u32 id;
+	u32 max_peers;
+	u32 int_control;
+	u32 doorbell;
+	u32 state;
+};
+
+struct latency {
+	unsigned int samples;
+	u64 min, max, sum;
+};
+
+static struct ivshm_regs *ivshm_regs;
+static unsigned int irq_base;
+static volatile unsigned int irq_count;
+
+static void irq_handler(unsigned int irq)
+{
+	irq_count++;
+}
+
+static void latency_add(struct latency *lat, u64 delta)
+{
+	if (lat->samples == 0 || delta < lat->min)
+		lat->min = delta;
+	if (delta > lat->max)
+		lat->max = delta;
+	lat->sum += delta;
+	lat->samples++;
+}
+
+static void latency_report(const char *test, struct latency *lat)
+{
+	if (lat->samples == 0) {
+		printk("JAILHOUSE-LATENCY %s failed\n", test);
+		return;
+	}
+	printk("JAILHOUSE-LATENCY %s samples=%u min_ns=%llu avg_ns=%llu "
+	       "max_ns=%llu\n", test, lat->samples, lat->min,
+	       lat->sum / lat->samples, lat->max);
+}
+
+/* Wait for irq_count to reach the given value, false on timeout. */
+static bool wait_for_irq(unsigned int count)
+{
+	u64 start = get_time_ns();
+
+	while (irq_count != count) {
+		cpu_relax();
+		if (get_time_ns() - start > IRQ_TIMEOUT_NS)
+			return false;
+	}
+	return true;
+}
+
+static void measure_mmio(unsigned int samples)
+{
+	struct latency lat = { };
+	u64 start;
+
+	while (samples-- > 0) {
+		start = get_time_ns();
+		mmio_read32(&ivshm_regs->id);
+		latency_add(&lat, get_time_ns() - start);
+	}
+	latency_report("mmio", &lat);
+}
+
+static void measure_hypercall(unsigned int samples)
+{
+	struct latency lat = { };
+	u64 start;
+
+	while (samples-- > 0) {
+		start = get_time_ns();
+		jailhouse_call(JAILHOUSE_HC_INVALID);
+		latency_add(&lat, get_time_ns() - start);
+	}
+	latency_report("hypercall", &lat);
+}
+
+static void measure_ipi(unsigned int samples)
+{
+	struct latency lat = { };
+	unsigned int count;
+	u64 start;
+
+	irq_enable(IPI_IRQ);
+	while (samples-- > 0) {
+		count = irq_count + 1;
+		start = get_time_ns();
+		send_self_ipi();
+		if (!wait_for_irq(count)) {
+			lat.samples = 0;
+			break;
+		}
+		latency_add(&lat, get_time_ns() - start);
+	}
+	latency_report("ipi", &lat);
+}
+
+static void measure_doorbell(unsigned int samples, u32 id)
+{
+	struct latency lat = { };
+	unsigned int count;
+	u64 start;
+
+	while (samples-- > 0) {
+		count = irq_count + 1;
+		start = get_time_ns();
+		mmio_write32(&ivshm_regs->doorbell, id << 16);
+		if (!wait_for_irq(count)) {
+			lat.samples = 0;
+			break;
+		}
+		latency_add(&lat, get_time_ns() - start);
+	}
+	latency_report("doorbell", &lat);
+}
+
+static bool init_ivshmem(void)
+{
+	int bdf, msix_cap;
+
+	bdf = pci_find_device(VENDORID, DEVICEID, 0);
+	if (bdf < 0)
+		return false;
+
+	ivshm_regs = (struct ivshm_regs *)BAR_BASE;
+	pci_write_config(bdf, PCI_CFG_BAR, BAR_BASE, 4);
+	pci_write_config(bdf, PCI_CFG_BAR + 4, BAR_BASE + PAGE_SIZE, 4);
+	pci_write_config(bdf, PCI_CFG_COMMAND, PCI_CMD_MEM | PCI_CMD_MASTER,
+			 2);
+	map_range((void *)BAR_BASE, 2 * PAGE_SIZE, MAP_UNCACHED);
+
+	/* vector 0, either via MSI-X or INTx */
+	msix_cap = pci_find_cap(bdf, PCI_CAP_MSIX);
+	if (msix_cap > 0)
+		pci_msix_set_vector(bdf, irq_base, 0);
+	irq_enable(irq_base);
+
+	mmio_write32(&ivshm_regs->int_control, 1);
+
+	return true;
+}
+
+void inmate_main(void)
+{
+	unsigned int samples;
+	bool has_ivshmem;
+
+	samples = cmdline_parse_int("samples", DEFAULT_SAMPLES);
+	irq_base = cmdline_parse_int("irq_base", DEFAULT_IRQ_BASE);
+
+#ifdef __x86_64__
+	tsc_init();
+#endif
+	irq_init(irq_handler);
+	pci_init();
+	enable_irqs();
+
+	has_ivshmem = init_ivshmem();
+	if (!has_ivshmem)
+		printk("JAILHOUSE-LATENCY: no ivshmem device, skipping mmio "
+		       "and doorbell\n");
+
+	if (has_ivshmem)
+		measure_mmio(samples);
+	measure_hypercall(samples);
+	if (HAS_SELF_IPI)
+		measure_ipi(samples);
+	if (has_ivshmem)
+		measure_doorbell(samples, mmio_read32(&ivshm_regs->id));
+
+	printk("JAILHOUSE-LATENCY done\n");
+	stop();
+}
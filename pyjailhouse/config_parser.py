@@ -180,8 +180,12 @@ class CellConfig:
             self.name = str(name.decode().strip('\0'))
             self.arch = convert_arch(self.arch)
 
-            mem_region_offs = struct.calcsize(CellConfig._HEADER_FORMAT) + \
-                self.cpu_set_size
+            cpu_set_offs = struct.calcsize(CellConfig._HEADER_FORMAT)
+            self.cpu_set = int.from_bytes(
+                self.data[cpu_set_offs:cpu_set_offs + self.cpu_set_size],
+                byteorder='little')
+
+            mem_region_offs = cpu_set_offs + self.cpu_set_size
             self.memory_regions = []
             for n in range(self.num_memory_regions):
                 self.memory_regions.append(
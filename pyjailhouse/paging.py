@@ -0,0 +1,71 @@
+#
+# Jailhouse, a Linux-based partitioning hypervisor
+#
+# Copyright (c) Siemens AG, 2026
+#
+# This work is licensed under the terms of the GNU GPL, version 2.  See
+# the COPYING file in the top-level directory.
+#
+# Estimation of the page table footprint of memory regions, shared by the
+# config helper scripts.
+
+PAGE_SIZE = 0x1000
+HUGE_PAGE_SIZES = [1 << 30, 1 << 21]
+PAGE_TABLE_ENTRIES = 512
+
+
+def size_str(size):
+    for unit, shift in (("GiB", 30), ("MiB", 20), ("KiB", 10)):
+        if size >= 1 << shift and size % (1 << shift) == 0:
+            return "%d %s" % (size >> shift, unit)
+    return "0x%x bytes" % size
+
+
+def align_up(value, alignment):
+    return -(-value // alignment) * alignment
+
+
+def align_down(value, alignment):
+    return value // alignment * alignment
+
+
+class Mapping:
+    """Estimate of the stage-2 page table entries for a memory region.
+
+    Follows the strategy of paging_create in the hypervisor: always use the
+    largest page that fits the remaining size and to which both the physical
+    and the virtual address are aligned.
+    """
+    def __init__(self, phys, virt, size, hugepages=True):
+        sizes = (HUGE_PAGE_SIZES if hugepages else []) + [PAGE_SIZE]
+        self.entries = dict.fromkeys(sizes, 0)
+        self.tables = 0
+
+        size = align_up(size, PAGE_SIZE)
+        while size > 0:
+            page_size = next(ps for ps in sizes
+                             if ps <= size and (phys | virt) & (ps - 1) == 0)
+            count = size // page_size
+            # stop where a larger page becomes usable
+            for larger in sizes:
+                if larger <= page_size or (phys - virt) % larger != 0:
+                    continue
+                distance = -virt % larger
+                if distance > 0:
+                    count = min(count, distance // page_size)
+
+            self.entries[page_size] += count
+            span = page_size * PAGE_TABLE_ENTRIES
+            self.tables += (virt + count * page_size - 1) // span - \
+                virt // span + 1
+
+            phys += count * page_size
+            virt += count * page_size
+            size -= count * page_size
+
+    def total(self):
+        return sum(self.entries.values())
+
+    def __str__(self):
+        return ", ".join("%d x %s" % (count, size_str(size))
+                         for size, count in self.entries.items() if count)
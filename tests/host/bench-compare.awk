@@ -0,0 +1,34 @@
+#
+# Jailhouse, a Linux-based partitioning hypervisor
+#
+# Copyright (c) Siemens AG, 2026
+#
+# This work is licensed under the terms of the GNU GPL, version 2.  See
+# the COPYING file in the top-level directory.
+#
+# Compare benchmark results against a baseline.
+#
+# Usage: awk -v tolerance=PERCENT -f bench-compare.awk BASELINE RESULTS
+#
+
+FNR == NR {
+	baseline[$2] = $3
+	next
+}
+
+$2 in baseline {
+	change = ($3 - baseline[$2]) * 100 / baseline[$2]
+	status = change > tolerance ? "REGRESSION" : "ok"
+	printf("%-10s %s %.2f -> %.2f ns/op (%+.1f%%)\n", status, $2,
+	       baseline[$2], $3, change)
+	if (change > tolerance)
+		regressions++
+}
+
+END {
+	if (regressions) {
+		printf("%d benchmark(s) regressed by more than %d%%\n",
+		       regressions, tolerance)
+		exit 1
+	}
+}
@@ -0,0 +1,486 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Differential fuzzing of the x86 MMIO instruction decoder against a
+ * table-driven reference decoder.
+ *
+ * The reference decodes the instruction set x86_mmio_parse is meant to
+ * support: MOV between registers or immediates and memory, MOVZX and MOV
+ * with moffs, with operand and address size prefixes and REX in all guest
+ * modes. Anything else must be rejected by the decoder.
+ *
+ * Input format, also used for libFuzzer and for replaying files:
+ *   byte 0, bit 0:    EFER.LMA
+ *           bit 1:    CS.L
+ *           bit 2:    CS.DB
+ *           bit 3:    write access
+ *           bits 4-7: number of bytes before a page boundary, 0 for none
+ *   bytes 1..15:      instruction bytes, following bytes are ignored
+ */
+
+#include <jailhouse/string.h>
+#include <asm/processor.h>
+#include <asm/vcpu.h>
+
+#include "host.h"
+#include "x86-guest.h"
+
+#define X86_MAX_INST_LEN	15
+
+#define DIFF_ITERATIONS		500000
+#define BENCH_CORPUS		512
+
+/* opcode properties, instructions without REF_MOFFS have a ModRM byte */
+#define REF_WRITE		(1 << 0)
+#define REF_BYTE_REG		(1 << 1)
+#define REF_ZX8			(1 << 2)
+#define REF_ZX16		(1 << 3)
+#define REF_IMM			(1 << 4)
+#define REF_MOFFS		(1 << 5)
+#define REF_NO_REG		(1 << 6)
+
+struct ref_opcode {
+	u8 bytes[2];
+	unsigned int len;
+	unsigned int flags;
+};
+
+static const struct ref_opcode ref_opcodes[] = {
+	{ { 0x88 }, 1, REF_BYTE_REG | REF_WRITE },
+	{ { 0x89 }, 1, REF_WRITE },
+	{ { 0x8a }, 1, REF_BYTE_REG },
+	{ { 0x8b }, 1, 0 },
+	{ { 0xc7 }, 1, REF_NO_REG | REF_IMM | REF_WRITE },
+	{ { 0xa1 }, 1, REF_MOFFS },
+	{ { 0xa3 }, 1, REF_MOFFS | REF_WRITE },
+	{ { 0x0f, 0xb6 }, 2, REF_ZX8 },
+	{ { 0x0f, 0xb7 }, 2, REF_ZX16 },
+};
+
+enum ref_result {
+	/* valid and supported, the decoder must return the same */
+	REF_OK,
+	/* unsupported, inconsistent or truncated, the decoder must fail */
+	REF_REJECT,
+	/* cannot cause an MMIO exit at this address, nothing to compare */
+	REF_IMPOSSIBLE,
+};
+
+struct ref_input {
+	const u8 *bytes;
+	unsigned int avail;
+	bool long_mode;
+	bool cs_db;
+	bool is_write;
+};
+
+/* mask of the bits a read of the given width leaves alone */
+static unsigned long ref_preserve_mask(unsigned int width)
+{
+	return width < 4 ? ~((1UL << (width * 8)) - 1) : 0;
+}
+
+/*
+ * Bytes are only available up to ref->avail. Bytes of displacements and
+ * moffs addresses are never needed to decode an instruction, the others
+ * are.
+ */
+static enum ref_result ref_byte(const struct ref_input *ref,
+				unsigned int pos, u8 *byte)
+{
+	if (pos >= X86_MAX_INST_LEN)
+		return REF_IMPOSSIBLE;
+	if (pos >= ref->avail)
+		return REF_REJECT;
+	*byte = ref->bytes[pos];
+	return REF_OK;
+}
+
+static enum ref_result ref_decode(const struct ref_input *ref,
+				  struct mmio_instruction *inst)
+{
+	const struct ref_opcode *opcode = NULL;
+	unsigned int pos = 0, n, osz, asz, regno, disp = 0, imm = 0;
+	bool opsz = false, addrsz = false;
+	u8 byte, op[2] = { }, rex = 0, modrm, sib;
+	enum ref_result res;
+
+	while (1) {
+		res = ref_byte(ref, pos, &byte);
+		if (res != REF_OK)
+			return res;
+		if (byte == 0x66 || byte == 0x67) {
+			if (byte == 0x66)
+				opsz = true;
+			else
+				addrsz = true;
+			/* REX only counts right before the opcode */
+			rex = 0;
+		} else if ((byte & 0xf0) == 0x40) {
+			/* INC/DEC outside of 64-bit mode, no memory access */
+			if (!ref->long_mode)
+				return REF_IMPOSSIBLE;
+			rex = byte;
+		} else {
+			break;
+		}
+		pos++;
+	}
+
+	op[0] = byte;
+	if (op[0] == 0x0f) {
+		res = ref_byte(ref, pos + 1, &op[1]);
+		if (res != REF_OK)
+			return res;
+	}
+	for (n = 0; n < ARRAY_SIZE(ref_opcodes); n++)
+		if (op[0] == ref_opcodes[n].bytes[0] &&
+		    (ref_opcodes[n].len == 1 ||
+		     op[1] == ref_opcodes[n].bytes[1]))
+			opcode = &ref_opcodes[n];
+	if (!opcode)
+		return REF_REJECT;
+	pos += opcode->len;
+
+	/* REX.X is not supported, even if no index register is used */
+	if (rex & 0x2)
+		return REF_REJECT;
+
+	if (rex & 0x8)
+		osz = 8;
+	else if (ref->long_mode)
+		osz = opsz ? 2 : 4;
+	else
+		osz = (ref->cs_db ^ opsz) ? 4 : 2;
+	if (ref->long_mode)
+		asz = addrsz ? 4 : 8;
+	else
+		asz = (ref->cs_db ^ addrsz) ? 4 : 2;
+
+	if (opcode->flags & (REF_BYTE_REG | REF_ZX8))
+		inst->access_size = 1;
+	else if (opcode->flags & REF_ZX16)
+		inst->access_size = 2;
+	else
+		inst->access_size = osz;
+
+	if (opcode->flags & REF_MOFFS) {
+		inst->inst_len = pos + asz;
+		inst->in_reg_num = 15; /* RAX */
+		goto done;
+	}
+
+	res = ref_byte(ref, pos++, &modrm);
+	if (res != REF_OK)
+		return res;
+	if ((modrm >> 6) == 3)
+		return REF_REJECT;
+
+	if (asz == 2) {
+		if ((modrm >> 6) == 1)
+			disp = 1;
+		else if ((modrm >> 6) == 2 || (modrm & 7) == 6)
+			disp = 2;
+	} else {
+		if ((modrm & 7) == 4) {
+			if ((modrm >> 6) == 0) {
+				res = ref_byte(ref, pos, &sib);
+				if (res != REF_OK)
+					return res;
+				if ((sib & 7) == 5)
+					disp = 4;
+			}
+			pos++;
+		}
+		if ((modrm >> 6) == 1)
+			disp = 1;
+		else if ((modrm >> 6) == 2 ||
+			 ((modrm >> 6) == 0 && (modrm & 7) == 5))
+			disp = 4;
+	}
+	pos += disp;
+
+	regno = ((modrm >> 3) & 7) | (rex & 0x4 ? 8 : 0);
+	if (opcode->flags & REF_NO_REG) {
+		if (regno & 7)
+			return REF_REJECT;
+		regno = 0;
+	} else if (regno == 4) {
+		/* SP or AH as source or destination is not supported */
+		return REF_REJECT;
+	} else if (opcode->flags & REF_BYTE_REG && !rex && regno > 4) {
+		/* CH, DH and BH are not supported */
+		return REF_REJECT;
+	}
+	inst->in_reg_num = 15 - regno;
+
+	if (opcode->flags & REF_IMM) {
+		imm = osz == 2 ? 2 : 4;
+		for (n = 0; n < imm; n++) {
+			res = ref_byte(ref, pos + n, &byte);
+			if (res != REF_OK)
+				return res;
+			inst->out_val |= (unsigned long)byte << (n * 8);
+		}
+		if (osz == 8)
+			inst->out_val = (s64)(s32)inst->out_val;
+		pos += imm;
+	}
+	inst->inst_len = pos;
+
+done:
+	if (inst->inst_len > X86_MAX_INST_LEN)
+		return REF_IMPOSSIBLE;
+
+	if (!!(opcode->flags & REF_WRITE) != ref->is_write)
+		return REF_REJECT;
+
+	if (ref->is_write) {
+		if (!(opcode->flags & REF_IMM))
+			inst->out_val = REG(inst->in_reg_num);
+	} else if (opcode->flags & (REF_ZX8 | REF_ZX16)) {
+		/* the destination register is osz wide */
+		inst->reg_preserve_mask = ref_preserve_mask(osz);
+	} else {
+		inst->reg_preserve_mask =
+			ref_preserve_mask(inst->access_size);
+	}
+
+	return REF_OK;
+}
+
+static void log_input(const char *what, const u8 *data, unsigned long size)
+{
+	unsigned long n;
+
+	host_log("%s: control 0x%02x, bytes", what, data[0]);
+	for (n = 1; n < size && n <= X86_MAX_INST_LEN; n++)
+		host_log(" %02x", data[n]);
+	host_log("\n");
+}
+
+static void log_inst(const char *what, const struct mmio_instruction *inst)
+{
+	host_log("  %s: len %u, size %u, reg %u, value 0x%lx, mask 0x%lx\n",
+		 what, inst->inst_len, inst->access_size, inst->in_reg_num,
+		 inst->out_val, inst->reg_preserve_mask);
+}
+
+static void setup_input(const u8 *data, unsigned long size,
+			struct ref_input *ref, unsigned long *rip)
+{
+	unsigned int split = data[0] >> 4;
+
+	ref->bytes = &data[1];
+	ref->avail = MIN(size - 1, X86_MAX_INST_LEN);
+	ref->long_mode = (data[0] & 0x1) && (data[0] & 0x2);
+	ref->cs_db = !!(data[0] & 0x4);
+	ref->is_write = !!(data[0] & 0x8);
+
+	guest_efer = data[0] & 0x1 ? EFER_LMA : 0;
+	guest_cs_attr = (data[0] & 0x2 ? VCPU_CS_L : 0) |
+		(data[0] & 0x4 ? VCPU_CS_DB : 0);
+
+	*rip = split ? GUEST_CODE + PAGE_SIZE - split : GUEST_CODE + 0x100;
+}
+
+/* Returns false if the decoder and the reference disagree. */
+static bool check_input(const u8 *data, unsigned long size)
+{
+	struct mmio_instruction expected = { 0 }, inst;
+	struct ref_input ref;
+	enum ref_result res;
+	unsigned long rip;
+	bool ok;
+
+	if (size < 1)
+		return true;
+
+	setup_input(data, size, &ref, &rip);
+
+	/* CS.L and CS.DB together are reserved in long mode */
+	if (ref.long_mode && ref.cs_db)
+		return true;
+
+	res = ref_decode(&ref, &expected);
+	if (res == REF_IMPOSSIBLE)
+		return true;
+
+	inst = guest_parse(ref.bytes, ref.avail, rip, ref.is_write);
+
+	if (res == REF_REJECT) {
+		ok = inst.inst_len == 0;
+	} else {
+		ok = inst.inst_len == expected.inst_len &&
+			inst.access_size == expected.access_size;
+		if (ref.is_write)
+			ok = ok && inst.out_val == expected.out_val;
+		else
+			ok = ok && inst.in_reg_num == expected.in_reg_num &&
+				inst.reg_preserve_mask ==
+				expected.reg_preserve_mask;
+	}
+
+	if (!ok) {
+		log_input("decoder mismatch", data, size);
+		if (res == REF_REJECT)
+			host_log("  expected: rejection\n");
+		else
+			log_inst("expected", &expected);
+		log_inst("decoded", &inst);
+	}
+	return ok;
+}
+
+int LLVMFuzzerTestOneInput(const unsigned char *data, unsigned long size)
+{
+	static bool initialized;
+
+	if (!initialized) {
+		guest_init();
+		initialized = true;
+	}
+
+	if (!check_input(data, size))
+		__builtin_trap();
+	return 0;
+}
+
+/*
+ * Random inputs close to the supported instructions, so that most of them
+ * get past the prefixes and opcodes.
+ */
+static unsigned int generate_input(u8 *data)
+{
+	static const u8 prefixes[] = {
+		0x66, 0x67, 0x40, 0x41, 0x44, 0x48, 0x4c, 0x42, 0xf0, 0x2e,
+	};
+	unsigned int n, size = 0, num_prefixes;
+	const struct ref_opcode *opcode;
+
+	data[size++] = host_random();
+
+	num_prefixes = host_random() % 8;
+	num_prefixes = num_prefixes < 4 ? num_prefixes : 0;
+	for (n = 0; n < num_prefixes; n++)
+		data[size++] = prefixes[host_random() % ARRAY_SIZE(prefixes)];
+
+	if (host_random() % 8) {
+		opcode = &ref_opcodes[host_random() % ARRAY_SIZE(ref_opcodes)];
+		for (n = 0; n < opcode->len; n++)
+			data[size++] = opcode->bytes[n];
+	}
+
+	while (size < 1 + X86_MAX_INST_LEN)
+		data[size++] = host_random();
+
+	/* occasionally cut the instruction short */
+	if (host_random() % 8 == 0)
+		size = 1 + host_random() % X86_MAX_INST_LEN;
+
+	return size;
+}
+
+static void test_differential(void)
+{
+	u8 data[1 + X86_MAX_INST_LEN];
+	unsigned int n, size, mismatches = 0;
+
+	guest_init();
+	for (n = 0; n < DIFF_ITERATIONS && mismatches < 10; n++) {
+		size = generate_input(data);
+		if (!check_input(data, size))
+			mismatches++;
+	}
+	CHECK_EQ(mismatches, 0);
+}
+
+static void test_reference(void)
+{
+	/* known answers, to catch a reference that agrees for wrong reasons */
+	static const struct {
+		u8 data[1 + X86_MAX_INST_LEN];
+		unsigned int size;
+		unsigned int inst_len;
+	} answers[] = {
+		/* mov %eax,0x10(%rax,%rbx,1) */
+		{ { 0x0b, 0x89, 0x44, 0x18, 0x10 }, 5, 4 },
+		/* mov 0x12345678(,%rbx,1),%r9 */
+		{ { 0x03, 0x4c, 0x8b, 0x0c, 0x1d, 0x78, 0x56, 0x34, 0x12 }, 9,
+		  8 },
+		/* movw $0x1234,0x10(%bx) in 16-bit mode */
+		{ { 0x08, 0xc7, 0x47, 0x10, 0x34, 0x12 }, 6, 5 },
+		/* mov %eax,0x12345678 in 64-bit mode */
+		{ { 0x0b, 0xa3, 0x78, 0x56, 0x34, 0x12, 0, 0, 0, 0 }, 10, 9 },
+		/* movzwl 0x1000(%ebx),%edx in compatibility mode */
+		{ { 0x05, 0x0f, 0xb7, 0x93, 0x00, 0x10, 0x00, 0x00 }, 8, 7 },
+	};
+	struct mmio_instruction inst;
+	struct ref_input ref;
+	unsigned long rip;
+	unsigned int n;
+
+	guest_init();
+	for (n = 0; n < ARRAY_SIZE(answers); n++) {
+		inst = (struct mmio_instruction){ 0 };
+		setup_input(answers[n].data, answers[n].size, &ref, &rip);
+		CHECK_EQ(ref_decode(&ref, &inst), REF_OK);
+		CHECK_EQ(inst.inst_len, answers[n].inst_len);
+		CHECK(check_input(answers[n].data, answers[n].size));
+	}
+}
+
+static struct {
+	u64 efer;
+	u16 cs_attr;
+	bool is_write;
+} bench_corpus[BENCH_CORPUS];
+
+static void bench_random(unsigned long iterations)
+{
+	struct mmio_instruction inst;
+	u8 data[1 + X86_MAX_INST_LEN];
+	struct ref_input ref;
+	unsigned int n, size;
+	unsigned long rip;
+
+	/* valid instructions in random modes, one per 16 bytes */
+	guest_init();
+	for (n = 0; n < BENCH_CORPUS; ) {
+		size = generate_input(data);
+		data[0] &= 0x0f;
+		setup_input(data, size, &ref, &rip);
+		inst = (struct mmio_instruction){ 0 };
+		if ((ref.long_mode && ref.cs_db) ||
+		    ref_decode(&ref, &inst) != REF_OK)
+			continue;
+
+		memcpy(&guest_code[n * 16], ref.bytes, ref.avail);
+		bench_corpus[n].efer = guest_efer;
+		bench_corpus[n].cs_attr = guest_cs_attr;
+		bench_corpus[n].is_write = ref.is_write;
+		n++;
+	}
+	guest_code_end = GUEST_CODE_END;
+
+	for (n = 0; iterations-- > 0; n = (n + 1) % BENCH_CORPUS) {
+		guest_rip = GUEST_CODE + n * 16;
+		guest_efer = bench_corpus[n].efer;
+		guest_cs_attr = bench_corpus[n].cs_attr;
+		host_keep(x86_mmio_parse(NULL,
+					 bench_corpus[n].is_write).inst_len);
+	}
+}
+
+void host_main(void)
+{
+	host_test("reference", test_reference);
+	host_test("differential", test_differential);
+
+	host_bench("x86_mmio_parse_random", bench_random);
+}
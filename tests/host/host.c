@@ -0,0 +1,250 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Host runtime for the unit tests and micro-benchmarks: test and benchmark
+ * drivers, memory helpers and replacements for the hypervisor console.
+ */
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "host.h"
+
+/* run each benchmark for at least this long */
+#define BENCH_MIN_NS		50000000ULL
+#define BENCH_RUNS		3
+
+static const char *program;
+static const char *current_test;
+static unsigned int failed_checks;
+static unsigned int failed_tests;
+static unsigned int passed_tests;
+static int run_benchmarks = 1;
+static int verbose;
+static unsigned long long random_state = 0x4a61696c686f7573ULL;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void host_test(const char *name, host_test_fn test)
+{
+	unsigned int failed_before = failed_checks;
+
+	current_test = name;
+	test();
+	current_test = NULL;
+
+	if (failed_checks == failed_before) {
+		printf("PASS %s/%s\n", program, name);
+		passed_tests++;
+	} else {
+		printf("FAIL %s/%s\n", program, name);
+		failed_tests++;
+	}
+}
+
+void host_bench(const char *name, host_bench_fn bench)
+{
+	unsigned long long start, elapsed, best = 0;
+	unsigned long iterations = 1;
+	unsigned int run;
+
+	if (!run_benchmarks)
+		return;
+
+	/* calibrate */
+	while (1) {
+		start = now_ns();
+		bench(iterations);
+		elapsed = now_ns() - start;
+		if (elapsed >= BENCH_MIN_NS / 4)
+			break;
+		iterations *= 2;
+	}
+	iterations = iterations * (BENCH_MIN_NS / elapsed + 1);
+
+	for (run = 0; run < BENCH_RUNS; run++) {
+		start = now_ns();
+		bench(iterations);
+		elapsed = now_ns() - start;
+		if (run == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	printf("BENCH %s/%s %.2f ns/op\n", program, name,
+	       (double)best / iterations);
+}
+
+void host_check(int cond, const char *expr, const char *file, int line)
+{
+	if (cond)
+		return;
+
+	printf("  %s:%d: %s: check failed: %s\n", file, line,
+	       current_test ? current_test : program, expr);
+	failed_checks++;
+}
+
+void host_check_eq(unsigned long long value, unsigned long long expected,
+		   const char *expr, const char *file, int line)
+{
+	if (value == expected)
+		return;
+
+	printf("  %s:%d: %s: %s is 0x%llx, expected 0x%llx\n", file, line,
+	       current_test ? current_test : program, expr, value, expected);
+	failed_checks++;
+}
+
+void *host_alloc_pages(unsigned long pages)
+{
+	void *addr = aligned_alloc(4096, pages * 4096);
+
+	if (!addr) {
+		fprintf(stderr, "%s: out of memory\n", program);
+		exit(2);
+	}
+	return memset(addr, 0, pages * 4096);
+}
+
+void host_free_pages(void *addr, unsigned long pages)
+{
+	free(addr);
+}
+
+void *host_map_fixed(unsigned long address, unsigned long size)
+{
+	void *addr = mmap((void *)address, size, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+			  -1, 0);
+
+	if (addr != (void *)address) {
+		fprintf(stderr, "%s: cannot map 0x%lx\n", program, address);
+		exit(2);
+	}
+	return addr;
+}
+
+unsigned long long host_random(void)
+{
+	/* xorshift64*, deterministic unless HOST_SEED is given */
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return random_state * 0x2545f4914f6cdd1dULL;
+}
+
+void host_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+/* Replacements for the hypervisor console, quiet unless -v is given */
+
+void printk(const char *fmt, ...);
+void panic_printk(const char *fmt, ...);
+
+void printk(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!verbose)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+void panic_printk(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!verbose)
+		return;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+#ifndef HOST_LIBFUZZER
+int LLVMFuzzerTestOneInput(const unsigned char *data, unsigned long size)
+	__attribute__((weak));
+
+/* replay fuzzer inputs, e.g. crashes found by libFuzzer or AFL */
+static int run_inputs(int count, char *paths[])
+{
+	static unsigned char data[1 << 16];
+	size_t size;
+	FILE *file;
+	int n;
+
+	if (!LLVMFuzzerTestOneInput) {
+		fprintf(stderr, "%s: no fuzzing entry point\n", program);
+		return 2;
+	}
+
+	for (n = 0; n < count; n++) {
+		file = fopen(paths[n], "rb");
+		if (!file) {
+			perror(paths[n]);
+			return 2;
+		}
+		size = fread(data, 1, sizeof(data), file);
+		fclose(file);
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	printf("%s: %d inputs passed\n", program, count);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *seed = getenv("HOST_SEED");
+	int n;
+
+	program = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+
+	for (n = 1; n < argc; n++) {
+		if (strcmp(argv[n], "--no-bench") == 0) {
+			run_benchmarks = 0;
+		} else if (strcmp(argv[n], "-v") == 0) {
+			verbose = 1;
+		} else if (argv[n][0] == '-') {
+			fprintf(stderr,
+				"usage: %s [--no-bench] [-v] [INPUT...]\n",
+				program);
+			return 2;
+		} else {
+			return run_inputs(argc - n, &argv[n]);
+		}
+	}
+
+	if (seed)
+		random_state = strtoull(seed, NULL, 0) | 1;
+
+	host_main();
+
+	printf("%s: %u passed, %u failed\n", program, passed_tests,
+	       failed_tests);
+	return failed_tests ? 1 : 0;
+}
+#endif /* !HOST_LIBFUZZER */
@@ -0,0 +1,57 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Interface between hypervisor code built for the host and the host runtime.
+ * Test programs are compiled against the hypervisor headers and must not
+ * include any libc header, so everything they need from the host is provided
+ * here.
+ */
+
+#ifndef _JAILHOUSE_TESTS_HOST_H
+#define _JAILHOUSE_TESTS_HOST_H
+
+typedef void (*host_test_fn)(void);
+typedef void (*host_bench_fn)(unsigned long iterations);
+
+/* Implemented by each test program, registers its tests and benchmarks. */
+void host_main(void);
+
+void host_test(const char *name, host_test_fn test);
+void host_bench(const char *name, host_bench_fn bench);
+
+void host_check(int cond, const char *expr, const char *file, int line);
+void host_check_eq(unsigned long long value, unsigned long long expected,
+		   const char *expr, const char *file, int line);
+
+void *host_alloc_pages(unsigned long pages);
+void host_free_pages(void *addr, unsigned long pages);
+void *host_map_fixed(unsigned long address, unsigned long size);
+
+unsigned long long host_random(void);
+
+void host_log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/*
+ * Optional libFuzzer-style entry point. Files given on the command line are
+ * passed to it instead of running host_main. Must not return on failures.
+ */
+int LLVMFuzzerTestOneInput(const unsigned char *data, unsigned long size);
+
+#define CHECK(cond)							\
+	host_check(!!(cond), #cond, __FILE__, __LINE__)
+
+#define CHECK_EQ(value, expected)					\
+	host_check_eq((unsigned long long)(value),			\
+		      (unsigned long long)(expected), #value, __FILE__,	\
+		      __LINE__)
+
+/* Keep the compiler from optimizing away results of benchmarked code. */
+#define host_keep(value)						\
+	asm volatile("" : : "r" (value) : "memory")
+
+#endif /* !_JAILHOUSE_TESTS_HOST_H */
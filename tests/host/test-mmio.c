@@ -0,0 +1,247 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Tests and benchmarks for the MMIO region dispatcher. The source is included
+ * to reach the static find_region().
+ */
+
+#include "../../hypervisor/mmio.c"
+
+#include "host.h"
+
+#define MAX_REGIONS		256
+#define LOOKUPS			1024
+
+static struct cell test_cell;
+static unsigned long lookup_address[LOOKUPS];
+
+static enum mmio_result test_handler(void *arg, struct mmio_access *mmio)
+{
+	mmio->value = (unsigned long)arg + mmio->address;
+	return MMIO_HANDLED;
+}
+
+static void test_cell_init(struct cell *cell, unsigned int max_regions)
+{
+	cell->max_mmio_regions = max_regions;
+	cell->num_mmio_regions = 0;
+	cell->mmio_generation = 0;
+	cell->mmio_locations = host_alloc_pages(
+		PAGES(max_regions * sizeof(struct mmio_region_location)));
+	cell->mmio_handlers = host_alloc_pages(
+		PAGES(max_regions * sizeof(struct mmio_region_handler)));
+}
+
+static void test_cell_exit(struct cell *cell)
+{
+	host_free_pages(cell->mmio_locations,
+		PAGES(cell->max_mmio_regions *
+		      sizeof(struct mmio_region_location)));
+	host_free_pages(cell->mmio_handlers,
+		PAGES(cell->max_mmio_regions *
+		      sizeof(struct mmio_region_handler)));
+}
+
+/*
+ * Register regions with random sizes and gaps, in random order. Returns the
+ * end of the covered address range.
+ */
+static unsigned long register_random_regions(struct cell *cell,
+					     unsigned int num)
+{
+	static struct mmio_region_location regions[MAX_REGIONS];
+	unsigned long address = 0x10000000;
+	struct mmio_region_location tmp;
+	unsigned int n, other;
+
+	for (n = 0; n < num; n++) {
+		address += (host_random() % 4) * 0x1000;
+		regions[n].start = address;
+		regions[n].size = (host_random() % 16 + 1) * 0x100;
+		address += regions[n].size;
+	}
+	for (n = 0; n < num; n++) {
+		other = host_random() % num;
+		tmp = regions[n];
+		regions[n] = regions[other];
+		regions[other] = tmp;
+	}
+	for (n = 0; n < num; n++)
+		mmio_region_register(cell, regions[n].start, regions[n].size,
+				     test_handler, (void *)regions[n].start);
+
+	return address;
+}
+
+static int find_region_linear(struct cell *cell, unsigned long address,
+			      unsigned int size)
+{
+	struct mmio_region_location *region;
+	unsigned int n;
+
+	for (n = 0; n < cell->num_mmio_regions; n++) {
+		region = &cell->mmio_locations[n];
+		if (address >= region->start &&
+		    address + size <= region->start + region->size)
+			return n;
+	}
+	return -1;
+}
+
+static void check_lookups(struct cell *cell, unsigned long end)
+{
+	unsigned long address, region_base;
+	struct mmio_region_handler handler;
+	unsigned int n, size;
+	int index;
+
+	for (n = 0; n < 20000; n++) {
+		address = 0x10000000 - 0x100 +
+			host_random() % (end - 0x10000000 + 0x200);
+		size = 1 << (host_random() % 4);
+
+		index = find_region(cell, address, size, &region_base,
+				    &handler);
+		CHECK_EQ(index, find_region_linear(cell, address, size));
+		if (index < 0)
+			continue;
+		CHECK_EQ(region_base, cell->mmio_locations[index].start);
+		CHECK_EQ(handler.arg, (void *)region_base);
+	}
+}
+
+static void test_register(void)
+{
+	unsigned long end;
+	unsigned int n;
+
+	test_cell_init(&test_cell, MAX_REGIONS);
+
+	end = register_random_regions(&test_cell, MAX_REGIONS);
+	CHECK_EQ(test_cell.num_mmio_regions, MAX_REGIONS);
+	CHECK_EQ(test_cell.mmio_generation, 2 * MAX_REGIONS);
+	for (n = 1; n < test_cell.num_mmio_regions; n++)
+		CHECK(test_cell.mmio_locations[n - 1].start <
+		      test_cell.mmio_locations[n].start);
+
+	check_lookups(&test_cell, end);
+
+	/* overflowing registrations are rejected */
+	mmio_region_register(&test_cell, 0, 0x1000, test_handler, NULL);
+	CHECK_EQ(test_cell.num_mmio_regions, MAX_REGIONS);
+	CHECK_EQ(find_region(&test_cell, 0, 1, NULL, NULL), -1);
+
+	test_cell_exit(&test_cell);
+}
+
+static void test_unregister(void)
+{
+	unsigned long end;
+	unsigned int n;
+
+	test_cell_init(&test_cell, MAX_REGIONS);
+
+	end = register_random_regions(&test_cell, MAX_REGIONS);
+	for (n = 0; n < MAX_REGIONS / 2; n++)
+		mmio_region_unregister(&test_cell,
+			test_cell.mmio_locations[host_random() %
+				test_cell.num_mmio_regions].start);
+	CHECK_EQ(test_cell.num_mmio_regions, MAX_REGIONS / 2);
+	CHECK_EQ(test_cell.mmio_generation, 2 * MAX_REGIONS + MAX_REGIONS);
+
+	check_lookups(&test_cell, end);
+
+	/* unknown regions are ignored */
+	mmio_region_unregister(&test_cell, 0x1000);
+	CHECK_EQ(test_cell.num_mmio_regions, MAX_REGIONS / 2);
+
+	while (test_cell.num_mmio_regions > 0)
+		mmio_region_unregister(&test_cell,
+				       test_cell.mmio_locations[0].start);
+	CHECK_EQ(find_region(&test_cell, 0x10000000, 1, NULL, NULL), -1);
+
+	test_cell_exit(&test_cell);
+}
+
+static void test_handle_access(void)
+{
+	struct per_cpu *cpu_data =
+		host_map_fixed(LOCAL_CPU_BASE, PAGE_ALIGN(sizeof(*cpu_data)));
+	struct mmio_access mmio;
+
+	test_cell_init(&test_cell, 4);
+	cpu_data->public.cell = &test_cell;
+
+	mmio_region_register(&test_cell, 0x1000, 0x100, test_handler,
+			     (void *)0x1000000);
+	mmio_region_register(&test_cell, 0x2000, 0x1000, test_handler,
+			     (void *)0x2000000);
+
+	mmio.address = 0x20fc;
+	mmio.size = 4;
+	mmio.is_write = false;
+	CHECK_EQ(mmio_handle_access(&mmio), MMIO_HANDLED);
+	CHECK_EQ(mmio.value, 0x20000fc);
+
+	/* access crossing the region end */
+	mmio.address = 0x10fe;
+	mmio.size = 4;
+	CHECK_EQ(mmio_handle_access(&mmio), MMIO_UNHANDLED);
+
+	mmio.address = 0x1800;
+	mmio.size = 1;
+	CHECK_EQ(mmio_handle_access(&mmio), MMIO_UNHANDLED);
+
+	test_cell_exit(&test_cell);
+}
+
+static void bench_find_region(unsigned int num_regions,
+			      unsigned long iterations)
+{
+	unsigned long end, region_base;
+	struct mmio_region_handler handler;
+	unsigned int n;
+
+	test_cell_init(&test_cell, num_regions);
+	end = register_random_regions(&test_cell, num_regions);
+	for (n = 0; n < LOOKUPS; n++)
+		lookup_address[n] = 0x10000000 +
+			host_random() % (end - 0x10000000);
+
+	for (n = 0; iterations-- > 0; n = (n + 1) % LOOKUPS)
+		host_keep(find_region(&test_cell, lookup_address[n], 4,
+				      &region_base, &handler));
+
+	test_cell_exit(&test_cell);
+}
+
+static void bench_find_region_8(unsigned long iterations)
+{
+	bench_find_region(8, iterations);
+}
+
+static void bench_find_region_64(unsigned long iterations)
+{
+	bench_find_region(64, iterations);
+}
+
+static void bench_find_region_256(unsigned long iterations)
+{
+	bench_find_region(256, iterations);
+}
+
+void host_main(void)
+{
+	host_test("register", test_register);
+	host_test("unregister", test_unregister);
+	host_test("handle_access", test_handle_access);
+
+	host_bench("find_region_8", bench_find_region_8);
+	host_bench("find_region_64", bench_find_region_64);
+	host_bench("find_region_256", bench_find_region_256);
+}
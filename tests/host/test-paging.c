@@ -0,0 +1,325 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Tests and benchmarks for the page allocator and the generic page table
+ * walker, using the x86-64 paging format.
+ */
+
+#include <jailhouse/paging.h>
+#include <asm/paging_modes.h>
+
+#include "host.h"
+
+#define POOL_PAGES		1024
+
+#define GB			(1UL << 30)
+#define MB			(1UL << 20)
+
+/* Host addresses double as physical addresses, page_offset stays 0. */
+
+/* referenced by arch_paging_flush_cpu_caches */
+unsigned long cache_line_size = 64;
+
+static void pool_init(struct page_pool *pool, unsigned long pages)
+{
+	pool->base_address = host_alloc_pages(pages);
+	pool->pages = pages;
+	pool->used_pages = 0;
+	pool->used_bitmap = host_alloc_pages(PAGES(pages / 8));
+	pool->flags = 0;
+}
+
+static void pool_exit(struct page_pool *pool)
+{
+	host_free_pages(pool->base_address, pool->pages);
+	host_free_pages(pool->used_bitmap, PAGES(pool->pages / 8));
+}
+
+static void test_page_alloc(void)
+{
+	struct page_pool pool;
+	void *p1, *p2, *p3;
+
+	pool_init(&pool, POOL_PAGES);
+
+	p1 = page_alloc(&pool, 1);
+	CHECK_EQ(p1, pool.base_address);
+	p2 = page_alloc(&pool, 3);
+	CHECK_EQ(p2, pool.base_address + PAGE_SIZE);
+	CHECK_EQ(pool.used_pages, 4);
+
+	/* a released gap is reused if it is large enough */
+	page_free(&pool, p1, 1);
+	p3 = page_alloc(&pool, 2);
+	CHECK_EQ(p3, pool.base_address + 4 * PAGE_SIZE);
+	p1 = page_alloc(&pool, 1);
+	CHECK_EQ(p1, pool.base_address);
+
+	CHECK(page_alloc(&pool, 0) == NULL);
+	CHECK(page_alloc(&pool, POOL_PAGES) == NULL);
+
+	page_free(&pool, p1, 1);
+	page_free(&pool, p2, 3);
+	page_free(&pool, p3, 2);
+	CHECK_EQ(pool.used_pages, 0);
+
+	/* the whole pool, then nothing more */
+	p1 = page_alloc(&pool, POOL_PAGES);
+	CHECK_EQ(p1, pool.base_address);
+	CHECK(page_alloc(&pool, 1) == NULL);
+	page_free(&pool, p1, POOL_PAGES);
+	CHECK_EQ(pool.used_pages, 0);
+
+	pool_exit(&pool);
+}
+
+static void test_page_alloc_aligned(void)
+{
+	struct page_pool pool;
+	unsigned int num;
+	void *p1, *p2;
+
+	pool_init(&pool, POOL_PAGES);
+
+	p1 = page_alloc(&pool, 1);
+	for (num = 1; num <= 64; num *= 2) {
+		p2 = page_alloc_aligned(&pool, num);
+		CHECK(p2 != NULL);
+		/* alignment refers to the page number, not the pool offset */
+		CHECK_EQ((unsigned long)p2 / PAGE_SIZE % num, 0);
+		page_free(&pool, p2, num);
+	}
+	page_free(&pool, p1, 1);
+	CHECK_EQ(pool.used_pages, 0);
+
+	pool_exit(&pool);
+}
+
+static void test_page_alloc_random(void)
+{
+	static unsigned char owner[POOL_PAGES];
+	struct {
+		void *page;
+		unsigned int num;
+	} allocs[64] = { };
+	unsigned int n, i, round, used = 0;
+	struct page_pool pool;
+	unsigned long first;
+
+	pool_init(&pool, POOL_PAGES);
+
+	for (round = 0; round < 20000; round++) {
+		n = host_random() % 64;
+		if (allocs[n].page) {
+			first = (allocs[n].page - pool.base_address) /
+				PAGE_SIZE;
+			for (i = 0; i < allocs[n].num; i++) {
+				CHECK_EQ(owner[first + i], n + 1);
+				owner[first + i] = 0;
+			}
+			page_free(&pool, allocs[n].page, allocs[n].num);
+			used -= allocs[n].num;
+			allocs[n].page = NULL;
+			continue;
+		}
+
+		allocs[n].num = host_random() % 32 + 1;
+		allocs[n].page = page_alloc(&pool, allocs[n].num);
+		if (!allocs[n].page)
+			continue;
+		first = (allocs[n].page - pool.base_address) / PAGE_SIZE;
+		for (i = 0; i < allocs[n].num; i++) {
+			CHECK_EQ(owner[first + i], 0);
+			owner[first + i] = n + 1;
+		}
+		used += allocs[n].num;
+		CHECK_EQ(pool.used_pages, used);
+	}
+
+	pool_exit(&pool);
+}
+
+static void paging_init_test(struct paging_structures *pg_structs)
+{
+	pool_init(&mem_pool, POOL_PAGES);
+	pg_structs->hv_paging = false;
+	pg_structs->root_paging = x86_64_paging;
+	pg_structs->root_table = page_alloc(&mem_pool, 1);
+}
+
+static void check_mapping(const struct paging_structures *pg_structs,
+			  unsigned long phys, unsigned long virt,
+			  unsigned long size)
+{
+	unsigned long offset;
+
+	for (offset = 0; offset < size; offset += size / 7 & PAGE_MASK)
+		CHECK_EQ(paging_virt2phys(pg_structs, virt + offset,
+					  PAGE_PRESENT_FLAGS), phys + offset);
+	CHECK_EQ(paging_virt2phys(pg_structs, virt + size - 1,
+				  PAGE_PRESENT_FLAGS), phys + size - 1);
+}
+
+static void test_paging_create(void)
+{
+	struct paging_structures pg_structs;
+	int err;
+
+	paging_init_test(&pg_structs);
+
+	/* 1 GB and 2 MB pages plus 4K tails */
+	err = paging_create(&pg_structs, 4 * GB - 2 * MB - PAGE_SIZE,
+			    2 * GB + 4 * MB + 2 * PAGE_SIZE,
+			    4 * GB - 2 * MB - PAGE_SIZE, PAGE_DEFAULT_FLAGS,
+			    PAGING_NON_COHERENT | PAGING_HUGE);
+	CHECK_EQ(err, 0);
+	check_mapping(&pg_structs, 4 * GB - 2 * MB - PAGE_SIZE,
+		      4 * GB - 2 * MB - PAGE_SIZE,
+		      2 * GB + 4 * MB + 2 * PAGE_SIZE);
+	/* root, PDPT, 2 PDs and 2 PTs at the ends */
+	CHECK_EQ(mem_pool.used_pages, 1 + 1 + 2 + 2);
+
+	CHECK_EQ(paging_virt2phys(&pg_structs, 4 * GB - 2 * MB - 2 * PAGE_SIZE,
+				  PAGE_PRESENT_FLAGS), INVALID_PHYS_ADDR);
+	CHECK_EQ(paging_virt2phys(&pg_structs, 6 * GB + 2 * MB + PAGE_SIZE,
+				  PAGE_PRESENT_FLAGS), INVALID_PHYS_ADDR);
+
+	/* without PAGING_HUGE, only 4K pages are used */
+	err = paging_create(&pg_structs, 16 * GB, 2 * MB, 32 * GB,
+			    PAGE_DEFAULT_FLAGS, PAGING_NON_COHERENT);
+	CHECK_EQ(err, 0);
+	check_mapping(&pg_structs, 16 * GB, 32 * GB, 2 * MB);
+	CHECK_EQ(mem_pool.used_pages, 6 + 1 + 1);
+
+	pool_exit(&mem_pool);
+}
+
+static void test_paging_destroy(void)
+{
+	struct paging_structures pg_structs;
+	int err;
+
+	paging_init_test(&pg_structs);
+
+	err = paging_create(&pg_structs, 2 * GB, 2 * GB, 2 * GB,
+			    PAGE_DEFAULT_FLAGS,
+			    PAGING_NON_COHERENT | PAGING_HUGE);
+	CHECK_EQ(err, 0);
+	CHECK_EQ(mem_pool.used_pages, 2);
+
+	/* punching a 4K hole splits a 1G and a 2M page */
+	err = paging_destroy(&pg_structs, 3 * GB + 5 * MB, PAGE_SIZE,
+			     PAGING_NON_COHERENT | PAGING_HUGE);
+	CHECK_EQ(err, 0);
+	CHECK_EQ(mem_pool.used_pages, 4);
+	CHECK_EQ(paging_virt2phys(&pg_structs, 3 * GB + 5 * MB,
+				  PAGE_PRESENT_FLAGS), INVALID_PHYS_ADDR);
+	check_mapping(&pg_structs, 2 * GB, 2 * GB, GB + 5 * MB);
+	check_mapping(&pg_structs, 3 * GB + 5 * MB + PAGE_SIZE,
+		      3 * GB + 5 * MB + PAGE_SIZE, GB - 5 * MB - PAGE_SIZE);
+
+	/* unmapping everything releases all but the root table */
+	err = paging_destroy(&pg_structs, 2 * GB, 2 * GB,
+			     PAGING_NON_COHERENT | PAGING_HUGE);
+	CHECK_EQ(err, 0);
+	CHECK_EQ(mem_pool.used_pages, 1);
+	CHECK_EQ(paging_virt2phys(&pg_structs, 2 * GB, PAGE_PRESENT_FLAGS),
+		 INVALID_PHYS_ADDR);
+
+	pool_exit(&mem_pool);
+}
+
+static void bench_page_alloc(unsigned long iterations)
+{
+	struct page_pool pool;
+	void *page;
+
+	pool_init(&pool, POOL_PAGES);
+	/* a fragmented pool: every other page of the first half is used */
+	for (page = pool.base_address;
+	     page < pool.base_address + POOL_PAGES / 2 * PAGE_SIZE;
+	     page += 2 * PAGE_SIZE)
+		CHECK(page_alloc(&pool, 2) != NULL);
+	for (page = pool.base_address;
+	     page < pool.base_address + POOL_PAGES / 2 * PAGE_SIZE;
+	     page += 2 * PAGE_SIZE)
+		page_free(&pool, page, 1);
+
+	while (iterations-- > 0) {
+		page = page_alloc(&pool, 2);
+		host_keep(page);
+		page_free(&pool, page, 2);
+	}
+
+	pool_exit(&pool);
+}
+
+static void bench_paging_create_4k(unsigned long iterations)
+{
+	struct paging_structures pg_structs;
+
+	paging_init_test(&pg_structs);
+
+	while (iterations-- > 0) {
+		paging_create(&pg_structs, 0, 64 * PAGE_SIZE, GB,
+			      PAGE_DEFAULT_FLAGS, PAGING_NON_COHERENT);
+		paging_destroy(&pg_structs, GB, 64 * PAGE_SIZE,
+			       PAGING_NON_COHERENT);
+	}
+
+	pool_exit(&mem_pool);
+}
+
+static void bench_paging_create_huge(unsigned long iterations)
+{
+	struct paging_structures pg_structs;
+
+	paging_init_test(&pg_structs);
+
+	while (iterations-- > 0) {
+		paging_create(&pg_structs, 0, GB + 64 * 2 * MB, GB,
+			      PAGE_DEFAULT_FLAGS,
+			      PAGING_NON_COHERENT | PAGING_HUGE);
+		paging_destroy(&pg_structs, GB, GB + 64 * 2 * MB,
+			       PAGING_NON_COHERENT | PAGING_HUGE);
+	}
+
+	pool_exit(&mem_pool);
+}
+
+static void bench_paging_virt2phys(unsigned long iterations)
+{
+	struct paging_structures pg_structs;
+	unsigned long virt = 0;
+
+	paging_init_test(&pg_structs);
+	paging_create(&pg_structs, 0, 2 * MB, GB, PAGE_DEFAULT_FLAGS,
+		      PAGING_NON_COHERENT);
+
+	while (iterations-- > 0) {
+		host_keep(paging_virt2phys(&pg_structs, GB + virt,
+					   PAGE_PRESENT_FLAGS));
+		virt = (virt + PAGE_SIZE) & (2 * MB - 1);
+	}
+
+	pool_exit(&mem_pool);
+}
+
+void host_main(void)
+{
+	host_test("page_alloc", test_page_alloc);
+	host_test("page_alloc_aligned", test_page_alloc_aligned);
+	host_test("page_alloc_random", test_page_alloc_random);
+	host_test("paging_create", test_paging_create);
+	host_test("paging_destroy", test_paging_destroy);
+
+	host_bench("page_alloc_free", bench_page_alloc);
+	host_bench("paging_create_destroy_4k", bench_paging_create_4k);
+	host_bench("paging_create_destroy_huge", bench_paging_create_huge);
+	host_bench("paging_virt2phys", bench_paging_virt2phys);
+}
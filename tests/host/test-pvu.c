@@ -0,0 +1,133 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Tests and benchmarks for the TI PVU entry list construction. The source is
+ * included to reach the static helpers, built against the arm64 headers.
+ */
+
+#include "../../hypervisor/arch/arm64/ti-pvu.c"
+
+#include "host.h"
+
+#define KB			(1ULL << 10)
+#define MB			(1ULL << 20)
+#define GB			(1ULL << 30)
+
+#define MAX_ENTRIES		64
+#define TEST_FLAGS		0x1234
+
+static struct pvu_tlb_entry entries[MAX_ENTRIES];
+
+static bool is_pvu_page_size(u64 size)
+{
+	unsigned int n;
+
+	for (n = 0; n < ARRAY_SIZE(pvu_page_size_bytes); n++)
+		if (size == pvu_page_size_bytes[n])
+			return true;
+	return false;
+}
+
+/* entries must be valid, contiguous and cover exactly the region */
+static void check_entries(u64 ipa, u64 pa, u64 size, int count)
+{
+	int n;
+
+	CHECK(count > 0);
+	for (n = 0; n < count; n++) {
+		CHECK(is_pvu_page_size(entries[n].size));
+		CHECK_EQ(entries[n].virt_addr, ipa);
+		CHECK_EQ(entries[n].phys_addr, pa);
+		CHECK_EQ(entries[n].virt_addr & (entries[n].size - 1), 0);
+		CHECK_EQ(entries[n].phys_addr & (entries[n].size - 1), 0);
+		CHECK_EQ(entries[n].flags, TEST_FLAGS);
+		ipa += entries[n].size;
+		pa += entries[n].size;
+		size -= entries[n].size;
+	}
+	CHECK_EQ(size, 0);
+}
+
+static void test_entrylist_create(void)
+{
+	int count;
+
+	/* a single huge entry */
+	count = pvu_entrylist_create(16 * GB, 32 * GB, 16 * GB, TEST_FLAGS,
+				     entries, MAX_ENTRIES);
+	CHECK_EQ(count, 1);
+	check_entries(16 * GB, 32 * GB, 16 * GB, count);
+
+	/* 4K head, growing to 2M, then 1G, then shrinking to a 64K tail */
+	count = pvu_entrylist_create(GB - 2 * MB - 4 * KB,
+				     3 * GB - 2 * MB - 4 * KB,
+				     GB + 2 * MB + 4 * KB + 2 * MB + 64 * KB,
+				     TEST_FLAGS, entries, MAX_ENTRIES);
+	check_entries(GB - 2 * MB - 4 * KB, 3 * GB - 2 * MB - 4 * KB,
+		      GB + 2 * MB + 4 * KB + 2 * MB + 64 * KB, count);
+	CHECK_EQ(entries[0].size, 4 * KB);
+	CHECK_EQ(entries[count - 1].size, 64 * KB);
+
+	/* the coarser alignment of ipa and pa limits the page size */
+	count = pvu_entrylist_create(0, 64 * KB, 4 * MB, TEST_FLAGS, entries,
+				     MAX_ENTRIES);
+	CHECK_EQ(count, 64);
+	check_entries(0, 64 * KB, 4 * MB, count);
+
+	CHECK_EQ(pvu_entrylist_create(0, 0, 0, TEST_FLAGS, entries,
+				      MAX_ENTRIES), 0);
+}
+
+static void test_entrylist_errors(void)
+{
+	/* too many entries needed */
+	CHECK_EQ(pvu_entrylist_create(0, 64 * KB, 4 * MB + 64 * KB,
+				      TEST_FLAGS, entries, MAX_ENTRIES),
+		 -EINVAL);
+	CHECK_EQ(pvu_entrylist_create(0, 0, 8 * KB, TEST_FLAGS, entries, 1),
+		 -EINVAL);
+
+	/* addresses or sizes below the smallest page size */
+	CHECK_EQ(pvu_entrylist_create(0x800, 0, 4 * KB, TEST_FLAGS, entries,
+				      MAX_ENTRIES), -EINVAL);
+	CHECK_EQ(pvu_entrylist_create(0, 0, 6 * KB, TEST_FLAGS, entries,
+				      MAX_ENTRIES), -EINVAL);
+}
+
+static void test_entrylist_sort(void)
+{
+	int count, n;
+
+	count = pvu_entrylist_create(GB - 2 * MB - 4 * KB,
+				     GB - 2 * MB - 4 * KB,
+				     GB + 4 * MB + 8 * KB, TEST_FLAGS,
+				     entries, MAX_ENTRIES);
+	CHECK(count > 1);
+	pvu_entrylist_sort(entries, count);
+	for (n = 1; n < count; n++)
+		CHECK(entries[n - 1].size >= entries[n].size);
+}
+
+static void bench_entrylist_create(unsigned long iterations)
+{
+	while (iterations-- > 0)
+		host_keep(pvu_entrylist_create(GB - 2 * MB - 4 * KB,
+					       3 * GB - 2 * MB - 4 * KB,
+					       GB + 4 * MB + 68 * KB,
+					       TEST_FLAGS, entries,
+					       MAX_ENTRIES));
+}
+
+void host_main(void)
+{
+	host_test("entrylist_create", test_entrylist_create);
+	host_test("entrylist_errors", test_entrylist_errors);
+	host_test("entrylist_sort", test_entrylist_sort);
+
+	host_bench("entrylist_create", bench_entrylist_create);
+}
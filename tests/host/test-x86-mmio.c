@@ -0,0 +1,242 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Tests and benchmarks for the x86 MMIO instruction decoder.
+ */
+
+#include <jailhouse/string.h>
+
+#include "host.h"
+#include "x86-guest.h"
+
+struct decoder_case {
+	const char *name;
+	u8 bytes[16];
+	unsigned int num_bytes;
+	bool is_write;
+	unsigned int mode;
+	unsigned int inst_len;
+	unsigned int access_size;
+	unsigned int in_reg_num;
+	unsigned long out_val;
+	unsigned long reg_preserve_mask;
+};
+
+static const struct decoder_case cases[] = {
+	{ "mov %eax,(%rbx)", { 0x89, 0x03 }, 2, true, MODE_64,
+	  2, 4, RAX, REG(RAX), 0 },
+	{ "mov (%rbx),%eax", { 0x8b, 0x03 }, 2, false, MODE_64,
+	  2, 4, RAX, 0, 0 },
+	{ "mov %rcx,(%rbx)", { 0x48, 0x89, 0x0b }, 3, true, MODE_64,
+	  3, 8, RCX, REG(RCX), 0 },
+	{ "mov %ax,(%rbx)", { 0x66, 0x89, 0x03 }, 3, true, MODE_64,
+	  3, 2, RAX, REG(RAX), 0 },
+	{ "mov (%rbx),%ax", { 0x66, 0x8b, 0x03 }, 3, false, MODE_64,
+	  3, 2, RAX, 0, ~0xffffUL },
+	{ "mov %al,(%rbx)", { 0x88, 0x03 }, 2, true, MODE_64,
+	  2, 1, RAX, REG(RAX), 0 },
+	{ "mov (%rbx),%al", { 0x8a, 0x03 }, 2, false, MODE_64,
+	  2, 1, RAX, 0, ~0xffUL },
+	{ "movzbl (%rbx),%eax", { 0x0f, 0xb6, 0x03 }, 3, false, MODE_64,
+	  3, 1, RAX, 0, 0 },
+	{ "movzbw (%rbx),%ax", { 0x66, 0x0f, 0xb6, 0x03 }, 4, false, MODE_64,
+	  4, 1, RAX, 0, ~0xffffUL },
+	{ "movzwl (%rbx),%eax", { 0x0f, 0xb7, 0x03 }, 3, false, MODE_64,
+	  3, 2, RAX, 0, 0 },
+	{ "movl $imm,(%rbx)", { 0xc7, 0x03, 0x78, 0x56, 0x34, 0x12 }, 6,
+	  true, MODE_64, 6, 4, RAX, 0x12345678, 0 },
+	{ "movq $-16,(%rbx)",
+	  { 0x48, 0xc7, 0x03, 0xf0, 0xff, 0xff, 0xff }, 7, true, MODE_64,
+	  7, 8, RAX, 0xfffffffffffffff0UL, 0 },
+	{ "movl $imm,0x10(%rbx)",
+	  { 0xc7, 0x43, 0x10, 0x01, 0x00, 0x00, 0x00 }, 7, true, MODE_64,
+	  7, 4, RAX, 1, 0 },
+	{ "movl $imm,0x100(%rbx)",
+	  { 0xc7, 0x83, 0x00, 0x01, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00 }, 10,
+	  true, MODE_64, 10, 4, RAX, 2, 0 },
+	{ "mov 0x10(%rbx),%eax", { 0x8b, 0x43, 0x10 }, 3, false, MODE_64,
+	  3, 4, RAX, 0, 0 },
+	{ "mov 0x100(%rbx),%eax", { 0x8b, 0x83, 0x00, 0x01, 0x00, 0x00 }, 6,
+	  false, MODE_64, 6, 4, RAX, 0, 0 },
+	{ "mov (%rsp),%eax", { 0x8b, 0x04, 0x24 }, 3, false, MODE_64,
+	  3, 4, RAX, 0, 0 },
+	{ "mov 0x1000,%eax (SIB)",
+	  { 0x8b, 0x04, 0x25, 0x00, 0x10, 0x00, 0x00 }, 7, false, MODE_64,
+	  7, 4, RAX, 0, 0 },
+	{ "mov 0x8(%rsp),%eax", { 0x8b, 0x44, 0x24, 0x08 }, 4, false,
+	  MODE_64, 4, 4, RAX, 0, 0 },
+	{ "mov 0x1000(%rsp),%eax",
+	  { 0x8b, 0x84, 0x24, 0x00, 0x10, 0x00, 0x00 }, 7, false, MODE_64,
+	  7, 4, RAX, 0, 0 },
+	{ "mov 0x1000(%rip),%eax", { 0x8b, 0x05, 0x00, 0x10, 0x00, 0x00 }, 6,
+	  false, MODE_64, 6, 4, RAX, 0, 0 },
+	{ "mov (%rbx),%r8d", { 0x44, 0x8b, 0x03 }, 3, false, MODE_64,
+	  3, 4, R8, 0, 0 },
+	{ "mov %ebx,(%rbx)", { 0x89, 0x1b }, 2, true, MODE_64,
+	  2, 4, RBX, REG(RBX), 0 },
+	{ "mov moffs64,%eax",
+	  { 0xa1, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 9, false,
+	  MODE_64, 9, 4, RAX, 0, 0 },
+	{ "mov %rax,moffs64",
+	  { 0x48, 0xa3, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 10,
+	  true, MODE_64, 10, 8, RAX, REG(RAX), 0 },
+	{ "mov moffs32,%eax (addr32)",
+	  { 0x67, 0xa1, 0x00, 0x10, 0x00, 0x00 }, 6, false, MODE_64,
+	  6, 4, RAX, 0, 0 },
+	{ "movw $imm,(%rbx)", { 0x66, 0xc7, 0x03, 0x34, 0x12 }, 5, true,
+	  MODE_64, 5, 2, RAX, 0x1234, 0 },
+	{ "mov %dil,(%rbx)", { 0x40, 0x88, 0x3b }, 3, true, MODE_64,
+	  3, 1, 8, REG(8), 0 },
+	{ "mov %ax,(%rbx) (REX before 0x66)", { 0x48, 0x66, 0x89, 0x03 }, 4,
+	  true, MODE_64, 4, 2, RAX, REG(RAX), 0 },
+	{ "mov %r8,(%rbx) (last REX counts)", { 0x40, 0x4c, 0x89, 0x03 }, 4,
+	  true, MODE_64, 4, 8, R8, REG(R8), 0 },
+	{ "movzbq (%rbx),%rax (0x66 and REX.W)",
+	  { 0x66, 0x48, 0x0f, 0xb6, 0x03 }, 5, false, MODE_64,
+	  5, 1, RAX, 0, 0 },
+	{ "mov 0x1000(%ebx),%eax (addr32)",
+	  { 0x67, 0x8b, 0x83, 0x00, 0x10, 0x00, 0x00 }, 7, false, MODE_64,
+	  7, 4, RAX, 0, 0 },
+
+	{ "mov %eax,(%ebx) [32]", { 0x89, 0x03 }, 2, true, MODE_32,
+	  2, 4, RAX, REG(RAX), 0 },
+	{ "mov %ax,(%ebx) [32]", { 0x66, 0x89, 0x03 }, 3, true, MODE_32,
+	  3, 2, RAX, REG(RAX), 0 },
+	{ "mov moffs32,%eax [32]", { 0xa1, 0x00, 0x10, 0x00, 0x00 }, 5, false,
+	  MODE_32, 5, 4, RAX, 0, 0 },
+	{ "mov moffs16,%eax [32]", { 0x67, 0xa1, 0x00, 0x10 }, 4, false,
+	  MODE_32, 4, 4, RAX, 0, 0 },
+	{ "mov %ax,(%bp,%di) [16]", { 0x89, 0x03 }, 2, true, MODE_16,
+	  2, 2, RAX, REG(RAX), 0 },
+	{ "mov %eax,(%bp,%di) [16]", { 0x66, 0x89, 0x03 }, 3, true, MODE_16,
+	  3, 4, RAX, REG(RAX), 0 },
+	{ "mov moffs16,%ax [16]", { 0xa1, 0x00, 0x10 }, 3, false, MODE_16,
+	  3, 2, RAX, 0, ~0xffffUL },
+	{ "mov 0x1234(%bx),%ax [16]", { 0x8b, 0x87, 0x34, 0x12 }, 4, false,
+	  MODE_16, 4, 2, RAX, 0, ~0xffffUL },
+	{ "mov %ax,0x1234 [16]", { 0x89, 0x06, 0x34, 0x12 }, 4, true,
+	  MODE_16, 4, 2, RAX, REG(RAX), 0 },
+	{ "mov 0x10(%bp,%si),%ax [16]", { 0x8b, 0x42, 0x10 }, 3, false,
+	  MODE_16, 3, 2, RAX, 0, ~0xffffUL },
+	{ "movw $imm,(%si) [16]", { 0xc7, 0x04, 0x34, 0x12 }, 4, true,
+	  MODE_16, 4, 2, RAX, 0x1234, 0 },
+	{ "movzbw (%si),%ax [16]", { 0x0f, 0xb6, 0x04 }, 3, false, MODE_16,
+	  3, 1, RAX, 0, ~0xffffUL },
+	{ "movzbl (%si),%eax [16]", { 0x66, 0x0f, 0xb6, 0x04 }, 4, false,
+	  MODE_16, 4, 1, RAX, 0, 0 },
+	{ "mov 0x1000(%esi),%eax [16]",
+	  { 0x66, 0x67, 0x8b, 0x86, 0x00, 0x10, 0x00, 0x00 }, 8, false,
+	  MODE_16, 8, 4, RAX, 0, 0 },
+
+	/* rejected instructions */
+	{ "mov %ebx,%eax", { 0x8b, 0xc3 }, 2, false, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "mov (%rbx),%esp", { 0x8b, 0x23 }, 2, false, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "mov (%rbx,%r8),%eax (REX.X)", { 0x4a, 0x8b, 0x04, 0x03 }, 4, false,
+	  MODE_64, 0, 0, 0, 0, 0 },
+	{ "mov %bh,(%rbx)", { 0x88, 0x3b }, 2, true, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "mov (%rbx),%ch", { 0x8a, 0x2b }, 2, false, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "movl $imm,(%rbx) with reg 1",
+	  { 0xc7, 0x0b, 0x00, 0x00, 0x00, 0x00 }, 6, true, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "movsx (%rbx),%eax", { 0x0f, 0xbe, 0x03 }, 3, false, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "add %eax,(%rbx)", { 0x01, 0x03 }, 2, true, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "mov %eax,(%rbx) as read", { 0x89, 0x03 }, 2, false, MODE_64,
+	  0, 0, 0, 0, 0 },
+	{ "mov (%rbx),%eax as write", { 0x8b, 0x03 }, 2, true, MODE_64,
+	  0, 0, 0, 0, 0 },
+};
+
+static struct mmio_instruction parse_at(const struct decoder_case *c,
+					unsigned long rip)
+{
+	guest_set_mode(c->mode);
+	return guest_parse(c->bytes, c->num_bytes, rip, c->is_write);
+}
+
+static void check_case(const struct decoder_case *c,
+		       struct mmio_instruction inst)
+{
+	bool ok = inst.inst_len == c->inst_len;
+
+	if (ok && c->inst_len > 0) {
+		ok = inst.access_size == c->access_size;
+		if (c->is_write)
+			ok = ok && inst.out_val == c->out_val;
+		else
+			ok = ok && inst.in_reg_num == c->in_reg_num &&
+				inst.reg_preserve_mask == c->reg_preserve_mask;
+	}
+	host_check(ok, c->name, __FILE__, __LINE__);
+}
+
+static void test_decoder(void)
+{
+	unsigned int n;
+
+	guest_init();
+	for (n = 0; n < ARRAY_SIZE(cases); n++)
+		check_case(&cases[n], parse_at(&cases[n], GUEST_CODE + 0x100));
+}
+
+static void test_page_crossing(void)
+{
+	const struct decoder_case *c;
+	unsigned int n, split;
+
+	guest_init();
+	for (n = 0; n < ARRAY_SIZE(cases); n++) {
+		c = &cases[n];
+		for (split = 1; split < c->num_bytes; split++)
+			check_case(c, parse_at(c, GUEST_CODE + PAGE_SIZE -
+					       split));
+	}
+}
+
+static void test_truncated(void)
+{
+	static const u8 bytes[] = { 0x48, 0x89 };
+
+	guest_init();
+
+	/* instruction bytes beyond the guest code cannot be fetched */
+	CHECK_EQ(guest_parse(bytes, 2, GUEST_CODE_END - 2, true).inst_len, 0);
+}
+
+static void bench_decoder(unsigned long iterations)
+{
+	static const unsigned int mix[] = { 0, 2, 7, 12, 17, 23 };
+	unsigned int n = 0, rip = GUEST_CODE;
+
+	guest_init();
+	for (n = 0; n < ARRAY_SIZE(mix); n++) {
+		memcpy(&guest_code[rip - GUEST_CODE], cases[mix[n]].bytes,
+		       cases[mix[n]].num_bytes);
+		rip += 16;
+	}
+
+	for (n = 0; iterations-- > 0; n = (n + 1) % ARRAY_SIZE(mix)) {
+		guest_rip = GUEST_CODE + n * 16;
+		host_keep(x86_mmio_parse(NULL,
+					 cases[mix[n]].is_write).inst_len);
+	}
+}
+
+void host_main(void)
+{
+	host_test("decoder", test_decoder);
+	host_test("page_crossing", test_page_crossing);
+	host_test("truncated", test_truncated);
+
+	host_bench("x86_mmio_parse", bench_decoder);
+}
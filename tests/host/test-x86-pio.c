@@ -0,0 +1,153 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Tests and benchmarks for the x86 port I/O dispatcher. The source is
+ * included to reach the static find_handler().
+ */
+
+#include <jailhouse/string.h>
+
+#include "../../hypervisor/arch/x86/pio.c"
+
+#include "host.h"
+
+#define LOOKUPS			1024
+
+static struct cell test_cell;
+static u16 lookup_port[LOOKUPS];
+
+static int test_handler(void *arg, struct pio_access *pio)
+{
+	if (pio->in)
+		pio->value = (unsigned long)arg + pio->port;
+	return (unsigned long)arg == 0xdead ? -1 : 1;
+}
+
+static void test_cell_init(struct cell *cell)
+{
+	memset(&cell->arch.pio, 0, sizeof(cell->arch.pio));
+}
+
+static void test_register(void)
+{
+	const struct pio_region_handler *handler;
+	unsigned int port;
+
+	test_cell_init(&test_cell);
+
+	CHECK_EQ(pio_region_register(&test_cell, 0xcf8, 8, test_handler,
+				     (void *)0x1000), 0);
+	CHECK_EQ(pio_region_register(&test_cell, 0x80, 1, test_handler,
+				     (void *)0x2000), 0);
+	/* a range spanning two pages */
+	CHECK_EQ(pio_region_register(&test_cell, 0x3f8, 0x10, test_handler,
+				     (void *)0x3000), 0);
+	CHECK_EQ(test_cell.arch.pio.num_handlers, 3);
+	CHECK_EQ(test_cell.arch.pio.num_pages, 4);
+
+	for (port = 0; port < 0x10000; port++) {
+		handler = find_handler(&test_cell.arch.pio, port);
+		if (port >= 0xcf8 && port < 0xd00)
+			CHECK_EQ(handler ? handler->arg : NULL, (void *)0x1000);
+		else if (port == 0x80)
+			CHECK_EQ(handler ? handler->arg : NULL, (void *)0x2000);
+		else if (port >= 0x3f8 && port < 0x408)
+			CHECK_EQ(handler ? handler->arg : NULL, (void *)0x3000);
+		else
+			CHECK(!handler);
+	}
+}
+
+static void test_register_errors(void)
+{
+	unsigned int n;
+
+	test_cell_init(&test_cell);
+
+	CHECK_EQ(pio_region_register(&test_cell, 0x60, 0x10, test_handler,
+				     NULL), 0);
+
+	/* empty, overflowing and overlapping ranges */
+	CHECK_EQ(pio_region_register(&test_cell, 0x100, 0, test_handler, NULL),
+		 -EINVAL);
+	CHECK_EQ(pio_region_register(&test_cell, 0xfff0, 0x20, test_handler,
+				     NULL), -EINVAL);
+	CHECK_EQ(pio_region_register(&test_cell, 0x50, 0x11, test_handler,
+				     NULL), -EBUSY);
+	CHECK_EQ(pio_region_register(&test_cell, 0x6f, 1, test_handler, NULL),
+		 -EBUSY);
+	CHECK_EQ(test_cell.arch.pio.num_handlers, 1);
+
+	/* out of pages */
+	for (n = 1; n < PIO_MAX_PAGES; n++)
+		CHECK_EQ(pio_region_register(&test_cell, n << 8, 1,
+					     test_handler, NULL), 0);
+	CHECK_EQ(pio_region_register(&test_cell, PIO_MAX_PAGES << 8, 1,
+				     test_handler, NULL), -ENOMEM);
+	CHECK(!find_handler(&test_cell.arch.pio, PIO_MAX_PAGES << 8));
+
+	/* out of handlers */
+	for (n = PIO_MAX_PAGES; n < PIO_MAX_REGIONS; n++)
+		CHECK_EQ(pio_region_register(&test_cell, 0x70 + n, 1,
+					     test_handler, NULL), 0);
+	CHECK_EQ(pio_region_register(&test_cell, 0x7f, 1, test_handler, NULL),
+		 -ENOMEM);
+	CHECK_EQ(test_cell.arch.pio.num_handlers, PIO_MAX_REGIONS);
+}
+
+static void test_handle_access(void)
+{
+	struct per_cpu *cpu_data =
+		host_map_fixed(LOCAL_CPU_BASE, PAGE_ALIGN(sizeof(*cpu_data)));
+	struct pio_access pio;
+
+	test_cell_init(&test_cell);
+	cpu_data->public.cell = &test_cell;
+
+	pio_region_register(&test_cell, 0x1f0, 8, test_handler,
+			    (void *)0x10000);
+	pio_region_register(&test_cell, 0x64, 1, test_handler, (void *)0xdead);
+
+	pio.port = 0x1f4;
+	pio.size = 1;
+	pio.in = true;
+	CHECK_EQ(pio_handle_access(&pio), 1);
+	CHECK_EQ(pio.value, 0x101f4);
+
+	pio.port = 0x1f8;
+	CHECK_EQ(pio_handle_access(&pio), 0);
+
+	/* handler errors are passed through */
+	pio.port = 0x64;
+	CHECK_EQ(pio_handle_access(&pio), -1);
+}
+
+static void bench_find_handler(unsigned long iterations)
+{
+	unsigned int n;
+
+	test_cell_init(&test_cell);
+	pio_region_register(&test_cell, 0xcf8, 8, test_handler, NULL);
+	pio_region_register(&test_cell, 0x80, 1, test_handler, NULL);
+	pio_region_register(&test_cell, 0x64, 1, test_handler, NULL);
+	pio_region_register(&test_cell, 0x3f8, 8, test_handler, NULL);
+	for (n = 0; n < LOOKUPS; n++)
+		lookup_port[n] = host_random();
+
+	for (n = 0; iterations-- > 0; n = (n + 1) % LOOKUPS)
+		host_keep(find_handler(&test_cell.arch.pio, lookup_port[n]));
+}
+
+void host_main(void)
+{
+	host_test("register", test_register);
+	host_test("register_errors", test_register_errors);
+	host_test("handle_access", test_handle_access);
+
+	host_bench("find_handler", bench_find_handler);
+}
@@ -0,0 +1,400 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Tests for the x86 string I/O emulation. The source is included to reach
+ * the static vcpu_handle_string_io(). Guest memory is identity-mapped by the
+ * paging stub below, port accesses go through the real dispatcher.
+ */
+
+#include <jailhouse/string.h>
+
+#include "../../hypervisor/arch/x86/vcpu.c"
+
+#include "host.h"
+
+#define GUEST_MEM		0x100000
+/* covers a full 16-bit segment and then some */
+#define GUEST_MEM_PAGES		17
+#define GUEST_MEM_END		(GUEST_MEM + GUEST_MEM_PAGES * PAGE_SIZE)
+
+#define TEST_PORT		0x3f8
+#define TEST_INST_LEN		2
+
+#define MAX_ACCESSES		(PIO_STRING_MAX_BYTES + 16)
+
+#define MODE_64			0
+#define MODE_32			1
+#define MODE_16			2
+
+static u8 __attribute__((aligned(PAGE_SIZE)))
+	guest_mem[GUEST_MEM_PAGES * PAGE_SIZE];
+static u64 guest_efer, guest_rflags;
+static u16 guest_cs_attr;
+static unsigned int skipped_len;
+static unsigned int guest_mappings;
+
+static struct cell test_cell;
+static struct per_cpu *cpu_data;
+
+/* port accesses seen by the handler, INs return an incrementing value */
+static u32 access_value[MAX_ACCESSES];
+static unsigned int num_accesses;
+static unsigned int fail_access;
+
+void *paging_get_guest_pages(const struct guest_paging_structures *pg_structs,
+			     unsigned long gaddr, unsigned int num,
+			     unsigned long flags)
+{
+	unsigned long page = gaddr & PAGE_MASK;
+
+	guest_mappings++;
+	if (page < GUEST_MEM || page + num * PAGE_SIZE > GUEST_MEM_END)
+		return NULL;
+	return &guest_mem[page - GUEST_MEM];
+}
+
+void vcpu_get_guest_paging_structs(struct guest_paging_structures *pg_structs)
+{
+}
+
+void vcpu_skip_emulated_instruction(unsigned int inst_len)
+{
+	skipped_len += inst_len;
+}
+
+u64 vcpu_vendor_get_efer(void)
+{
+	return guest_efer;
+}
+
+u16 vcpu_vendor_get_cs_attr(void)
+{
+	return guest_cs_attr;
+}
+
+u64 vcpu_vendor_get_rflags(void)
+{
+	return guest_rflags;
+}
+
+static int test_port_handler(void *arg, struct pio_access *pio)
+{
+	if (num_accesses == fail_access)
+		return -1;
+	if (pio->in)
+		pio->value = 0x80 + num_accesses;
+	access_value[num_accesses++] = pio->value;
+	return 1;
+}
+
+static void test_init(unsigned int mode, bool down)
+{
+	unsigned int n;
+
+	if (!cpu_data)
+		cpu_data = host_map_fixed(LOCAL_CPU_BASE,
+					  PAGE_ALIGN(sizeof(*cpu_data)));
+	for (n = 0; n < 16; n++)
+		cpu_data->guest_regs.by_index[n] = 0xa0a0a0a0a0a0a000UL | n;
+	cpu_data->public.cell = &test_cell;
+
+	memset(&test_cell.arch.pio, 0, sizeof(test_cell.arch.pio));
+	pio_region_register(&test_cell, TEST_PORT, 8, test_port_handler,
+			    NULL);
+
+	switch (mode) {
+	case MODE_64:
+		guest_efer = EFER_LMA;
+		guest_cs_attr = VCPU_CS_L;
+		break;
+	case MODE_32:
+		guest_efer = 0;
+		guest_cs_attr = VCPU_CS_DB;
+		break;
+	default:
+		guest_efer = 0;
+		guest_cs_attr = 0;
+		break;
+	}
+	guest_rflags = down ? X86_RFLAGS_DF : 0;
+
+	for (n = 0; n < sizeof(guest_mem); n++)
+		guest_mem[n] = n;
+	memset(access_value, 0, sizeof(access_value));
+	num_accesses = 0;
+	fail_access = MAX_ACCESSES;
+	skipped_len = 0;
+	guest_mappings = 0;
+}
+
+static struct vcpu_io_intercept string_io(bool in, unsigned int size,
+					  bool rep, unsigned int addr_size)
+{
+	struct vcpu_io_intercept io = {
+		.port = TEST_PORT,
+		.size = size,
+		.in = in,
+		.inst_len = TEST_INST_LEN,
+		.rep = rep,
+		.string = true,
+		.addr_size = addr_size,
+		.seg = VCPU_SEG_ES,
+		.seg_base = 0,
+	};
+
+	return io;
+}
+
+static void test_outs(void)
+{
+	union registers *regs;
+	struct vcpu_io_intercept io;
+	unsigned int n;
+
+	/* single outsb */
+	test_init(MODE_64, false);
+	regs = &cpu_data->guest_regs;
+	regs->rsi = GUEST_MEM + 0x10;
+	regs->rcx = 0x1234;
+	io = string_io(false, 1, false, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 1);
+	CHECK_EQ(access_value[0], 0x10);
+	CHECK_EQ(regs->rsi, GUEST_MEM + 0x11);
+	CHECK_EQ(regs->rcx, 0x1234);
+	CHECK_EQ(skipped_len, TEST_INST_LEN);
+
+	/* rep outsw */
+	test_init(MODE_64, false);
+	regs->rsi = GUEST_MEM + 0x20;
+	regs->rcx = 10;
+	io = string_io(false, 2, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 10);
+	for (n = 0; n < 10; n++)
+		CHECK_EQ(access_value[n], (0x21 + 2 * n) << 8 | (0x20 + 2 * n));
+	CHECK_EQ(regs->rsi, GUEST_MEM + 0x20 + 20);
+	CHECK_EQ(regs->rcx, 0);
+	CHECK_EQ(skipped_len, TEST_INST_LEN);
+
+	/* rep with zero count */
+	test_init(MODE_64, false);
+	regs->rsi = GUEST_MEM;
+	regs->rcx = 0;
+	io = string_io(false, 1, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 0);
+	CHECK_EQ(regs->rsi, GUEST_MEM);
+	CHECK_EQ(skipped_len, TEST_INST_LEN);
+}
+
+static void test_ins(void)
+{
+	union registers *regs;
+	struct vcpu_io_intercept io;
+	unsigned int n;
+
+	test_init(MODE_64, false);
+	regs = &cpu_data->guest_regs;
+	regs->rdi = GUEST_MEM + 0x40;
+	regs->rsi = 0x5678;
+	regs->rcx = 3;
+	io = string_io(true, 4, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 3);
+	for (n = 0; n < 3; n++)
+		CHECK_EQ(*(u32 *)&guest_mem[0x40 + 4 * n], 0x80 + n);
+	/* the neighbouring bytes are untouched */
+	CHECK_EQ(guest_mem[0x3f], 0x3f);
+	CHECK_EQ(guest_mem[0x4c], 0x4c);
+	CHECK_EQ(regs->rdi, GUEST_MEM + 0x4c);
+	CHECK_EQ(regs->rsi, 0x5678);
+	CHECK_EQ(regs->rcx, 0);
+	CHECK_EQ(skipped_len, TEST_INST_LEN);
+}
+
+static void test_direction(void)
+{
+	union registers *regs;
+	struct vcpu_io_intercept io;
+	unsigned int n;
+
+	/* outs walks down from the start address */
+	test_init(MODE_64, true);
+	regs = &cpu_data->guest_regs;
+	regs->rsi = GUEST_MEM + 0x105;
+	regs->rcx = 4;
+	io = string_io(false, 1, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 4);
+	for (n = 0; n < 4; n++)
+		CHECK_EQ(access_value[n], 0x05 - n);
+	CHECK_EQ(regs->rsi, GUEST_MEM + 0x101);
+	CHECK_EQ(regs->rcx, 0);
+
+	/* the first value read by ins lands at the start address */
+	test_init(MODE_64, true);
+	regs->rdi = GUEST_MEM + 0x208;
+	regs->rcx = 3;
+	io = string_io(true, 2, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 3);
+	CHECK_EQ(*(u16 *)&guest_mem[0x208], 0x80);
+	CHECK_EQ(*(u16 *)&guest_mem[0x206], 0x81);
+	CHECK_EQ(*(u16 *)&guest_mem[0x204], 0x82);
+	CHECK_EQ(guest_mem[0x20a], 0x0a);
+	CHECK_EQ(guest_mem[0x203], 0x03);
+	CHECK_EQ(regs->rdi, GUEST_MEM + 0x202);
+	CHECK_EQ(regs->rcx, 0);
+	CHECK_EQ(skipped_len, TEST_INST_LEN);
+}
+
+static void test_chunking(void)
+{
+	unsigned int items = PIO_STRING_MAX_BYTES / 4;
+	union registers *regs;
+	struct vcpu_io_intercept io;
+	unsigned int n;
+
+	/* one exit copies up to a page, then the instruction is repeated */
+	test_init(MODE_64, false);
+	regs = &cpu_data->guest_regs;
+	regs->rdi = GUEST_MEM;
+	regs->rcx = items + 5;
+	io = string_io(true, 4, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, items);
+	CHECK_EQ(regs->rdi, GUEST_MEM + PIO_STRING_MAX_BYTES);
+	CHECK_EQ(regs->rcx, 5);
+	CHECK_EQ(skipped_len, 0);
+	/* a chunk buffer is mapped twice for ins, before and after the I/O */
+	CHECK_EQ(guest_mappings,
+		 2 * PIO_STRING_MAX_BYTES / PIO_STRING_CHUNK);
+
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, items + 5);
+	CHECK_EQ(regs->rdi, GUEST_MEM + PIO_STRING_MAX_BYTES + 20);
+	CHECK_EQ(regs->rcx, 0);
+	CHECK_EQ(skipped_len, TEST_INST_LEN);
+	for (n = 0; n < items + 5; n++)
+		if (*(u32 *)&guest_mem[4 * n] != 0x80 + n)
+			break;
+	CHECK_EQ(n, items + 5);
+
+	/* operands that cross a page boundary */
+	test_init(MODE_64, false);
+	regs->rsi = GUEST_MEM + PAGE_SIZE - 3;
+	regs->rcx = 6;
+	io = string_io(false, 1, true, 8);
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 6);
+	for (n = 0; n < 6; n++)
+		CHECK_EQ(access_value[n], (PAGE_SIZE - 3 + n) & 0xff);
+	CHECK_EQ(regs->rsi, GUEST_MEM + PAGE_SIZE + 3);
+	CHECK_EQ(guest_mappings, 1);
+}
+
+static void test_address_size(void)
+{
+	union registers *regs;
+	struct vcpu_io_intercept io;
+
+	/*
+	 * 16-bit addressing wraps the index within the segment. Only the low
+	 * 16 bits of the index and count registers are updated.
+	 */
+	test_init(MODE_16, false);
+	regs = &cpu_data->guest_regs;
+	regs->rsi = 0x12340000fffeUL;
+	regs->rcx = 0x567800000004UL;
+	io = string_io(false, 1, true, 2);
+	io.seg_base = GUEST_MEM;
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 4);
+	CHECK_EQ(access_value[0], 0xfe);
+	CHECK_EQ(access_value[1], 0xff);
+	CHECK_EQ(access_value[2], 0x00);
+	CHECK_EQ(access_value[3], 0x01);
+	CHECK_EQ(regs->rsi, 0x123400000002UL);
+	CHECK_EQ(regs->rcx, 0x567800000000UL);
+
+	/* 32-bit updates clear the upper half */
+	test_init(MODE_32, false);
+	regs->rsi = 0x1234000000000010UL;
+	regs->rcx = 0x5678000000000002UL;
+	io = string_io(false, 1, true, 4);
+	io.seg_base = GUEST_MEM;
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 2);
+	CHECK_EQ(access_value[0], 0x10);
+	CHECK_EQ(regs->rsi, 0x12);
+	CHECK_EQ(regs->rcx, 0);
+
+	/* in 64-bit mode, only FS and GS have a segment base */
+	test_init(MODE_64, false);
+	regs->rsi = 0x30;
+	io = string_io(false, 1, false, 8);
+	io.seg = VCPU_SEG_FS;
+	io.seg_base = GUEST_MEM;
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(access_value[0], 0x30);
+	CHECK_EQ(regs->rsi, 0x31);
+
+	test_init(MODE_64, false);
+	regs->rsi = GUEST_MEM + 0x30;
+	io = string_io(false, 1, false, 8);
+	io.seg = 3; /* DS */
+	io.seg_base = 0x1000;
+	CHECK(vcpu_handle_string_io(&io));
+	CHECK_EQ(access_value[0], 0x30);
+}
+
+static void test_errors(void)
+{
+	union registers *regs;
+	struct vcpu_io_intercept io;
+
+	/* a failing port access keeps the progress made so far */
+	test_init(MODE_64, false);
+	regs = &cpu_data->guest_regs;
+	regs->rsi = GUEST_MEM;
+	regs->rcx = 8;
+	fail_access = 3;
+	io = string_io(false, 1, true, 8);
+	CHECK(!vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 3);
+	CHECK_EQ(regs->rsi, GUEST_MEM + 3);
+	CHECK_EQ(regs->rcx, 5);
+	CHECK_EQ(skipped_len, 0);
+
+	/* unmapped operands are rejected before accessing the port */
+	test_init(MODE_64, false);
+	regs->rdi = GUEST_MEM_END - 2;
+	regs->rcx = 4;
+	io = string_io(true, 1, true, 8);
+	CHECK(!vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 0);
+	CHECK_EQ(skipped_len, 0);
+
+	/* unknown segment */
+	test_init(MODE_64, false);
+	io = string_io(false, 1, false, 8);
+	io.seg = -1;
+	CHECK(!vcpu_handle_string_io(&io));
+	CHECK_EQ(num_accesses, 0);
+}
+
+void host_main(void)
+{
+	host_test("outs", test_outs);
+	host_test("ins", test_ins);
+	host_test("direction", test_direction);
+	host_test("chunking", test_chunking);
+	host_test("address_size", test_address_size);
+	host_test("errors", test_errors);
+}
@@ -0,0 +1,102 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include <jailhouse/paging.h>
+#include <jailhouse/percpu.h>
+#include <jailhouse/string.h>
+#include <asm/vcpu.h>
+
+#include "host.h"
+#include "x86-guest.h"
+
+u8 guest_code[GUEST_CODE_END - GUEST_CODE];
+unsigned long guest_rip;
+unsigned long guest_code_end = GUEST_CODE_END;
+u64 guest_efer;
+u16 guest_cs_attr;
+
+static struct per_cpu *cpu_data;
+
+const u8 *vcpu_get_inst_bytes(const struct guest_paging_structures *pg_structs,
+			      unsigned long pc, unsigned int *size)
+{
+	unsigned long page_end = (pc & PAGE_MASK) + PAGE_SIZE;
+
+	if (pc < GUEST_CODE || pc >= guest_code_end)
+		return NULL;
+
+	/* like the real implementation, stop at page boundaries */
+	if (*size > page_end - pc)
+		*size = page_end - pc;
+	if (*size > guest_code_end - pc)
+		*size = guest_code_end - pc;
+	return &guest_code[pc - GUEST_CODE];
+}
+
+u64 vcpu_vendor_get_efer(void)
+{
+	return guest_efer;
+}
+
+u64 vcpu_vendor_get_rip(void)
+{
+	return guest_rip;
+}
+
+u16 vcpu_vendor_get_cs_attr(void)
+{
+	return guest_cs_attr;
+}
+
+void guest_init(void)
+{
+	unsigned int n;
+
+	if (!cpu_data)
+		cpu_data = host_map_fixed(LOCAL_CPU_BASE,
+					  PAGE_ALIGN(sizeof(*cpu_data)));
+	for (n = 0; n < 16; n++)
+		cpu_data->guest_regs.by_index[n] = REG(n);
+
+	memset(guest_code, 0xcc, sizeof(guest_code));
+	guest_code_end = GUEST_CODE_END;
+	guest_set_mode(MODE_64);
+}
+
+void guest_set_mode(unsigned int mode)
+{
+	switch (mode) {
+	case MODE_64:
+		guest_efer = EFER_LMA;
+		guest_cs_attr = VCPU_CS_L;
+		break;
+	case MODE_32:
+		guest_efer = 0;
+		guest_cs_attr = VCPU_CS_DB;
+		break;
+	default:
+		guest_efer = 0;
+		guest_cs_attr = 0;
+		break;
+	}
+}
+
+/*
+ * Place the instruction bytes at rip and decode them. Bytes beyond the
+ * instruction cannot be fetched.
+ */
+struct mmio_instruction guest_parse(const u8 *bytes, unsigned int num_bytes,
+				    unsigned long rip, bool is_write)
+{
+	memcpy(&guest_code[rip - GUEST_CODE], bytes, num_bytes);
+	guest_rip = rip;
+	guest_code_end = rip + num_bytes;
+
+	return x86_mmio_parse(NULL, is_write);
+}
@@ -0,0 +1,43 @@
+/*
+ * Jailhouse, a Linux-based partitioning hypervisor
+ *
+ * Copyright (c) Siemens AG, 2026
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ *
+ * Emulated guest state for running the x86 MMIO instruction decoder on the
+ * host: guest code memory, CPU mode and registers.
+ */
+
+#ifndef _JAILHOUSE_TESTS_X86_GUEST_H
+#define _JAILHOUSE_TESTS_X86_GUEST_H
+
+#include <jailhouse/mmio.h>
+
+#define GUEST_CODE		0x7000
+#define GUEST_CODE_END		0x9000
+
+#define MODE_64			0
+#define MODE_32			1
+#define MODE_16			2
+
+/* initial value of the guest register with by_index number n */
+#define REG(n)			(0xa0a0a0a0a0a0a000UL | (n))
+#define RAX			15
+#define RCX			14
+#define RBX			12
+#define R8			7
+
+extern u8 guest_code[GUEST_CODE_END - GUEST_CODE];
+extern unsigned long guest_rip;
+extern unsigned long guest_code_end;
+extern u64 guest_efer;
+extern u16 guest_cs_attr;
+
+void guest_init(void);
+void guest_set_mode(unsigned int mode);
+struct mmio_instruction guest_parse(const u8 *bytes, unsigned int num_bytes,
+				    unsigned long rip, bool is_write);
+
+#endif /* !_JAILHOUSE_TESTS_X86_GUEST_H */
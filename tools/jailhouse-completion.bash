@@ -264,7 +264,7 @@ function _jailhouse_config_create() {
 	prev="${COMP_WORDS[COMP_CWORD-1]}"
 
 	options="-h --help -g --generate-collector -r --root -t --template-dir \
-		--mem-inmates --mem-hv"
+		--mem-inmates --mem-hv -n --non-root-cells"
 
 	# if we already have begun to write an option
 	if [[ "$cur" == -* ]]; then
@@ -277,7 +277,7 @@ function _jailhouse_config_create() {
 			_filedir -d
 			return $?
 			;;
-		--mem-inmates|--mem-hv)
+		--mem-inmates|--mem-hv|-n|--non-root-cells)
 			# we can't really predict this
 			return 0
 			;;
@@ -319,11 +319,11 @@ function _jailhouse() {
 	local command command_cell command_config cur prev subcommand
 
 	# first level
-	command="enable disable console cell config hardware --help"
+	command="enable disable console cell config hardware trace --help"
 
 	# second level
 	command_cell="create load start shutdown destroy linux list stats"
-	command_config="create collect check"
+	command_config="create collect check lint"
 
 	# ${COMP_WORDS} array containing the words on the current command line
 	# ${COMP_CWORD} index into COMP_WORDS, pointing at the current position
@@ -356,6 +356,14 @@ function _jailhouse() {
 					"${cur}") )
 			fi
 			;;
+		trace)
+			if [[ "$cur" == -* ]]; then
+				COMPREPLY=( $( compgen -W "-d --duration" -- \
+					"${cur}") )
+			else
+				_filedir
+			fi
+			;;
 		cell)
 			# one of the following subcommands
 			COMPREPLY=( $( compgen -W "${command_cell}" -- \
@@ -403,6 +411,14 @@ function _jailhouse() {
 			check)
 				_jailhouse_config_check || return 1
 				;;
+			lint)
+				if [[ "$cur" == -* ]]; then
+					COMPREPLY=( $( compgen -W "-h --help" \
+						-- "${cur}") )
+				else
+					_filedir "cell"
+				fi
+				;;
 			*)
 				return 1;;
 			esac
@@ -20,22 +20,37 @@
 #include <errno.h>
 #include <limits.h>
 #include <libgen.h>
+#include <signal.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <jailhouse.h>
+#include <jailhouse/trace-events.h>
 
 #define JAILHOUSE_EXEC_DIR	LIBEXECDIR "/jailhouse"
 #define JAILHOUSE_DEVICE	"/dev/jailhouse"
 #define JAILHOUSE_CELLS		"/sys/devices/jailhouse/cells/"
 
+#define TRACE_BATCH		256
+#define TRACE_POLL_US		100000
+
 enum shutdown_load_mode {LOAD, SHUTDOWN};
 
 struct extension {
 	char *cmd, *subcmd, *help;
 };
 
+struct trace_cpu {
+	__u32 position;
+	bool started;
+	unsigned long lost;
+	bool in_exit;
+	struct jailhouse_trace_record exit;
+};
+
 struct jailhouse_cell_info {
 	struct jailhouse_cell_id id;
 	char *state;
@@ -52,9 +67,11 @@ static const struct extension extensions[] = {
 	{ "config", "create", "[-h] [-g] [-r ROOT] [-t TEMPLATE_DIR]"
 	  " [-c CONSOLE]\n"
 	  "                 [--mem-inmates MEM_INMATES] [--mem-hv MEM_HV]\n"
-	  "                 FILE" },
+	  "                 [-n NON_ROOT_CELLS] FILE" },
 	{ "config", "collect", "FILE.TAR" },
-	{ "config", "check", "[-h] SYSCONFIG [CELLCONFIG [CELLCONFIG ...]]" },
+	{ "config", "lint", "[-h] CONFIG [CONFIG ...]" },
+	{ "config", "check", "[-h] [--json] SYSCONFIG\n"
+	  "                [CELLCONFIG [CELLCONFIG ...]]" },
 	{ "hardware", "check", "" },
 	{ NULL }
 };
@@ -75,7 +92,8 @@ static void __attribute__((noreturn)) help(char *prog, int exit_status)
 	       "             [-a | --address ADDRESS] ...\n"
 	       "   cell start { ID | [--name] NAME }\n"
 	       "   cell shutdown { ID | [--name] NAME }\n"
-	       "   cell destroy { ID | [--name] NAME }\n",
+	       "   cell destroy { ID | [--name] NAME }\n"
+	       "   trace [-d | --duration SECONDS] FILE\n",
 	       basename(prog));
 	for (ext = extensions; ext->cmd; ext++)
 		printf("   %s %s %s\n", ext->cmd, ext->subcmd, ext->help);
@@ -378,16 +396,169 @@ static int cell_list(int argc, char *argv[])
 	return 0;
 }
 
+struct image_arg {
+	const char *source;
+	bool is_string;
+	unsigned long long target_address;
+};
+
+static bool parse_image_arg(int argc, char *argv[], int *arg_num,
+			    struct image_arg *image)
+{
+	char *endp;
+
+	if (*arg_num >= argc)
+		return false;
+
+	image->is_string = match_opt(argv[*arg_num], "-s", "--string");
+	if (image->is_string) {
+		if (*arg_num + 1 >= argc)
+			help(argv[0], 1);
+		(*arg_num)++;
+	}
+	image->source = argv[(*arg_num)++];
+	image->target_address = 0;
+
+	if (*arg_num < argc &&
+	    match_opt(argv[*arg_num], "-a", "--address")) {
+		if (*arg_num + 1 >= argc)
+			help(argv[0], 1);
+		errno = 0;
+		image->target_address = strtoull(argv[*arg_num + 1], &endp, 0);
+		if (errno != 0 || *endp != 0)
+			help(argv[0], 1);
+		*arg_num += 2;
+	}
+
+	return true;
+}
+
+/*
+ * Reads an image directly into the cell memory, using a mapping of the
+ * target range provided by the driver.
+ */
+static int load_image_mapped(int cell_fd, const struct image_arg *image)
+{
+	unsigned long page_offs;
+	size_t size, done = 0;
+	int fd = -1, err = 0;
+	ssize_t result;
+	struct stat st;
+	char *mem;
+
+	page_offs = image->target_address & (sysconf(_SC_PAGESIZE) - 1);
+
+	if (image->is_string) {
+		size = strlen(image->source) + 1;
+	} else {
+		fd = open(image->source, O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "opening %s: %s\n", image->source,
+				strerror(errno));
+			exit(1);
+		}
+		if (fstat(fd, &st) < 0) {
+			perror("fstat");
+			exit(1);
+		}
+		size = st.st_size;
+	}
+
+	if (size == 0)
+		goto out;
+
+	mem = mmap(NULL, page_offs + size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   cell_fd, image->target_address - page_offs);
+	if (mem == MAP_FAILED) {
+		fprintf(stderr, "mapping cell memory at 0x%llx: %s\n",
+			image->target_address, strerror(errno));
+		err = -1;
+		goto out;
+	}
+
+	if (image->is_string) {
+		memcpy(mem + page_offs, image->source, size);
+	} else {
+		while (done < size) {
+			result = read(fd, mem + page_offs + done, size - done);
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result < 0) {
+				fprintf(stderr, "reading %s: %s\n",
+					image->source, strerror(errno));
+				err = -1;
+				break;
+			}
+			if (result == 0)
+				break;
+			done += result;
+		}
+	}
+
+	munmap(mem, page_offs + size);
+
+out:
+	if (fd >= 0)
+		close(fd);
+
+	return err;
+}
+
+/*
+ * Fallback for drivers without JAILHOUSE_CELL_MMAP: read all images into
+ * buffers and let the driver copy them into the cell.
+ */
+static int load_images_copied(int fd, const struct jailhouse_cell_id *cell_id,
+			      int argc, char *argv[], int arg_num,
+			      unsigned int images)
+{
+	struct jailhouse_preload_image *preload;
+	struct jailhouse_cell_load *cell_load;
+	struct image_arg image;
+	unsigned int n;
+	size_t size;
+	int err;
+
+	cell_load = malloc(sizeof(*cell_load) + sizeof(*preload) * images);
+	if (!cell_load) {
+		fprintf(stderr, "insufficient memory\n");
+		exit(1);
+	}
+	cell_load->cell_id = *cell_id;
+	cell_load->num_preload_images = images;
+
+	preload = cell_load->image;
+	while (parse_image_arg(argc, argv, &arg_num, &image)) {
+		if (image.is_string)
+			preload->source_address =
+				(unsigned long)read_string(image.source, &size);
+		else
+			preload->source_address =
+				(unsigned long)read_file(image.source, &size);
+		preload->size = size;
+		preload->target_address = image.target_address;
+		preload++;
+	}
+
+	err = ioctl(fd, JAILHOUSE_CELL_LOAD, cell_load);
+	if (err)
+		perror("JAILHOUSE_CELL_LOAD");
+
+	for (n = 0, preload = cell_load->image; n < images; n++, preload++)
+		free((void *)(unsigned long)preload->source_address);
+	free(cell_load);
+
+	return err;
+}
+
 static int cell_shutdown_load(int argc, char *argv[],
 			      enum shutdown_load_mode mode)
 {
-	struct jailhouse_preload_image *image;
-	struct jailhouse_cell_load *cell_load;
+	struct jailhouse_cell_load cell_load;
 	struct jailhouse_cell_id cell_id;
-	int err, fd, id_args, arg_num;
-	unsigned int images, n;
-	size_t size;
-	char *endp;
+	int err, fd, cell_fd, id_args, arg_num;
+	struct image_arg image;
+	unsigned int images;
 
 	id_args = parse_cell_id(&cell_id, argc - 3, &argv[3]);
 	arg_num = 3 + id_args;
@@ -396,69 +567,45 @@ static int cell_shutdown_load(int argc, char *argv[],
 		help(argv[0], 1);
 
 	images = 0;
-	while (arg_num < argc) {
-		if (match_opt(argv[arg_num], "-s", "--string")) {
-			if (arg_num + 1 >= argc)
-				help(argv[0], 1);
-			arg_num++;
-		}
-
+	while (parse_image_arg(argc, argv, &arg_num, &image))
 		images++;
-		arg_num++;
 
-		if (arg_num < argc &&
-		    match_opt(argv[arg_num], "-a", "--address")) {
-			if (arg_num + 1 >= argc)
-				help(argv[0], 1);
-			arg_num += 2;
-		}
-	}
+	fd = open_dev();
 
-	cell_load = malloc(sizeof(*cell_load) + sizeof(*image) * images);
-	if (!cell_load) {
-		fprintf(stderr, "insufficient memory\n");
-		exit(1);
+	/* shut down the cell and make its memory loadable */
+	memset(&cell_load, 0, sizeof(cell_load));
+	cell_load.cell_id = cell_id;
+	err = ioctl(fd, JAILHOUSE_CELL_LOAD, &cell_load);
+	if (err) {
+		perror("JAILHOUSE_CELL_LOAD");
+		goto out;
 	}
-	cell_load->cell_id = cell_id;
-	cell_load->num_preload_images = images;
+
+	if (images == 0)
+		goto out;
 
 	arg_num = 3 + id_args;
 
-	for (n = 0, image = cell_load->image; n < images; n++, image++) {
-		if (match_opt(argv[arg_num], "-s", "--string")) {
-			arg_num++;
-			image->source_address =
-				(unsigned long)read_string(argv[arg_num++],
-							   &size);
-		} else {
-			image->source_address =
-				(unsigned long)read_file(argv[arg_num++],
-							 &size);
-		}
-		image->size = size;
-		image->target_address = 0;
-
-		if (arg_num < argc &&
-		    match_opt(argv[arg_num], "-a", "--address")) {
-			errno = 0;
-			image->target_address =
-				strtoull(argv[arg_num + 1], &endp, 0);
-			if (errno != 0 || *endp != 0)
-				help(argv[0], 1);
-			arg_num += 2;
+	cell_fd = ioctl(fd, JAILHOUSE_CELL_MMAP, &cell_id);
+	if (cell_fd < 0) {
+		/* only fall back if the driver lacks the mmap interface */
+		if (errno != ENOTTY && errno != EOPNOTSUPP) {
+			perror("JAILHOUSE_CELL_MMAP");
+			err = cell_fd;
+			goto out;
 		}
+		err = load_images_copied(fd, &cell_id, argc, argv, arg_num,
+					 images);
+		goto out;
 	}
 
-	fd = open_dev();
+	while (!err && parse_image_arg(argc, argv, &arg_num, &image))
+		err = load_image_mapped(cell_fd, &image);
 
-	err = ioctl(fd, JAILHOUSE_CELL_LOAD, cell_load);
-	if (err)
-		perror("JAILHOUSE_CELL_LOAD");
+	close(cell_fd);
 
+out:
 	close(fd);
-	for (n = 0, image = cell_load->image; n < images; n++, image++)
-		free((void *)(unsigned long)image->source_address);
-	free(cell_load);
 
 	return err;
 }
@@ -553,6 +700,182 @@ out:
 	return ret;
 }
 
+static const char * const trace_event_names[] = {
+	[JAILHOUSE_TRACE_IRQ_INJECT]		= "irq-inject",
+	[JAILHOUSE_TRACE_HYPERCALL]		= "hypercall",
+	[JAILHOUSE_TRACE_IVSHMEM_DOORBELL]	= "ivshmem-doorbell",
+};
+
+static volatile sig_atomic_t trace_stop;
+
+static void trace_signal(int signum)
+{
+	trace_stop = signum;
+}
+
+static double trace_ts_us(__u64 timestamp, unsigned int timestamp_khz)
+{
+	/* without a known frequency, assume nanoseconds */
+	if (!timestamp_khz)
+		return timestamp / 1000.0;
+	return timestamp * 1000.0 / timestamp_khz;
+}
+
+/*
+ * Writes a record as event of the Trace Event Format that can be loaded by
+ * Perfetto and chrome://tracing. VM exits are reported as complete events
+ * once they are done, root cell suspensions as begin/end pairs.
+ */
+static void trace_write_record(FILE *out, struct trace_cpu *tcpu,
+			       const struct jailhouse_trace_record *rec,
+			       unsigned int timestamp_khz)
+{
+	double ts = trace_ts_us(rec->timestamp, timestamp_khz);
+	const char *name = NULL;
+
+	switch (rec->event) {
+	case JAILHOUSE_TRACE_VMEXIT:
+		tcpu->exit = *rec;
+		tcpu->in_exit = true;
+		break;
+	case JAILHOUSE_TRACE_VMEXIT_DONE:
+		if (!tcpu->in_exit)
+			break;
+		tcpu->in_exit = false;
+		fprintf(out, ",\n{\"name\":\"vmexit\",\"ph\":\"X\","
+			"\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,"
+			"\"args\":{\"reason\":\"0x%llx\",\"pc\":\"0x%llx\"}}",
+			trace_ts_us(tcpu->exit.timestamp, timestamp_khz),
+			ts - trace_ts_us(tcpu->exit.timestamp, timestamp_khz),
+			rec->cpu, (unsigned long long)tcpu->exit.arg[0],
+			(unsigned long long)tcpu->exit.arg[1]);
+		break;
+	case JAILHOUSE_TRACE_MANAGEMENT_BEGIN:
+		fprintf(out, ",\n{\"name\":\"root-suspend\",\"ph\":\"B\","
+			"\"ts\":%.3f,\"pid\":0,\"tid\":%u}", ts, rec->cpu);
+		break;
+	case JAILHOUSE_TRACE_MANAGEMENT_END:
+		fprintf(out, ",\n{\"name\":\"root-suspend\",\"ph\":\"E\","
+			"\"ts\":%.3f,\"pid\":0,\"tid\":%u,"
+			"\"args\":{\"duration_us\":%llu}}", ts, rec->cpu,
+			(unsigned long long)rec->arg[0]);
+		break;
+	default:
+		if (rec->event < sizeof(trace_event_names) /
+				 sizeof(trace_event_names[0]))
+			name = trace_event_names[rec->event];
+		fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+			"\"ts\":%.3f,\"pid\":0,\"tid\":%u,"
+			"\"args\":{\"event\":%u,\"arg0\":\"0x%llx\","
+			"\"arg1\":\"0x%llx\"}}", name ? : "unknown", ts,
+			rec->cpu, rec->event, (unsigned long long)rec->arg[0],
+			(unsigned long long)rec->arg[1]);
+		break;
+	}
+}
+
+static int trace(int argc, char *argv[])
+{
+	struct jailhouse_trace_record records[TRACE_BATCH];
+	struct jailhouse_trace_query query;
+	struct trace_cpu *cpus = NULL;
+	unsigned int max_cpus = 1, cpu, duration = 0;
+	struct timespec start, now;
+	int fd, ret, n, arg_num = 2;
+	FILE *out;
+
+	if (argc >= 4 && match_opt(argv[2], "-d", "--duration")) {
+		duration = strtoul(argv[3], NULL, 0);
+		arg_num = 4;
+	}
+	if (argc != arg_num + 1)
+		help(argv[0], 1);
+
+	fd = open_dev();
+
+	out = fopen(argv[arg_num], "w");
+	if (!out) {
+		perror(argv[arg_num]);
+		exit(1);
+	}
+
+	signal(SIGINT, trace_signal);
+	signal(SIGTERM, trace_signal);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	fprintf(out, "{\"traceEvents\":[\n{\"name\":\"process_name\","
+		"\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"jailhouse\"}}");
+
+	while (!trace_stop) {
+		for (cpu = 0; cpu < max_cpus; cpu++) {
+			do {
+				memset(&query, 0, sizeof(query));
+				query.buffer_address = (unsigned long)records;
+				query.buffer_size = sizeof(records);
+				query.cpu = cpu;
+				if (cpus)
+					query.position = cpus[cpu].position;
+
+				ret = ioctl(fd, JAILHOUSE_TRACE_READ, &query);
+				if (ret < 0) {
+					if (errno == EOPNOTSUPP)
+						fprintf(stderr, "hypervisor "
+							"built without "
+							"CONFIG_TRACE_EVENTS\n");
+					else
+						perror("JAILHOUSE_TRACE_READ");
+					goto out;
+				}
+
+				if (!cpus) {
+					max_cpus = query.max_cpus;
+					cpus = calloc(max_cpus, sizeof(*cpus));
+					if (!cpus) {
+						fprintf(stderr,
+							"insufficient memory\n");
+						exit(1);
+					}
+				}
+
+				if (cpus[cpu].started)
+					cpus[cpu].lost += query.position -
+						cpus[cpu].position;
+				cpus[cpu].started = true;
+				cpus[cpu].position = query.position + ret;
+
+				for (n = 0; n < ret; n++)
+					trace_write_record(out, &cpus[cpu],
+							   &records[n],
+							   query.timestamp_khz);
+			} while (ret == TRACE_BATCH);
+		}
+
+		if (duration) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec - start.tv_sec >= duration)
+				break;
+		}
+		usleep(TRACE_POLL_US);
+	}
+	ret = 0;
+
+out:
+	fprintf(out, "\n]}\n");
+	if (fclose(out) != 0) {
+		perror(argv[arg_num]);
+		ret = -1;
+	}
+	close(fd);
+
+	for (cpu = 0; cpus && cpu < max_cpus; cpu++)
+		if (cpus[cpu].lost)
+			fprintf(stderr, "CPU %u: %lu trace records lost\n",
+				cpu, cpus[cpu].lost);
+	free(cpus);
+
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	int fd;
@@ -573,6 +896,8 @@ int main(int argc, char *argv[])
 		err = cell_management(argc, argv);
 	} else if (strcmp(argv[1], "console") == 0) {
 		err = console(argc, argv);
+	} else if (strcmp(argv[1], "trace") == 0) {
+		err = trace(argc, argv);
 	} else if (strcmp(argv[1], "config") == 0 ||
 		   strcmp(argv[1], "hardware") == 0) {
 		call_extension_script(argv[1], argc, argv);